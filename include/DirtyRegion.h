@@ -0,0 +1,106 @@
+/**
+ * @file DirtyRegion.h
+ * @brief Dirty-rectangle accumulator for the VNC display driver
+ *
+ * Collects the rectangles touched while decoding a FramebufferUpdate and
+ * merges overlapping or adjacent ones, so the changed screen area can be
+ * flushed to the panel in a few large transfers instead of one per tile.
+ */
+
+#pragma once
+
+#ifndef DIRTYREGION_H
+#define DIRTYREGION_H
+
+#include <stdint.h>
+
+/**
+ * @struct DirtyRect
+ * @brief Rectangle in screen coordinates
+ */
+struct DirtyRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t w;
+    uint32_t h;
+};
+
+/**
+ * @struct DirtyStats
+ * @brief Counters of the dirty region tracker
+ */
+struct DirtyStats {
+    uint32_t received;  ///< Rectangles passed to add()
+    uint32_t merged;    ///< Rectangles folded into another one
+    uint32_t flushed;   ///< Rectangles handed out for flushing
+};
+
+/**
+ * @class DirtyRegion
+ * @brief Fixed-capacity set of non-redundant dirty rectangles
+ *
+ * Two rectangles are merged when their bounding box is not larger than the
+ * sum of their areas, i.e. when they overlap or share an edge. Merging is
+ * repeated with the grown rectangle, so a full row of ZRLE tiles collapses
+ * into one strip and consecutive strips into one block. When the set is
+ * full, the new rectangle is merged into the one whose bounding box grows
+ * least.
+ */
+class DirtyRegion {
+public:
+    static const uint8_t MAX_RECTS = 32;
+
+    DirtyRegion();
+
+    /**
+     * @brief Add a rectangle to the region
+     */
+    void add(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
+    /**
+     * @brief Remove all rectangles (counters are kept)
+     */
+    void clear();
+
+    /**
+     * @brief Check if nothing is dirty
+     */
+    bool isEmpty() const { return _count == 0; }
+
+    /**
+     * @brief Number of rectangles currently held
+     */
+    uint8_t count() const { return _count; }
+
+    /**
+     * @brief Access a rectangle, 0 <= i < count()
+     */
+    const DirtyRect& rect(uint8_t i) const { return _rects[i]; }
+
+    /**
+     * @brief Count rectangles as flushed and clear the region
+     */
+    void flushed();
+
+    /**
+     * @brief Get the counters
+     */
+    const DirtyStats& stats() const { return _stats; }
+
+    /**
+     * @brief Reset the counters
+     */
+    void resetStats();
+
+private:
+    static uint64_t area(const DirtyRect& r);
+    static DirtyRect bounds(const DirtyRect& a, const DirtyRect& b);
+
+    void remove(uint8_t i);
+
+    DirtyRect _rects[MAX_RECTS];
+    uint8_t _count;
+    DirtyStats _stats;
+};
+
+#endif // DIRTYREGION_H
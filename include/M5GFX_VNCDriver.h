@@ -22,9 +22,27 @@
 
 #include "VNC_config.h"
 #include "VNC.h"
+#include "frameBuffer.h"
+#include "DirtyRegion.h"
+#include "RingQueue.h"
+#include <atomic>
 #include <M5Unified.h>
 #include <M5GFX.h>
 
+/**
+ * @struct PresentStats
+ * @brief Counters of the present queue between decode and present task
+ */
+struct PresentStats {
+    uint32_t queued;     ///< Regions handed to the present task
+    uint32_t presented;  ///< Regions pushed to the panel by present()
+    uint32_t stalls;     ///< Times the decode task waited on a full queue
+    uint32_t maxDepth;   ///< Highest queue depth seen
+    uint32_t writes;     ///< Regions written to the panel
+    uint64_t writeUs;    ///< Time spent writing them
+    uint32_t maxWriteUs; ///< Longest single write
+};
+
 /**
  * @class M5GFX_VNCDriver
  * @brief VNC display driver implementation for M5Stack Tab5
@@ -32,6 +50,14 @@
  * This class implements the VNCdisplay interface using M5GFX library,
  * providing display rendering and touch input capabilities for VNC sessions.
  * Supports pausing/resuming screen drawing while maintaining VNC connection.
+ * 
+ * Optionally a full-screen shadow framebuffer in PSRAM holds the remote
+ * desktop. All updates land there first, so CopyRect needs no panel readback
+ * and updates received while paused are kept instead of dropped.
+ * Rectangles decoded within one FramebufferUpdate are collected in a
+ * DirtyRegion and flushed to the panel together when the update ends.
+ * The flush can be handed to a present task on the other core, so network
+ * reads and decoding overlap with panel transfers.
  */
 class M5GFX_VNCDriver : public VNCdisplay {
 public:
@@ -54,6 +80,12 @@ public:
      */
     bool hasCopyRect(void) override;
     
+    /**
+     * @brief Check if the display decodes JPEG rectangles of the Tight encoding
+     * @return true, M5GFX brings its own JPEG decoder
+     */
+    bool hasJpeg(void) override;
+    
     /**
      * @brief Get display height
      * @return Display height in pixels
@@ -72,7 +104,7 @@ public:
      * @param y Y coordinate
      * @param w Width of the area
      * @param h Height of the area
-     * @param data Pointer to RGB565 pixel data
+     * @param data Pointer to RGB565 pixel data in the negotiated byte order (w * h pixels)
      */
     void draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t* data) override;
     
@@ -82,7 +114,7 @@ public:
      * @param y Y coordinate
      * @param w Width of the rectangle
      * @param h Height of the rectangle
-     * @param color RGB565 color value
+     * @param color Native RGB565 color value
      */
     void draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color) override;
     
@@ -97,6 +129,18 @@ public:
      */
     void copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h) override;
     
+    /**
+     * @brief Decode a JPEG image into a rectangle
+     * @param x X coordinate
+     * @param y Y coordinate
+     * @param w Width of the rectangle
+     * @param h Height of the rectangle
+     * @param data JPEG data, only valid during the call
+     * @param len Length of the JPEG data
+     * @return false if the data could not be decoded
+     */
+    bool draw_jpeg(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t* data, size_t len) override;
+    
     /**
      * @brief Start an area update operation
      * @param x X coordinate
@@ -108,7 +152,11 @@ public:
     
     /**
      * @brief Send pixel data during area update
-     * @param data Pointer to pixel data
+     * 
+     * Data is streamed into the address window opened by area_update_start().
+     * Consecutive calls continue where the previous one stopped, even mid-row.
+     * 
+     * @param data Pointer to RGB565 pixel data in the negotiated byte order
      * @param pixel Number of pixels
      */
     void area_update_data(char* data, uint32_t pixel) override;
@@ -118,6 +166,22 @@ public:
      */
     void area_update_end(void) override;
     
+    /**
+     * @brief Start collecting dirty rectangles of a FramebufferUpdate
+     */
+    void framebuffer_update_start(void) override;
+    
+    /**
+     * @brief Flush the dirty rectangles of a FramebufferUpdate to the panel
+     */
+    void framebuffer_update_end(void) override;
+
+    /**
+     * @brief Regions handed to the present task but not yet on the panel
+     * @return Number of queued or in-flight regions (0 without a present task)
+     */
+    uint32_t present_backlog(void) override;
+    
     /**
      * @brief Override VNC options (optional)
      * @param opt Pointer to VNC options structure
@@ -132,8 +196,9 @@ public:
      * 
      * When paused, VNC communication continues but no drawing updates are applied.
      * This allows displaying alternative screens while keeping the VNC session alive.
+     * Pausing waits until a push to the panel in progress has finished.
      */
-    void setPaused(bool paused) { _isPaused = paused; }
+    void setPaused(bool paused);
     
     /**
      * @brief Check if screen drawing is paused
@@ -141,6 +206,102 @@ public:
      */
     bool isPaused() const { return _isPaused; }
 
+    /**
+     * @brief Allocate the shadow framebuffer in PSRAM
+     * @return true if the shadow framebuffer is in use
+     * 
+     * Must be called before the VNC session starts. If the allocation fails
+     * the driver keeps drawing straight to the panel.
+     */
+    bool enableShadowBuffer();
+    
+    /**
+     * @brief Check if the shadow framebuffer is in use
+     * @return true if a shadow framebuffer is allocated
+     */
+    bool hasShadowBuffer() const { return _hasShadow; }
+    
+    /**
+     * @brief Redraw the whole panel from the shadow framebuffer
+     * 
+     * Used when returning from another screen instead of requesting a full
+     * update from the server. Does nothing without a shadow framebuffer.
+     */
+    void repaint();
+    
+    /**
+     * @brief Set the maximum time dirty rectangles are held back
+     * @param ms Deadline in milliseconds, 0 flushes only at the end of an update
+     * 
+     * Only used with the shadow framebuffer.
+     */
+    void setFlushDeadline(uint32_t ms) { _flushDeadline = ms; }
+    
+    /**
+     * @brief Get the counters of the dirty rectangle tracker
+     * @return Rectangles received, merged and flushed since start
+     */
+    const DirtyStats& getDirtyStats() const { return _dirty.stats(); }
+    
+    /**
+     * @brief Hand panel transfers to a present task
+     * @param task Task that calls present(), or nullptr to push from the decode task
+     * 
+     * Flushed regions are queued and the task is notified instead of pushing
+     * them to the panel directly. Only used with the shadow framebuffer.
+     * Set it before the VNC session starts.
+     */
+    void setPresentTask(TaskHandle_t task);
+    
+    /**
+     * @brief Push all queued regions to the panel
+     * @return Number of regions pushed
+     * 
+     * Called by the present task after it has been notified.
+     */
+    uint32_t present();
+    
+    /**
+     * @brief Get the counters of the present queue
+     */
+    const PresentStats& getPresentStats() const { return _presentStats; }
+
+    // Overlay methods
+
+    /**
+     * @brief Reserve a corner of the panel for an overlay
+     * @param x Left edge of the overlay
+     * @param y Top edge of the overlay
+     * @param w Width of the overlay
+     * @param h Height of the overlay
+     * @return false without shadow framebuffer or if the canvas cannot be allocated
+     *
+     * Remote content keeps going into the shadow framebuffer, but regions
+     * pushed to the panel leave the overlay area out.
+     */
+    bool setOverlay(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
+    /**
+     * @brief Give the overlay area back to the remote desktop and repaint it
+     */
+    void clearOverlay();
+
+    /**
+     * @brief Check if an overlay is reserved
+     */
+    bool hasOverlay() const { return _overlayOn; }
+
+    /**
+     * @brief Canvas of the overlay, draw into it and call presentOverlay()
+     * @return nullptr without overlay or while the last canvas is not on the panel yet
+     */
+    LGFX_Sprite* overlayCanvas();
+
+    /**
+     * @brief Have the present task push the overlay canvas to the panel
+     */
+    void presentOverlay();
+
     // Additional helper methods
     
     /**
@@ -164,13 +325,51 @@ public:
     void clear(uint16_t color = 0x0000);
 
 private:
+    /**
+     * @brief Push a region of the shadow framebuffer to the panel
+     */
+    void pushShadow(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
+    /**
+     * @brief Push a region of the shadow framebuffer, leaving the overlay out
+     */
+    void pushVisible(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+    
+    /**
+     * @brief Record a changed region of the shadow framebuffer
+     */
+    void markDirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+    
+    /**
+     * @brief Push all dirty regions to the panel
+     */
+    void flush();
+
     M5GFX* _gfx;           ///< Pointer to M5GFX display object
-    bool _isPaused;         ///< Flag to pause/resume drawing
+    std::atomic<bool> _isPaused;    ///< Flag to pause/resume drawing
+    bool _hasShadow;        ///< Shadow framebuffer is allocated
+    FrameBuffer _shadow;    ///< Full-screen copy of the remote desktop (PSRAM)
     uint32_t _updateX;      ///< Current update area X coordinate
     uint32_t _updateY;      ///< Current update area Y coordinate
     uint32_t _updateW;      ///< Current update area width
     uint32_t _updateH;      ///< Current update area height
-    uint32_t _pixelCount;   ///< Pixel counter for area updates
+    uint32_t _updateCol;    ///< Column cursor inside the current update area
+    uint32_t _updateRow;    ///< Row cursor inside the current update area
+    DirtyRegion _dirty;     ///< Regions of the shadow not yet on the panel
+    bool _inUpdate;         ///< Inside a FramebufferUpdate message
+    uint32_t _flushDeadline;    ///< Max ms to hold back dirty regions (0 = until update end)
+    unsigned long _dirtySince;  ///< millis() when the first pending region was added
+    std::atomic<bool> _dropDirty;   ///< setPaused() asks the decode task to clear _dirty
+    RingQueue<DirtyRect, 64> _presentQueue; ///< Regions waiting for the present task
+    TaskHandle_t _presentTask;  ///< Consumer of _presentQueue (nullptr = push directly)
+    SemaphoreHandle_t _panelLock;   ///< Held while the shadow or overlay is pushed
+    std::atomic<bool> _repaintPending;  ///< Full repaint requested for the present task
+    std::atomic<uint32_t> _presentBacklog; ///< Queued regions not yet pushed to the panel
+    LGFX_Sprite _overlay;       ///< Overlay canvas (PSRAM)
+    DirtyRect _overlayArea;     ///< Panel area reserved for the overlay
+    std::atomic<bool> _overlayOn;       ///< Pushed regions leave _overlayArea out
+    std::atomic<bool> _overlayPending;  ///< Overlay canvas waits for the present task
+    PresentStats _presentStats; ///< Present queue counters
 };
 
 #endif // ESP32
@@ -0,0 +1,79 @@
+/**
+ * @file RingQueue.h
+ * @brief Bounded lock-free single-producer/single-consumer queue
+ *
+ * Used to hand work from the VNC decode task to the present task running on
+ * the other core without taking a lock on either side.
+ */
+
+#pragma once
+
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * @class RingQueue
+ * @brief Fixed-size SPSC ring buffer
+ * @tparam T Element type (copied in and out)
+ * @tparam N Capacity, must be a power of two
+ *
+ * push() may only be called by one task and pop() by one other task.
+ * Head and tail are free-running counters, so all N slots are usable.
+ */
+template <typename T, uint32_t N>
+class RingQueue {
+    static_assert(N && !(N & (N - 1)), "RingQueue capacity must be a power of two");
+
+public:
+    RingQueue() : _head(0), _tail(0) {}
+
+    /**
+     * @brief Append an element (producer side)
+     * @return false if the queue is full
+     */
+    bool push(const T& item) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= N) {
+            return false;
+        }
+        _items[head & (N - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest element (consumer side)
+     * @return false if the queue is empty
+     */
+    bool pop(T& item) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _items[tail & (N - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Number of queued elements (a snapshot when called concurrently)
+     */
+    uint32_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Capacity of the queue
+     */
+    static constexpr uint32_t capacity() { return N; }
+
+private:
+    T _items[N];
+    std::atomic<uint32_t> _head;    ///< Next slot to write, owned by the producer
+    std::atomic<uint32_t> _tail;    ///< Next slot to read, owned by the consumer
+};
+
+#endif // RINGQUEUE_H
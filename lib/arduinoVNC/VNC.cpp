@@ -44,16 +44,96 @@ extern "C" {
 #include "d3des.h"
 }
 
+/// running average over about the last 8 samples, the first one is taken as is
+static inline void vnc_average(uint32_t * avg, uint32_t sample) {
+    *avg = *avg ? *avg - *avg / 8 + sample / 8 : sample;
+}
+
+#ifdef VNC_AUTO_ENCODING
+/// candidates of the automatic encoding selection, most compression first
+static const int32_t vnc_auto_ladder[] = {
+#if defined(VNC_TIGHT) && defined(VNC_JPEG_QUALITY)
+    rfbEncodingTight,   // with JPEG it beats everything else on photos
+#endif
+#ifdef VNC_ZRLE
+    rfbEncodingZRLE,
+#endif
+#if defined(VNC_TIGHT) && !defined(VNC_JPEG_QUALITY)
+    rfbEncodingTight,
+#endif
+#ifdef VNC_ZLIB
+    rfbEncodingZlib,
+#endif
+#ifdef VNC_HEXTILE
+    rfbEncodingHextile,
+#endif
+    rfbEncodingRaw
+};
+
+#define VNC_AUTO_STEPS (sizeof(vnc_auto_ladder) / sizeof(vnc_auto_ladder[0]))
+static_assert(VNC_AUTO_STEPS <= VNC_AUTO_CANDIDATES, "VNC_AUTO_CANDIDATES is too small");
+
+/// the link is the bottleneck above, the decoder below
+#define VNC_AUTO_LINK_BOUND 50
+#define VNC_AUTO_CPU_BOUND 15
+#endif
+
 //#############################################################################################
 
 arduinoVNC::arduinoVNC(VNCdisplay * _display) {
     host = "";
     port = 5900;
     display = _display;
+    panel = _display;
+#ifdef VNC_SCALING
+    scaleMode = VNC_SCALE_NONE;
+#endif
     opt = {0};
     sock = 0;
     protocolMinorVersion = 3;
     onlyFullUpdate = false;
+    fenceSupported = false;
+    cuSupported = false;
+    cuActive = false;
+    cuPaused = false;
+    cuEndPending = false;
+    cuRegion = { 0 };
+    fenceSent = 0;
+    fenceAcked = 0;
+    rx_buf = NULL;
+    rx_head = 0;
+    rx_tail = 0;
+    rx_total = 0;
+    rx_waitUs = 0;
+    stats = { 0 };
+    requestPending = false;
+    requestTime = 0;
+    requestUs = 0;
+    requestEarly = false;
+    presentPending = false;
+    presentStart = 0;
+#ifdef VNC_RECORDER
+    recorder = NULL;
+#endif
+#ifdef VNC_ZSTREAMS
+    zstream_zlen = 0;
+#endif
+#ifdef VNC_HEXTILE
+    hextile_strip = NULL;
+#endif
+#ifdef VNC_ZLIBHEX
+    hextile_zs = NULL;
+#endif
+#ifdef VNC_ZYWRLE
+    zywrle = NULL;
+    zywrle_level = 0;
+#endif
+#ifdef VNC_TIGHT
+    tight_pixels = NULL;
+    tight_data = NULL;
+    tight_jpeg = NULL;
+    tight_jpeg_size = 0;
+#endif
 #ifdef VNC_RICH_CURSOR
     richCursorData = NULL;
     richCursorMask = NULL;
@@ -62,6 +142,30 @@ arduinoVNC::arduinoVNC(VNCdisplay * _display) {
 
 arduinoVNC::~arduinoVNC(void) {
     TCPclient.stop();
+    if(rx_buf) {
+        freeSec(rx_buf);
+    }
+#ifdef VNC_HEXTILE
+    if(hextile_strip) {
+        freeSec(hextile_strip);
+    }
+#endif
+#ifdef VNC_ZYWRLE
+    if(zywrle) {
+        freeSec(zywrle);
+    }
+#endif
+#ifdef VNC_TIGHT
+    if(tight_pixels) {
+        freeSec(tight_pixels);
+    }
+    if(tight_data) {
+        freeSec(tight_data);
+    }
+    if(tight_jpeg) {
+        freeSec(tight_jpeg);
+    }
+#endif
 #ifdef VNC_RICH_CURSOR
     if(richCursorData) {
         freeSec(richCursorData);
@@ -92,7 +196,11 @@ void arduinoVNC::begin(char *_host, uint16_t _port, bool _onlyFullUpdate) {
     opt.client.bpp = 16;
     opt.client.depth = 16;
 
+#if defined(VNC_NATIVE_PIXEL_ORDER) && !defined(WORDS_BIGENDIAN)
+    opt.client.bigendian = 0;
+#else
     opt.client.bigendian = 1;
+#endif
     opt.client.truecolour = 1;
 
     opt.client.redmax = 31;
@@ -108,7 +216,11 @@ void arduinoVNC::begin(char *_host, uint16_t _port, bool _onlyFullUpdate) {
 #else
     opt.client.compresslevel = 99;
 #endif
+#ifdef VNC_JPEG_QUALITY
+    opt.client.quality = VNC_JPEG_QUALITY;
+#else
     opt.client.quality = 99;
+#endif
 
     opt.shared = 1;
     opt.localcursor = 1;
@@ -149,7 +261,6 @@ void arduinoVNC::setPassword(String pass) {
 void arduinoVNC::loop(void) {
 
     static uint16_t fails = 0;
-    static unsigned long lastUpdate = 0;
 
 #if defined(ESP8266) || defined(ESP32)
     if(WiFi.status() != WL_CONNECTED) {
@@ -176,6 +287,25 @@ void arduinoVNC::loop(void) {
             return;
         }
 
+        // the server announces Fence and ContinuousUpdates in reply to the encodings
+        fenceSupported = false;
+        cuSupported = false;
+        cuActive = false;
+        cuPaused = false;
+        cuEndPending = false;
+        fenceSent = 0;
+        fenceAcked = 0;
+        stats = { 0 };
+        requestPending = false;
+        requestEarly = false;
+        presentPending = false;
+#ifdef VNC_AUTO_ENCODING
+        rfb_auto_reset();
+#endif
+#ifdef VNC_METRICS
+        metrics.reset();
+#endif
+
         /* Tell the VNC server which pixel format and encodings we want to use */
         if(!rfb_set_format_and_encodings()) {
             DEBUG_VNC("Error negotiating format and encodings. Exiting.\n");
@@ -194,51 +324,22 @@ void arduinoVNC::loop(void) {
         }
 #endif
 
-        /* calculate horizontal and vertical offset */
-        if(opt.client.width > opt.server.width) {
-            opt.h_offset = rint((opt.client.width - opt.server.width) / 2);
-        }
-        if(opt.client.height > opt.server.height) {
-            opt.v_offset = rint((opt.client.height - opt.server.height) / 2);
-        }
-
         mousestate.x = opt.client.width / 2;
         mousestate.y = opt.client.height / 2;
 
-        // no scale support for embedded systems!
-        opt.h_ratio = 1; //(double) opt.client.width / (double) opt.server.width;
-        opt.v_ratio = 1; //(double) opt.client.height / (double) opt.server.height;
+        // scaling is done by VNCscaler (VNC_SCALING), pointer events are mapped in rfb_update_mouse
+        opt.h_ratio = 1;
+        opt.v_ratio = 1;
 
 
+        // polled until the server turns out to support continuous updates
         rfb_send_update_request(0);
-        //rfb_set_continuous_updates(1);
 
         DEBUG_VNC("vnc_connect Done.\n");
 
-#if defined(VNC_ZLIB) || defined(VNC_ZRLE)
-        if (!zin) {
-            zin = (uint8_t *)malloc(ZRLE_INPUT_BUFFER);
-        }
-        if (!zin) {
-            DEBUG_VNC("zin_buffer malloc failed!\n");
-        }
-
-        if (!zout) {
-            zout = (uint8_t *)malloc(ZRLE_OUTPUT_BUFFER);
-        }
-        if (!zout) {
-            DEBUG_VNC("zout malloc failed!\n");
-        }
-
-        tinfl_init(&inflator);
-        // reset dict
-        memset(zout, 0, ZRLE_OUTPUT_BUFFER);
-        zout_next = zout;
-
-#ifdef VNC_ZRLE
-        zout_read = zout;
-#endif // #ifdef VNC_ZRLE
-
+#ifdef VNC_ZSTREAMS
+        // a new connection starts with fresh zlib streams
+        zstreams.resetAll();
 #endif
 
     } else {
@@ -247,9 +348,20 @@ void arduinoVNC::loop(void) {
             return;
         }
 
-        if((millis() - lastUpdate) > updateDelay) {
+#ifdef VNC_AUTO_ENCODING
+        if(!rfb_auto_encoding()) {
+            disconnect();
+            return;
+        }
+#endif
+
+        if(cuActive || cuPaused || (cuSupported && fenceSupported && !onlyFullUpdate)) {
+            // the server pushes the updates
+            if(!rfb_pace_continuous_updates()) {
+                disconnect();
+            }
+        } else if(rfb_update_wanted()) {
             if(rfb_send_update_request(onlyFullUpdate ? 0 : 1)) {
-                lastUpdate = millis();
                 fails = 0;
             } else {
                 fails++;
@@ -271,8 +383,92 @@ int arduinoVNC::forceFullUpdate(void) {
 void arduinoVNC::setOffset(uint16_t x, uint16_t y) {
     opt.h_offset = x;
     opt.v_offset = y;
+
+    if(connected() && (display == panel || display == &offset)) {
+        rfb_place_desktop();
+        // CopyRect and JPEG depend on the whole desktop being visible
+        rfb_set_format_and_encodings();
+        rfb_send_update_request(0);
+    }
 }
 
+#ifdef VNC_SCALING
+void arduinoVNC::setScaling(vnc_scale_mode_t mode) {
+    scaleMode = mode;
+}
+#endif
+
+#ifdef VNC_VIEWPORT
+bool arduinoVNC::panViewport(int dx, int dy) {
+    if(display != &viewport || !connected()) {
+        return false;
+    }
+    rfbRectangle old = viewport.window();
+    return viewport.pan(dx, dy) && rfb_request_exposed(old);
+}
+
+bool arduinoVNC::zoomViewport(float factor, int x, int y) {
+    if(display != &viewport || !connected()) {
+        return false;
+    }
+    rfbRectangle old = viewport.window();
+    return viewport.zoom(factor, x, y) && rfb_request_exposed(old);
+}
+
+bool arduinoVNC::resetViewport(void) {
+    if(display != &viewport || !connected()) {
+        return false;
+    }
+    rfbRectangle old = viewport.window();
+    return viewport.reset() && rfb_request_exposed(old);
+}
+
+bool arduinoVNC::canPanViewport(void) {
+    return display == &viewport && viewport.canPan();
+}
+
+/**
+ * the cache outside of the old window was not kept up to date,
+ * ask for the parts of the new window that were not visible before
+ */
+bool arduinoVNC::rfb_request_exposed(rfbRectangle old) {
+    rfbRectangle r = viewport.window();
+    uint32_t ox1 = old.x + old.w;
+    uint32_t oy1 = old.y + old.h;
+    uint32_t x1 = r.x + r.w;
+    uint32_t y1 = r.y + r.h;
+
+    if(r.x >= ox1 || x1 <= old.x || r.y >= oy1 || y1 <= old.y) {
+        return rfb_send_update_request(0, r.x, r.y, r.w, r.h);
+    }
+
+    bool ok = true;
+    // above and below the old window, full width
+    if(r.y < old.y) {
+        ok &= rfb_send_update_request(0, r.x, r.y, r.w, old.y - r.y);
+    }
+    if(y1 > oy1) {
+        ok &= rfb_send_update_request(0, r.x, oy1, r.w, y1 - oy1);
+    }
+    // left and right of it, between those strips
+    uint32_t my0 = max((uint32_t) r.y, (uint32_t) old.y);
+    uint32_t my1 = min(y1, oy1);
+    if(r.x < old.x) {
+        ok &= rfb_send_update_request(0, r.x, my0, old.x - r.x, my1 - my0);
+    }
+    if(x1 > ox1) {
+        ok &= rfb_send_update_request(0, ox1, my0, x1 - ox1, my1 - my0);
+    }
+    return ok;
+}
+#endif
+
+#ifdef VNC_RECORDER
+void arduinoVNC::setRecorder(VNCrecorder * _recorder) {
+    recorder = _recorder;
+}
+#endif
+
 void arduinoVNC::setMaxFPS(uint16_t fps) {
     updateDelay = (1000/fps);
 }
@@ -296,6 +492,11 @@ void arduinoVNC::reconnect(void) {
 }
 
 bool arduinoVNC::connected(void) {
+    // data the server sent before closing is still decoded
+    return tcp_connected() || rx_available();
+}
+
+bool arduinoVNC::tcp_connected(void) {
 #ifdef ESP8266
     return (TCPclient.status() == ESTABLISHED);
 #else
@@ -311,22 +512,31 @@ bool arduinoVNC::connected(void) {
 
 bool arduinoVNC::read_from_rfb_server(int sock, char *out, size_t n) {
     unsigned long t = millis();
+    unsigned long waitStart = 0;
     size_t len;
-    /*
-     DEBUG_VNC("read_from_rfb_server %d...\n", n);
-
-     if(n > 2 * 1024 * 1042) {
-     DEBUG_VNC("read_from_rfb_server N: %d 0x%08X make no sens!\n", n, n);
-     return 0;
-     }
-
-     if(out == NULL) {
-     DEBUG_VNC("read_from_rfb_server out == NULL!\n");
-     return 0;
-     }
-     */
+
+    // serve what is already buffered
+    len = min(n, rx_available());
+    if(len) {
+        memcpy(out, rx_buf + rx_head, len);
+        rx_head += len;
+        out += len;
+        n -= len;
+    }
+
+    // small reads go through the buffer, so the next ones are served from memory
+    if(n && n < (VNC_RX_BUFFER / 2)) {
+        if(!rx_fill(n)) {
+            return false;
+        }
+        memcpy(out, rx_buf + rx_head, n);
+        rx_head += n;
+        return true;
+    }
+
+    // large reads go straight into the caller's buffer
     while(n > 0) {
-        if(!connected()) {
+        if(!tcp_connected()) {
             DEBUG_VNC("[read_from_rfb_server] not connected!\n");
             return false;
         }
@@ -337,15 +547,28 @@ bool arduinoVNC::read_from_rfb_server(int sock, char *out, size_t n) {
         }
 
         if(!TCPclient.available()) {
+            if(!waitStart) {
+                waitStart = micros() | 1;
+            }
             delay(0);
             continue;
         }
+        if(waitStart) {
+            rx_waitUs += micros() - waitStart;
+            waitStart = 0;
+        }
 
         len = TCPclient.read((uint8_t*) out, n);
         if(len) {
             t = millis();
+#ifdef VNC_RECORDER
+            if(recorder) {
+                recorder->record((uint8_t*) out, len);
+            }
+#endif
             out += len;
             n -= len;
+            rx_total += len;
             //DEBUG_VNC("Receive %d left %d!\n", len, n);
         } else {
             //DEBUG_VNC("Receive %d left %d!\n", len, n);
@@ -355,95 +578,153 @@ bool arduinoVNC::read_from_rfb_server(int sock, char *out, size_t n) {
     return true;
 }
 
-#ifdef VNC_ZRLE
-bool arduinoVNC::read_from_z(uint8_t *out, size_t n) {
-    // Make our life a bit easier
-    if(n > ZRLE_OUTPUT_BUFFER) {
-        DEBUG_VNC("[read_from_z] Cannot read more than %d bytes (%d)\n", ZRLE_OUTPUT_BUFFER, n);
+/**
+ * make sure at least n contiguous bytes are in the receive buffer
+ * reads as much as the socket has available, not only n
+ */
+bool arduinoVNC::rx_fill(size_t n) {
+    unsigned long t = millis();
+    unsigned long waitStart = 0;
+    size_t len;
+
+    if(n > VNC_RX_BUFFER) {
+        DEBUG_VNC("[rx_fill] Cannot buffer more than %d bytes (%u)\n", VNC_RX_BUFFER, (unsigned) n);
         return false;
     }
 
-    bool decompress_more = true;
+    if(rx_head == rx_tail) {
+        rx_head = rx_tail = 0;
+    } else if(rx_head + n > VNC_RX_BUFFER) {
+        // not enough room behind the data, move it to the front
+        memmove(rx_buf, rx_buf + rx_head, rx_available());
+        rx_tail -= rx_head;
+        rx_head = 0;
+    }
 
-    // Check if we already decompressed enough data in the run before
-    if(zout_read != zout_next) {
-        size_t buf_size = 0;
-        if(zout_read < zout_next) {
-            buf_size = zout_next - zout_read;
-        } else {
-            buf_size = ZRLE_OUTPUT_BUFFER - (zout_read - zout_next);
+    while(rx_available() < n) {
+        if(!tcp_connected()) {
+            DEBUG_VNC("[rx_fill] not connected!\n");
+            return false;
         }
-        if(buf_size < n) {
-            DEBUG_VNC_ZRLE("[read_from_z] Partially in buffer: %d of %d\n", buf_size, n);
-            // Data is only partially available
-            memcpy(out, zout_read, buf_size);
-            out += buf_size;
-            n -= buf_size;
-            zout_read = zout_next;
-        }  else {
-            decompress_more = false;
+
+        if((millis() - t) > VNC_TCP_TIMEOUT) {
+            DEBUG_VNC("[rx_fill] receive TIMEOUT!\n");
+            return false;
         }
-    }
 
-    while(decompress_more) {
-        DEBUG_VNC_ZRLE("[read_from_z] dict: %zu next: %zu avail: %zu\n", zout, zout_next, ZRLE_OUTPUT_BUFFER - (zout_next-zout));
-        if(!bytes_available) {
-            if(!msg_bytes_remain) {
-                DEBUG_VNC("[read_from_z] Empty buffer, but %d missing\n", n);
-                return false;
-            }
-            bytes_available = min(msg_bytes_remain, (size_t)ZRLE_INPUT_BUFFER);
-            DEBUG_VNC_ZRLE("[read_from_z] Reading %d\n", bytes_available);
-            if (!read_from_rfb_server(sock, (char *)zin, bytes_available)) {
-                DEBUG_VNC("[read_from_z] Failed reading from socket %d!\n", bytes_available);
-                return false;
+        if(!TCPclient.available()) {
+            if(!waitStart) {
+                waitStart = micros() | 1;
             }
-            msg_bytes_remain -= bytes_available;
-            zin_next = zin;
+            delay(0);
+            continue;
+        }
+        if(waitStart) {
+            rx_waitUs += micros() - waitStart;
+            waitStart = 0;
         }
 
-        size_t bytes_decompressed = zout + ZRLE_OUTPUT_BUFFER - zout_next;
-        size_t bytes_consumed = bytes_available;
-        // We cannot decompress into "out" directly, because it would have to have at least ZRLE_OUTPUT_BUFFER capacity
-        tinfl_status last_status = tinfl_decompress(&inflator, zin_next, &bytes_consumed, zout, zout_next, &bytes_decompressed, TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_PARSE_ZLIB_HEADER);
-        bytes_available -= bytes_consumed;
-        zin_next += bytes_consumed;
+        len = TCPclient.read(rx_buf + rx_tail, VNC_RX_BUFFER - rx_tail);
+        if(len) {
+            t = millis();
+#ifdef VNC_RECORDER
+            if(recorder) {
+                recorder->record(rx_buf + rx_tail, len);
+            }
+#endif
+            rx_tail += len;
+            rx_total += len;
+        }
+        delay(0);
+    }
+    return true;
+}
 
-        zout_next += bytes_decompressed;
-        if (zout_next >= zout + ZRLE_OUTPUT_BUFFER) {
-            zout_next = zout;
+#ifdef VNC_ZSTREAMS
+/**
+ * inflate until n contiguous bytes of zs are available at zs->read
+ */
+bool arduinoVNC::zstream_need(vnc_zstream_t * zs, size_t n) {
+    if(n > zs->guard) {
+        DEBUG_VNC("[zstream_need] Cannot span more than %d bytes (%d)\n", (int) zs->guard, (int) n);
+        return false;
+    }
+    while((size_t) (zs->next - zs->read) < n) {
+        if(!zstream_inflate_more(zs)) {
+            return false;
         }
+    }
+    return true;
+}
 
-        if(bytes_decompressed < n) {
-            memcpy(out, zout_read, bytes_decompressed);
-            out += bytes_decompressed;
-            n -= bytes_decompressed;
-            zout_read = zout_next;
-        } else {
-            decompress_more = false;
+/**
+ * copy n inflated bytes of zs to out
+ */
+bool arduinoVNC::zstream_read(vnc_zstream_t * zs, uint8_t * out, size_t n) {
+    while(n) {
+        if(zs->read == zs->next && !zstream_inflate_more(zs)) {
+            return false;
         }
+        size_t len = min(n, (size_t) (zs->next - zs->read));
+        memcpy(out, zs->read, len);
+        zs->read += len;
+        out += len;
+        n -= len;
+    }
+    return true;
+}
 
-        DEBUG_VNC_ZRLE("[read_from_z] Available: %zu Consumed: %zu Decompressed: %zu Missing: %zu AvailOut: %zu Status: %d\n", bytes_available, bytes_consumed, bytes_decompressed, bytes_missing, ZRLE_OUTPUT_BUFFER - (zout_next-zout), last_status);
-        if(last_status < TINFL_STATUS_NEEDS_MORE_INPUT) {
-            DEBUG_VNC("[read_from_z] Error during decompression: %d\n", last_status);
+/**
+ * run the inflater of zs once on the compressed bytes of the rect
+ * the input is taken from the receive buffer without copying
+ */
+bool arduinoVNC::zstream_inflate_more(vnc_zstream_t * zs) {
+    size_t in_size = 0;
+    if(zstream_zlen) {
+        if(!rx_available() && !rx_fill(1)) {
             return false;
         }
+        in_size = min(rx_available(), zstream_zlen);
+    }
+
+#ifdef VNC_METRICS
+    uint32_t inflateStart = micros();
+#endif
+    size_t out_size;
+    if(!VNCzstreams::inflate(zs, rx_buf + rx_head, &in_size, &out_size)) {
+        return false;
     }
 
-    // Copy data from decompression buffer into "out"
-    memcpy(out, zout_read, n);
-    zout_read += n;
+    rx_head += in_size;
+    zstream_zlen -= in_size;
+#ifdef VNC_METRICS
+    metrics.inflated(out_size, micros() - inflateStart);
+#endif
 
-    if (zout_read >= zout + ZRLE_OUTPUT_BUFFER) {
-        zout_read = zout;
+    if(!in_size && !out_size) {
+        DEBUG_VNC("[zstream_inflate_more] compressed data ended early\n");
+        return false;
     }
+    return true;
+}
 
+/**
+ * pass the rest of the compressed data (the sync flush) through the inflater
+ */
+bool arduinoVNC::zstream_finish(vnc_zstream_t * zs) {
+    while(zstream_zlen) {
+        zs->read = zs->next;
+        if(!zstream_inflate_more(zs)) {
+            return false;
+        }
+    }
+    zs->read = zs->next;
     return true;
 }
-#endif // #ifdef VNC_ZRLE
+#endif // #ifdef VNC_ZSTREAMS
 
 bool arduinoVNC::write_exact(int sock, char *buf, size_t n) {
-    if(!connected()) {
+    if(!tcp_connected()) {
         DEBUG_VNC("[write_exact] not connected!\n");
         return false;
     }
@@ -460,6 +741,12 @@ bool arduinoVNC::set_non_blocking(int sock) {
 void arduinoVNC::disconnect(void) {
     DEBUG_VNC("[arduinoVNC] disconnect...\n");
     TCPclient.stop();
+    rx_head = rx_tail = 0;
+#ifdef VNC_RECORDER
+    if(recorder) {
+        recorder->session_end();
+    }
+#endif
 }
 
 #else
@@ -473,6 +760,15 @@ void arduinoVNC::disconnect(void) {
  * ConnectToRFBServer.
  */
 bool arduinoVNC::rfb_connect_to_server(const char *host, int port) {
+    if(!rx_buf) {
+        rx_buf = (uint8_t *) malloc(VNC_RX_BUFFER);
+        if(!rx_buf) {
+            DEBUG_VNC("[rfb_connect_to_server] rx_buf malloc failed!\n");
+            return false;
+        }
+    }
+    rx_head = rx_tail = 0;
+
 #ifdef USE_ARDUINO_TCP
     if(!TCPclient.connect(host, port)) {
         DEBUG_VNC("[rfb_connect_to_server] Connect error\n");
@@ -480,6 +776,11 @@ bool arduinoVNC::rfb_connect_to_server(const char *host, int port) {
     }
 
     DEBUG_VNC("[rfb_connect_to_server] Connected.\n");
+#ifdef VNC_RECORDER
+    if(recorder) {
+        recorder->session_start();
+    }
+#endif
     set_non_blocking(sock);
     return true;
 #else
@@ -790,9 +1091,24 @@ bool arduinoVNC::_rfb_initialise_server() {
     opt.server.width = Swap16IfLE(si.framebufferWidth);
     opt.server.height = Swap16IfLE(si.framebufferHeight);
 
-    // never be bigger then the client!
-    opt.server.width = min(opt.client.width, opt.server.width);
-    opt.server.height = min(opt.client.height, opt.server.height);
+#ifdef VNC_SCALING
+    // a desktop larger than the display is cached and shown through the
+    // viewport, or without the memory for that, drawn through the scaler
+    display = panel;
+    if(opt.server.width > (int) panel->getWidth() || opt.server.height > (int) panel->getHeight()) {
+#ifdef VNC_VIEWPORT
+        if(viewport.begin(panel, opt.server.width, opt.server.height, scaleMode)) {
+            display = &viewport;
+        } else
+#endif
+        if(scaler.begin(panel, opt.server.width, opt.server.height, scaleMode)) {
+            display = &scaler;
+        }
+    }
+#endif
+
+    // anything not scaled is shown at 1:1, cropped or centered
+    rfb_place_desktop();
 
     opt.server.bpp = si.format.bitsPerPixel;
     opt.server.depth = si.format.depth;
@@ -827,10 +1143,7 @@ bool arduinoVNC::_rfb_initialise_server() {
 //#############################################################################################
 
 bool arduinoVNC::rfb_set_format_and_encodings() {
-    uint8_t num_enc = 0;
     rfbSetPixelFormatMsg pf;
-    rfbSetEncodingsMsg em;
-    CARD32 enc[MAX_ENCODINGS];
 
     pf.type = 0;
     pf.format.bitsPerPixel = opt.client.bpp;
@@ -848,6 +1161,26 @@ bool arduinoVNC::rfb_set_format_and_encodings() {
         return false;
     }
 
+    if(!rfb_set_encodings()) {
+        return false;
+    }
+
+    DEBUG_VNC("[VNC-CLIENT] Client pixel format:\n");
+    DEBUG_VNC(" - width:%d      height:%d\n", opt.client.width, opt.client.height);
+    DEBUG_VNC(" - bpp:%d        depth:%d        bigEndian:%d    trueColor:%d\n", opt.client.bpp, opt.client.depth, opt.client.bigendian, opt.client.truecolour);
+    DEBUG_VNC(" - red-max:%d    green-max:%d    blue-max:%d\n", opt.client.redmax, opt.client.greenmax, opt.client.bluemax);
+    DEBUG_VNC(" - red-shift:%d  green-shift:%d  blue-shift:%d\n", opt.client.redshift, opt.client.greenshift, opt.client.blueshift);
+
+    return true;
+}
+
+bool arduinoVNC::rfb_set_encodings() {
+    uint8_t num_enc = 0;
+    rfbSetEncodingsMsg em;
+    CARD32 enc[MAX_ENCODINGS];
+    uint8_t compresslevel = opt.client.compresslevel;
+    uint8_t quality = opt.client.quality;
+
     em.type = rfbSetEncodings;
 
     DEBUG_VNC("[VNC-CLIENT] Supported Encodings:\n");
@@ -859,6 +1192,10 @@ bool arduinoVNC::rfb_set_format_and_encodings() {
     enc[num_enc++] = Swap32IfLE(rfbEncodingTight);
     DEBUG_VNC(" - Tight\n");
 #endif
+#ifdef VNC_ZLIBHEX
+    enc[num_enc++] = Swap32IfLE(rfbEncodingZlibHex);
+    DEBUG_VNC(" - ZlibHex\n");
+#endif
 #ifdef VNC_HEXTILE
     enc[num_enc++] = Swap32IfLE(rfbEncodingHextile);
     DEBUG_VNC(" - Hextile\n");
@@ -885,6 +1222,38 @@ bool arduinoVNC::rfb_set_format_and_encodings() {
     enc[num_enc++] = Swap32IfLE(rfbEncodingRaw);
     DEBUG_VNC(" - Raw\n");
 
+#ifdef VNC_AUTO_ENCODING
+    // the server uses the first encoding of the list it supports
+    for(uint8_t i = 1; i < num_enc; i++) {
+        if(enc[i] == (CARD32) Swap32IfLE(autoChoice.encoding)) {
+            CARD32 first = enc[i];
+            memmove(&enc[1], &enc[0], i * sizeof(CARD32));
+            enc[0] = first;
+            break;
+        }
+    }
+    DEBUG_VNC(" - preferred: %d\n", autoChoice.encoding);
+    compresslevel = autoChoice.compressLevel;
+    quality = autoChoice.quality;
+#endif
+
+#ifdef VNC_ZYWRLE
+    // ZYWRLE is ZRLE with lossy wavelet tiles, at low qualities it goes in front of ZRLE
+    zywrle_level = 0;
+    if(quality < VNC_ZYWRLE_QUALITY) {
+        for(uint8_t i = 0; i < num_enc; i++) {
+            if(enc[i] == (CARD32) Swap32IfLE(rfbEncodingZRLE)) {
+                memmove(&enc[i + 1], &enc[i], (num_enc - i) * sizeof(CARD32));
+                enc[i] = Swap32IfLE(rfbEncodingZYWRLE);
+                num_enc++;
+                zywrle_level = 1;
+                DEBUG_VNC(" - ZYWRLE\n");
+                break;
+            }
+        }
+    }
+#endif
+
     DEBUG_VNC("[VNC-CLIENT] Supported Special Encodings:\n");
 
 #ifdef SET_DESKTOP_SIZE
@@ -909,13 +1278,26 @@ bool arduinoVNC::rfb_set_format_and_encodings() {
     enc[num_enc++] = Swap32IfLE(rfbEncodingContinuousUpdates);
     DEBUG_VNC(" - ContinuousUpdates\n");
 
-    if (opt.client.compresslevel <= 9) {
-        enc[num_enc++] = Swap32IfLE(rfbEncodingCompressLevel0 + opt.client.compresslevel);
-        DEBUG_VNC(" - compresslevel: %d\n", opt.client.compresslevel);
+    enc[num_enc++] = Swap32IfLE(rfbEncodingFence);
+    DEBUG_VNC(" - Fence\n");
+
+    if (compresslevel <= 9) {
+        enc[num_enc++] = Swap32IfLE(rfbEncodingCompressLevel0 + compresslevel);
+        DEBUG_VNC(" - compresslevel: %d\n", compresslevel);
     }
-    if (opt.client.quality <= 9) {
-        enc[num_enc++] = Swap32IfLE(rfbEncodingQualityLevel0 + opt.client.quality);
-        DEBUG_VNC(" - quality: %d\n", opt.client.quality);
+    // the quality level enables JPEG in Tight, only ask for it if the display can decode it
+    // or the server is going to use ZYWRLE
+    bool sendQuality = quality <= 9 && display->hasJpeg();
+#ifdef VNC_ZYWRLE
+    sendQuality |= zywrle_level && enc[0] == (CARD32) Swap32IfLE(rfbEncodingZYWRLE);
+    if(sendQuality && zywrle_level) {
+        // the server picks the wavelet level from the quality, level 1 without one
+        zywrle_level = vnc_zywrle_level(quality);
+    }
+#endif
+    if (sendQuality) {
+        enc[num_enc++] = Swap32IfLE(rfbEncodingQualityLevel0 + quality);
+        DEBUG_VNC(" - quality: %d\n", quality);
     }
 
     em.nEncodings = Swap16IfLE(num_enc);
@@ -928,12 +1310,6 @@ bool arduinoVNC::rfb_set_format_and_encodings() {
         return false;
     }
 
-    DEBUG_VNC("[VNC-CLIENT] Client pixel format:\n");
-    DEBUG_VNC(" - width:%d      height:%d\n", opt.client.width, opt.client.height);
-    DEBUG_VNC(" - bpp:%d        depth:%d        bigEndian:%d    trueColor:%d\n", opt.client.bpp, opt.client.depth, opt.client.bigendian, opt.client.truecolour);
-    DEBUG_VNC(" - red-max:%d    green-max:%d    blue-max:%d\n", opt.client.redmax, opt.client.greenmax, opt.client.bluemax);
-    DEBUG_VNC(" - red-shift:%d  green-shift:%d  blue-shift:%d\n", opt.client.redshift, opt.client.greenshift, opt.client.blueshift);
-
     return true;
 }
 
@@ -949,6 +1325,15 @@ bool arduinoVNC::rfb_set_desktop_size() {
     opt.server.width = w;
     opt.server.height = h;
 
+    // the desktop is resized to the display, nothing left to scale or move
+#ifdef VNC_SCALING
+    scaler.end();
+#ifdef VNC_VIEWPORT
+    viewport.end();
+#endif
+#endif
+    display = panel;
+
     w = Swap16IfLE(w);
     h = Swap16IfLE(h);
     rfbSetDesktopSizeMsg ds;
@@ -973,15 +1358,91 @@ bool arduinoVNC::rfb_set_desktop_size() {
 }
 #endif
 
+/**
+ * show the desktop at 1:1 when neither the scaler nor the viewport does,
+ * a smaller desktop is centered, a larger one cropped at the setOffset() position
+ */
+void arduinoVNC::rfb_place_desktop(void) {
+    if(display == &offset) {
+        display = panel;
+    }
+    if(display != panel) {
+        return;
+    }
+
+    int32_t cw = panel->getWidth();
+    int32_t ch = panel->getHeight();
+    int32_t x, y;
+
+    if(opt.server.width <= cw) {
+        x = -((cw - opt.server.width) / 2);
+    } else {
+        x = min(max(opt.h_offset, 0), opt.server.width - cw);
+    }
+    if(opt.server.height <= ch) {
+        y = -((ch - opt.server.height) / 2);
+    } else {
+        y = min(max(opt.v_offset, 0), opt.server.height - ch);
+    }
+
+    // a desktop of the display size goes straight to the panel
+    if(x != 0 || y != 0 || opt.server.width != cw || opt.server.height != ch) {
+        offset.begin(panel, opt.server.width, opt.server.height, x, y);
+        display = &offset;
+    }
+}
+
+/// the part of the desktop on the display, the only part update requests ask for
+rfbRectangle arduinoVNC::rfb_view(void) {
+#ifdef VNC_VIEWPORT
+    if(display == &viewport) {
+        return viewport.window();
+    }
+#endif
+    if(display == &offset) {
+        return offset.visible();
+    }
+
+    // the scaler and a desktop of the display size show everything
+    rfbRectangle r;
+    r.x = 0;
+    r.y = 0;
+    r.w = opt.server.width;
+    r.h = opt.server.height;
+    return r;
+}
+
+/// display position -> server position
+void arduinoVNC::rfb_to_server(int * x, int * y) {
+#ifdef VNC_SCALING
+    if(display == &scaler) {
+        scaler.to_server(x, y);
+    }
+#endif
+#ifdef VNC_VIEWPORT
+    if(display == &viewport) {
+        viewport.to_server(x, y);
+    }
+#endif
+    if(display == &offset) {
+        offset.to_server(x, y);
+    }
+}
+
 bool arduinoVNC::rfb_send_update_request(int incremental) {
+    rfbRectangle r = rfb_view();
+    return rfb_send_update_request(incremental, r.x, r.y, r.w, r.h);
+}
+
+bool arduinoVNC::rfb_send_update_request(int incremental, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
     rfbFramebufferUpdateRequestMsg urq = { 0 };
 
     urq.type = rfbFramebufferUpdateRequest;
     urq.incremental = incremental;
-    urq.x = opt.v_offset;
-    urq.y = opt.h_offset;
-    urq.w = opt.server.width;
-    urq.h = opt.server.height;
+    urq.x = x;
+    urq.y = y;
+    urq.w = w;
+    urq.h = h;
 
     urq.x = Swap16IfLE(urq.x);
     urq.y = Swap16IfLE(urq.y);
@@ -993,18 +1454,195 @@ bool arduinoVNC::rfb_send_update_request(int incremental) {
         return false;
     }
 
+    requestPending = true;
+    requestTime = millis();
+    requestUs = micros();
     return true;
 }
 
-bool arduinoVNC::rfb_set_continuous_updates(bool enable) {
-    rfbEnableContinuousUpdatesMsg urq = { 0 };
-
-    urq.type = rfbEnableContinuousUpdates;
-    urq.enable = enable;
-    urq.x = opt.v_offset;
-    urq.y = opt.h_offset;
-    urq.w = opt.server.width;
-    urq.h = opt.server.height;
+/**
+ * the next update request goes out when the pipeline has room for it:
+ * the display has shown the last update, the last request is answered
+ * (or overdue, nothing may have changed) and setMaxFPS allows it.
+ * Asking earlier only queues up frames that are stale when they are drawn.
+ */
+bool arduinoVNC::rfb_update_wanted(void) {
+    unsigned long now = millis();
+
+    if(presentPending) {
+        if(display->present_backlog()) {
+            return false;
+        }
+        presentPending = false;
+        vnc_average(&stats.presentUs, micros() - presentStart);
+#ifdef VNC_METRICS
+        metrics.present(micros() - presentStart);
+#endif
+    }
+
+    if(requestPending && (now - requestTime) < VNC_UPDATE_TIMEOUT) {
+        return false;
+    }
+    return (now - requestTime) >= updateDelay;
+}
+
+#ifdef VNC_AUTO_ENCODING
+const vnc_encoding_cost_t * arduinoVNC::getEncodingCost(int32_t encoding) {
+    for(uint8_t i = 0; i < VNC_AUTO_STEPS; i++) {
+        if(vnc_auto_ladder[i] == encoding) {
+            return &autoCost[i];
+        }
+    }
+    return NULL;
+}
+
+void arduinoVNC::rfb_auto_reset(void) {
+    autoChoice = { 0 };
+    autoStep = 0;
+    autoChoice.encoding = vnc_auto_ladder[0];
+    autoChoice.compressLevel = opt.client.compresslevel;
+    autoChoice.quality = opt.client.quality;
+    autoQualityMax = opt.client.quality;
+    autoTime = millis();
+
+    for(uint8_t i = 0; i < VNC_AUTO_STEPS; i++) {
+        autoCost[i] = { 0 };
+        autoCost[i].encoding = vnc_auto_ladder[i];
+        autoTried[i] = autoTime;
+        autoPixels[i] = 0;
+        autoBytes[i] = 0;
+        autoCpuUs[i] = 0;
+    }
+    autoRxBytes = 0;
+    autoWallUs = 0;
+    autoWaitUs = 0;
+}
+
+/// account one decoded rectangle
+void arduinoVNC::rfb_auto_measure(int32_t encoding, uint32_t pixels, uint32_t wallUs, uint32_t bytes, uint32_t waitUs) {
+    autoRxBytes += bytes;
+    autoWallUs += wallUs;
+    autoWaitUs += waitUs;
+
+    for(uint8_t i = 0; i < VNC_AUTO_STEPS; i++) {
+        if(vnc_auto_ladder[i] == encoding) {
+            autoPixels[i] += pixels;
+            autoBytes[i] += bytes;
+            autoCpuUs[i] += (wallUs > waitUs) ? wallUs - waitUs : 0;
+            autoCost[i].rects++;
+            autoTried[i] = millis();
+            return;
+        }
+    }
+}
+
+/**
+ * the measurements do not rule out that the candidate at step is faster
+ * than the current encoding. Receiving and decoding overlap, the slower of
+ * the two sets the pace.
+ */
+bool arduinoVNC::rfb_auto_faster(uint8_t step, float linkBytesPerUs) {
+    const vnc_encoding_cost_t & c = autoCost[step];
+    const vnc_encoding_cost_t & cur = autoCost[autoStep];
+
+    if(!c.rects || !cur.rects || (millis() - autoTried[step]) > VNC_AUTO_ENCODING_RETRY) {
+        // not measured (for a while), find out
+        return true;
+    }
+
+    float t = max(c.cpuNsPerPixel, c.bytesPerPixel * 1000.0f / linkBytesPerUs);
+    float tCur = max(cur.cpuNsPerPixel, cur.bytesPerPixel * 1000.0f / linkBytesPerUs);
+    return t < tCur;
+}
+
+/**
+ * every VNC_AUTO_ENCODING_INTERVAL: when most of the decoding time is spent
+ * waiting for the network, ask for more compression. When hardly any is,
+ * the decoder is the bottleneck and a cheaper encoding is worth more bytes.
+ * @return false if the new encodings could not be sent
+ */
+bool arduinoVNC::rfb_auto_encoding(void) {
+    if((millis() - autoTime) < VNC_AUTO_ENCODING_INTERVAL) {
+        return true;
+    }
+    autoTime = millis();
+
+    // too little traffic to tell anything, nothing changes on the desktop
+    if(autoWallUs < 20000 || autoRxBytes < 4096) {
+        return true;
+    }
+
+    autoChoice.waitPercent = (uint64_t) autoWaitUs * 100 / autoWallUs;
+    autoChoice.linkKbps = (uint64_t) autoRxBytes * 8000 / autoWallUs;
+    float link = (float) autoRxBytes / autoWallUs;
+
+    for(uint8_t i = 0; i < VNC_AUTO_STEPS; i++) {
+        if(autoPixels[i]) {
+            vnc_encoding_cost_t & c = autoCost[i];
+            float bytes = (float) autoBytes[i] / autoPixels[i];
+            float cpu = (float) autoCpuUs[i] * 1000.0f / autoPixels[i];
+            c.bytesPerPixel = c.bytesPerPixel ? (c.bytesPerPixel * 3 + bytes) / 4 : bytes;
+            c.cpuNsPerPixel = c.cpuNsPerPixel ? (c.cpuNsPerPixel * 3 + cpu) / 4 : cpu;
+        }
+        autoPixels[i] = 0;
+        autoBytes[i] = 0;
+        autoCpuUs[i] = 0;
+    }
+    autoRxBytes = 0;
+    autoWallUs = 0;
+    autoWaitUs = 0;
+
+    uint8_t step = autoStep;
+    uint8_t compress = autoChoice.compressLevel;
+    uint8_t quality = autoChoice.quality;
+    bool jpeg = (vnc_auto_ladder[step] == rfbEncodingTight) && quality <= 9 && display->hasJpeg();
+
+    if(autoChoice.waitPercent >= VNC_AUTO_LINK_BOUND) {
+        if(step > 0 && rfb_auto_faster(step - 1, link)) {
+            step--;
+        } else if(compress < 9) {
+            compress++;
+        } else if(jpeg && quality > VNC_AUTO_MIN_QUALITY) {
+            quality--;
+        }
+    } else if(autoChoice.waitPercent <= VNC_AUTO_CPU_BOUND) {
+        if(jpeg && quality < autoQualityMax) {
+            quality++;
+        } else if(step < VNC_AUTO_STEPS - 1 && rfb_auto_faster(step + 1, link)) {
+            step++;
+        } else if(compress <= 9 && compress > 1) {
+            // the server compresses faster, the client decodes about as fast
+            compress--;
+        }
+    }
+
+    if(step == autoStep && compress == autoChoice.compressLevel && quality == autoChoice.quality) {
+        return true;
+    }
+
+    DEBUG_VNC("[rfb_auto_encoding] wait %d%% %d kbit/s: encoding %d -> %d compress %d quality %d\n",
+              autoChoice.waitPercent, autoChoice.linkKbps, autoChoice.encoding, vnc_auto_ladder[step], compress, quality);
+
+    autoStep = step;
+    autoChoice.encoding = vnc_auto_ladder[step];
+    autoChoice.compressLevel = compress;
+    autoChoice.quality = quality;
+    autoChoice.changes++;
+    return rfb_set_encodings();
+}
+#endif
+
+bool arduinoVNC::rfb_set_continuous_updates(bool enable) {
+    rfbEnableContinuousUpdatesMsg urq = { 0 };
+
+    rfbRectangle r = rfb_view();
+
+    urq.type = rfbEnableContinuousUpdates;
+    urq.enable = enable;
+    urq.x = r.x;
+    urq.y = r.y;
+    urq.w = r.w;
+    urq.h = r.h;
 
     urq.x = Swap16IfLE(urq.x);
     urq.y = Swap16IfLE(urq.y);
@@ -1016,6 +1654,59 @@ bool arduinoVNC::rfb_set_continuous_updates(bool enable) {
         return false;
     }
 
+    cuActive = enable;
+    cuRegion = r;
+    return true;
+}
+
+bool arduinoVNC::rfb_send_fence(uint32_t flags, const uint8_t * data, uint8_t len) {
+    uint8_t buf[sz_rfbFenceMsg + 64];
+    rfbFenceMsg fm = { 0 };
+
+    len = min(len, (uint8_t) 64);
+
+    fm.type = rfbFence;
+    fm.flags = Swap32IfLE(flags);
+    fm.length = len;
+
+    memcpy(buf, &fm, sz_rfbFenceMsg);
+    memcpy(buf + sz_rfbFenceMsg, data, len);
+
+    if(!write_exact(sock, (char*) buf, sz_rfbFenceMsg + len)) {
+        DEBUG_VNC("[rfb_send_fence] write_exact failed!\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * a fence sent after every decoded frame comes back once the server has
+ * sent everything queued before it. While more than VNC_FRAMES_IN_FLIGHT
+ * are unanswered the link is not keeping up, the updates are disabled
+ * until the backlog has drained instead of piling up in the buffers.
+ */
+bool arduinoVNC::rfb_pace_continuous_updates(void) {
+    uint32_t inFlight = fenceSent - fenceAcked;
+
+    if(cuActive && inFlight > VNC_FRAMES_IN_FLIGHT) {
+        DEBUG_VNC("[rfb_pace_continuous_updates] %d frames in flight, pause\n", inFlight);
+        cuPaused = true;
+        cuEndPending = true;
+        return rfb_set_continuous_updates(0);
+    }
+
+    if(cuPaused) {
+        if(inFlight || cuEndPending) {
+            return true;
+        }
+        cuPaused = false;
+    }
+
+    // (re)enable, also when the view moved
+    rfbRectangle r = rfb_view();
+    if(!cuActive || memcmp(&r, &cuRegion, sizeof(r))) {
+        return rfb_set_continuous_updates(1);
+    }
     return true;
 }
 
@@ -1024,14 +1715,37 @@ bool arduinoVNC::rfb_handle_server_message() {
     rfbServerToClientMsg msg = { 0 };
     rfbFramebufferUpdateRectHeader rectheader = { 0 };
 
-    if(TCPclient.available()) {
+    if(rx_available() || TCPclient.available()) {
         if(!read_from_rfb_server(sock, (char*) &msg, 1)) {
             return false;
         }
         switch(msg.type) {
-            case rfbFramebufferUpdate:
+            case rfbFramebufferUpdate: {
+                unsigned long decodeStart = micros();
+                uint32_t bytesStart = rx_consumed() - 1;
+
                 read_from_rfb_server(sock, ((char*) &msg.fu) + 1, sz_rfbFramebufferUpdateMsg - 1);
                 msg.fu.nRects = Swap16IfLE(msg.fu.nRects);
+
+                if(requestPending) {
+                    requestPending = false;
+                    // an early request waited behind the previous update, that is no round trip
+                    if(!requestEarly) {
+                        vnc_average(&stats.latencyUs, decodeStart - requestUs);
+#ifdef VNC_METRICS
+                        metrics.latency(decodeStart - requestUs);
+#endif
+                    }
+                    requestEarly = false;
+
+                    // decoding and showing take longer than a round trip, ask for
+                    // the next update now so it arrives when this one is done
+                    if(!cuActive && !cuPaused && stats.decodeUs + stats.presentUs > stats.latencyUs && rfb_update_wanted()) {
+                        requestEarly = rfb_send_update_request(onlyFullUpdate ? 0 : 1);
+                    }
+                }
+
+                display->framebuffer_update_start();
                 for(uint16_t i = 0; i < msg.fu.nRects; i++) {
                     read_from_rfb_server(sock, (char*) &rectheader,
                     sz_rfbFramebufferUpdateRectHeader);
@@ -1042,10 +1756,19 @@ bool arduinoVNC::rfb_handle_server_message() {
                     rectheader.encoding = Swap32IfLE(rectheader.encoding);
                     //SoftCursorLockArea(rectheader.r.x, rectheader.r.y, rectheader.r.w, rectheader.r.h);
 
-#ifdef FPS_BENCHMARK
+#if defined(FPS_BENCHMARK) || defined(VNC_AUTO_ENCODING) || defined(VNC_METRICS)
                     unsigned long encodingStart = micros();
+                    // the rect header is counted with the rect
+                    uint32_t encodingBytes = rx_consumed() - sz_rfbFramebufferUpdateRectHeader;
+#endif
+#ifdef VNC_AUTO_ENCODING
+                    uint32_t encodingWait = rx_waitUs;
 #endif
                     bool encodingResult = false;
+                    // pseudo encodings are negative
+                    if(rectheader.encoding >= 0) {
+                        stats.encoding = rectheader.encoding;
+                    }
                     switch(rectheader.encoding) {
                         case rfbEncodingRaw:
                             encodingResult = _handle_raw_encoded_message(rectheader);
@@ -1068,14 +1791,22 @@ bool arduinoVNC::rfb_handle_server_message() {
                             encodingResult = _handle_hextile_encoded_message(rectheader);
                             break;
 #endif
+#ifdef VNC_ZLIBHEX
+                        case rfbEncodingZlibHex:
+                            encodingResult = _handle_zlibhex_encoded_message(rectheader);
+                            break;
+#endif
 #ifdef VNC_ZRLE
                         case rfbEncodingZRLE:
+#ifdef VNC_ZYWRLE
+                        case rfbEncodingZYWRLE:
+#endif
                             encodingResult = _handle_zrle_encoded_message(rectheader);
                             break;
 #endif
 #ifdef VNC_TIGHT
-                            case rfbEncodingTight:
-                            encodingResult =_handle_tight_encoded_message(rectheader);
+                        case rfbEncodingTight:
+                            encodingResult = _handle_tight_encoded_message(rectheader);
                             break;
 #endif
 #ifdef VNC_ZLIB
@@ -1110,14 +1841,22 @@ bool arduinoVNC::rfb_handle_server_message() {
                             break;
                     }
 
+#ifdef VNC_AUTO_ENCODING
+                    rfb_auto_measure(rectheader.encoding, (uint32_t) rectheader.r.w * rectheader.r.h, micros() - encodingStart,
+                                     rx_consumed() - encodingBytes, rx_waitUs - encodingWait);
+#endif
+#ifdef VNC_METRICS
+                    metrics.rect(rectheader.encoding, (uint32_t) rectheader.r.w * rectheader.r.h, rx_consumed() - encodingBytes, micros() - encodingStart);
+#endif
 #ifdef FPS_BENCHMARK
                     unsigned long encodingTime = micros() - encodingStart;
-                    double fps = ((double) (1 * 1000 * 1000) / (double) encodingTime);
-                    DEBUG_VNC("[Benchmark][0x%08X][%d]\t us: %d \tfps: %s \tHeap: %d\n", rectheader.encoding, rectheader.encoding, encodingTime, String(fps, 2).c_str(), ESP.getFreeHeap());
+                    DEBUG_VNC("[Benchmark][0x%08X][%d]\t us: %lu \tpixels: %u \tbytes: %u \tHeap: %d\n", rectheader.encoding, rectheader.encoding, encodingTime,
+                              (uint32_t) rectheader.r.w * rectheader.r.h, rx_consumed() - encodingBytes, ESP.getFreeHeap());
 #endif
                     //wdt_enable(0);
                     if(!encodingResult) {
                         DEBUG_VNC("[0x%08X][%d] encoding Failed!\n", rectheader.encoding, rectheader.encoding);
+                        display->framebuffer_update_end();
                         disconnect();
                         return false;
                     } else {
@@ -1127,6 +1866,38 @@ bool arduinoVNC::rfb_handle_server_message() {
                     /* Now we may discard "soft cursor locks". */
                     //SoftCursorUnlockScreen();
                 }
+                display->framebuffer_update_end();
+
+                vnc_average(&stats.decodeUs, micros() - decodeStart);
+                vnc_average(&stats.bytes, rx_consumed() - bytesStart);
+#ifdef VNC_METRICS
+                metrics.update(rx_consumed() - bytesStart, micros() - decodeStart);
+#endif
+                stats.updates++;
+                presentPending = true;
+                presentStart = micros();
+
+                // paces continuous updates, see rfb_pace_continuous_updates
+                if(cuActive) {
+                    fenceSent++;
+                    if(!rfb_send_fence(rfbFenceFlagRequest | rfbFenceFlagBlockBefore, (uint8_t *) &fenceSent, sizeof(fenceSent))) {
+                        disconnect();
+                        return false;
+                    }
+                }
+                break;
+            }
+            case rfbFence:
+                if(!_handle_server_fence_message()) {
+                    disconnect();
+                    return false;
+                }
+                break;
+            case rfbEndOfContinuousUpdates:
+                if(!_handle_end_of_continuous_updates_message()) {
+                    disconnect();
+                    return false;
+                }
                 break;
             case rfbSetColourMapEntries:
                 DEBUG_VNC("SetColourMapEntries\n");
@@ -1168,9 +1939,12 @@ bool arduinoVNC::rfb_update_mouse() {
     msg.type = rfbPointerEvent;
     msg.buttonMask = mousestate.buttonmask;
 
-    /* scale to server resolution */
-    msg.x = mousestate.x; //rint(mousestate.x * opt.h_ratio);
-    msg.y = mousestate.y; //rint(mousestate.y * opt.v_ratio);
+    /* map to the server position */
+    int x = mousestate.x;
+    int y = mousestate.y;
+    rfb_to_server(&x, &y);
+    msg.x = min(max(x, 0), opt.server.width - 1);
+    msg.y = min(max(y, 0), opt.server.height - 1);
 
 #ifdef VNC_RICH_CURSOR
     SoftCursorMove(msg.x, msg.y);
@@ -1252,7 +2026,7 @@ bool arduinoVNC::_handle_raw_encoded_message(rfbFramebufferUpdateRectHeader rect
 
     DEBUG_VNC_RAW("[_handle_raw_encoded_message] msgPixel: %d msgSize: %d\n", msgPixel, msgSize);
 
-    display->area_update_start(rectheader.r.x - opt.v_offset, rectheader.r.y - opt.h_offset, rectheader.r.w, rectheader.r.h);
+    display->area_update_start(rectheader.r.x, rectheader.r.y, rectheader.r.w, rectheader.r.h);
 #ifdef VNC_SAVE_MEMORY
     buf = (char *) malloc(msgSize);
 #endif
@@ -1327,18 +2101,19 @@ bool arduinoVNC::_handle_rre_encoded_message(rfbFramebufferUpdateRectHeader rect
         return false;
     }
 
-    display->draw_rect(rectheader.r.x, rectheader.r.y, rectheader.r.w, rectheader.r.h, Swap16IfLE(colour));
+    display->draw_rect(rectheader.r.x, rectheader.r.y, rectheader.r.w, rectheader.r.h, SwapPixel(colour));
 
     /* subrect pixel values */
     for(uint32_t i = 0; i < header.nSubrects; i++) {
-        if(!read_from_rfb_server(sock, (char *) &colour, sizeof(colour))) {
+        const uint8_t * subrect = rx_span(sizeof(colour) + sizeof(rect));
+        if(!subrect) {
             return false;
         }
-        if(!read_from_rfb_server(sock, (char *) &rect, sizeof(rect)))
-            return false;
+        memcpy(&colour, subrect, sizeof(colour));
+        memcpy(&rect, subrect + sizeof(colour), sizeof(rect));
         display->draw_rect(
         Swap16IfLE(rect[0]) + rectheader.r.x,
-        Swap16IfLE(rect[1]) + rectheader.r.y, Swap16IfLE(rect[2]), Swap16IfLE(rect[3]), Swap16IfLE(colour));
+        Swap16IfLE(rect[1]) + rectheader.r.y, Swap16IfLE(rect[2]), Swap16IfLE(rect[3]), SwapPixel(colour));
     }
 
     return true;
@@ -1360,205 +2135,196 @@ bool arduinoVNC::_handle_corre_encoded_message(rfbFramebufferUpdateRectHeader re
     if(!read_from_rfb_server(sock, (char *) &colour, sizeof(colour))) {
         return false;
     }
-    display->draw_rect(rectheader.r.x, rectheader.r.y, rectheader.r.w, rectheader.r.h, Swap16IfLE(colour));
+    display->draw_rect(rectheader.r.x, rectheader.r.y, rectheader.r.w, rectheader.r.h, SwapPixel(colour));
 
     /* subrect pixel values */
     for(uint32_t i = 0; i < header.nSubrects; i++) {
-        if(!read_from_rfb_server(sock, (char *) &colour, sizeof(colour))) {
-            return false;
-        }
-        if(!read_from_rfb_server(sock, (char *) &rect, sizeof(rect))) {
+        const uint8_t * subrect = rx_span(sizeof(colour) + sizeof(rect));
+        if(!subrect) {
             return false;
         }
-        display->draw_rect(rect[0] + rectheader.r.x, rect[1] + rectheader.r.y, rect[2], rect[3], Swap16IfLE(colour));
+        memcpy(&colour, subrect, sizeof(colour));
+        memcpy(&rect, subrect + sizeof(colour), sizeof(rect));
+        display->draw_rect(rect[0] + rectheader.r.x, rect[1] + rectheader.r.y, rect[2], rect[3], SwapPixel(colour));
     }
     return true;
 }
 #endif
 
 #ifdef VNC_HEXTILE
-bool arduinoVNC::_handle_hextile_encoded_message(rfbFramebufferUpdateRectHeader rectheader) {
-    uint32_t rect_x, rect_y, rect_w, rect_h, i = 0, j = 0;
-    uint32_t rect_xW, rect_yW;
-
-    uint32_t tile_w = 16, tile_h = 16;
-    int32_t remaining_w, remaining_h;
-
-    CARD8 subrect_encoding;
-
-    uint16_t fgColor;
-    uint16_t bgColor;
-
-    DEBUG_VNC_HEXTILE("[_handle_hextile_encoded_message] x: %d y: %d w: %d h: %d!\n", rectheader.r.x, rectheader.r.y, rectheader.r.w, rectheader.r.h);
-
-    //alloc max nedded size
-#ifdef VNC_SAVE_MEMORY
-    char * buf = (char *) malloc(255 * sizeof(HextileSubrectsColoured_t));
-#else
-    static char * buf = (char *) malloc(255 * sizeof(HextileSubrectsColoured_t));
-#endif
-    if(!buf) {
-        DEBUG_VNC("[_handle_hextile_encoded_message] too less memory!\n");
-        return false;
+/// fill w x h pixels of a tile whose rows are stride pixels apart
+static inline void hextile_fill(uint16_t * p, uint32_t stride, uint32_t w, uint32_t h, uint16_t color) {
+    while(h--) {
+        for(uint32_t i = 0; i < w; i++) {
+            p[i] = color;
+        }
+        p += stride;
     }
+}
 
-    rect_w = remaining_w = rectheader.r.w;
-    rect_h = remaining_h = rectheader.r.h;
-    rect_x = rectheader.r.x;
-    rect_y = rectheader.r.y;
-
-    /* the rect is divided into tiles of width and height 16. Iterate over
-     * those */
-    while((i * 16) < rect_h) {
-        /* the last tile in a column could be smaller than 16 */
-        if((remaining_h -= 16) <= 0)
-            tile_h = remaining_h + 16;
-
-        j = 0;
-        while((j * 16) < rect_w) {
-            /* the last tile in a row could also be smaller */
-            if((remaining_w -= 16) <= 0)
-                tile_w = remaining_w + 16;
+bool arduinoVNC::_handle_hextile_encoded_message(rfbFramebufferUpdateRectHeader rectheader) {
+    return hextile_rect(rectheader, false);
+}
 
-            if(!read_from_rfb_server(sock, (char*) &subrect_encoding, 1)) {
-#ifdef VNC_SAVE_MEMORY
-                freeSec(buf);
+#ifdef VNC_ZLIBHEX
+bool arduinoVNC::_handle_zlibhex_encoded_message(rfbFramebufferUpdateRectHeader rectheader) {
+    return hextile_rect(rectheader, true);
+}
 #endif
-                return false;
-            }
-
-            rect_xW = rect_x + (j * 16);
-            rect_yW = rect_y + (i * 16);
-
-            /* first, check if the raw bit is set */
-            if(subrect_encoding & rfbHextileRaw) {
-                rfbFramebufferUpdateRectHeader rawUpdate;
 
-                rawUpdate.encoding = rfbEncodingRaw;
+/**
+ * Hextile rect, with zlib compressed tiles for ZlibHex
+ */
+bool arduinoVNC::hextile_rect(rfbFramebufferUpdateRectHeader rectheader, bool zlib) {
+    uint32_t rect_x = rectheader.r.x;
+    uint32_t rect_y = rectheader.r.y;
+    uint32_t rect_w = rectheader.r.w;
+    uint32_t rect_h = rectheader.r.h;
+
+    // background and foreground carry over from tile to tile
+    uint16_t bgColor = 0;
+    uint16_t fgColor = 0;
+
+    DEBUG_VNC_HEXTILE("[hextile_rect] x: %d y: %d w: %d h: %d zlib: %d!\n", rect_x, rect_y, rect_w, rect_h, zlib);
+
+    if(!hextile_strip) {
+        hextile_strip = (uint16_t *) malloc(HEXTILE_STRIP_WIDTH * 16 * 2);
+        if(!hextile_strip) {
+            DEBUG_VNC("[hextile_rect] too less memory!\n");
+            return false;
+        }
+    }
 
-                rawUpdate.r.w = tile_w;
-                rawUpdate.r.h = tile_h;
+    /* the rect is divided into tiles of width and height 16, the tiles of a
+     * row are painted side by side into the strip and drawn together */
+    for(uint32_t ty = 0; ty < rect_h; ty += 16) {
+        uint32_t tile_h = min(rect_h - ty, (uint32_t) 16);
 
-                rawUpdate.r.x = rect_xW;
-                rawUpdate.r.y = rect_yW;
+        for(uint32_t run_x = 0; run_x < rect_w; run_x += HEXTILE_STRIP_WIDTH) {
+            uint32_t run_w = min(rect_w - run_x, (uint32_t) HEXTILE_STRIP_WIDTH);
 
-                if(!_handle_raw_encoded_message(rawUpdate)) {
-#ifdef VNC_SAVE_MEMORY
-                freeSec(buf);
-#endif
+            for(uint32_t tx = 0; tx < run_w; tx += 16) {
+                uint32_t tile_w = min(run_w - tx, (uint32_t) 16);
+                if(!hextile_tile(hextile_strip + tx, run_w, tile_w, tile_h, zlib, &bgColor, &fgColor)) {
                     return false;
                 }
+            }
 
-            } else { /* subrect encoding is not raw */
+            display->draw_area(rect_x + run_x, rect_y + ty, run_w, tile_h, (uint8_t *) hextile_strip);
+            delay(0);
+        }
+    }
 
-                /* check whether theres a new bg or fg colour specified */
-                if(subrect_encoding & rfbHextileBackgroundSpecified) {
-                    if(!read_from_rfb_server(sock, (char *) &bgColor, sizeof(bgColor))) {
-#ifdef VNC_SAVE_MEMORY
-                freeSec(buf);
-#endif
-                        return false;
-                    }
-                }
+    DEBUG_VNC_HEXTILE("[hextile_rect] ------------------------ Fin ------------------------\n");
+    return true;
+}
 
-                if(subrect_encoding & rfbHextileForegroundSpecified) {
-                    if(!read_from_rfb_server(sock, (char *) &fgColor, sizeof(fgColor))) {
-#ifdef VNC_SAVE_MEMORY
-                freeSec(buf);
-#endif
-                        return false;
-                    }
-                }
+/**
+ * paint one tile into the strip, rows are stride pixels apart
+ * with zlib the tile may come compressed: rfbHextileZlibRaw holds the raw
+ * pixels, rfbHextileZlibHex everything after the subencoding byte
+ */
+bool arduinoVNC::hextile_tile(uint16_t * tile, uint32_t stride, uint32_t tile_w, uint32_t tile_h, bool zlib, uint16_t * bgColor, uint16_t * fgColor) {
+    uint8_t subrect_encoding;
+    if(!rx_read8(&subrect_encoding)) {
+        return false;
+    }
 
-                //DEBUG_VNC_HEXTILE("[_handle_hextile_encoded_message] subrect: x: %d y: %d w: %d h: %d\n", rect_xW, rect_yW, tile_w, tile_h);
+#ifdef VNC_ZLIBHEX
+    if(zlib && (subrect_encoding & (rfbHextileZlibRaw | rfbHextileZlibHex))) {
+        uint16_t len;
+        if(!rx_read16(&len)) {
+            return false;
+        }
+        // the zlib subencodings invalidate the raw bit
+        vnc_zstream_t * zs;
+        if(subrect_encoding & rfbHextileZlibRaw) {
+            zs = zstreams.borrow(ZSTREAM_ZLIBHEX_RAW);
+            subrect_encoding = rfbHextileRaw;
+        } else {
+            zs = zstreams.borrow(ZSTREAM_ZLIBHEX);
+            subrect_encoding &= ~rfbHextileRaw;
+        }
+        if(!zs) {
+            return false;
+        }
+        zstream_zlen = Swap16IfLE(len);
 
-#ifdef VNC_FRAMEBUFFER
-                if(!fb.begin(tile_w, tile_h)) {
-                    DEBUG_VNC("[_handle_hextile_encoded_message] too less memory!\n");
-#ifdef VNC_SAVE_MEMORY
-                freeSec(buf);
+        hextile_zs = zs;
+        bool ok = hextile_tile_data(tile, stride, tile_w, tile_h, subrect_encoding, bgColor, fgColor);
+        hextile_zs = NULL;
+        return ok && zstream_finish(zs);
+    }
 #endif
-                    return false;
-                }
 
-                /* fill the background */
-                fb.draw_rect(0, 0, tile_w, tile_h, bgColor);
-#else
-                /* fill the background */
-                display->draw_rect(rect_xW, rect_yW, tile_w, tile_h, Swap16IfLE(bgColor));
-#endif
+    return hextile_tile_data(tile, stride, tile_w, tile_h, subrect_encoding, bgColor, fgColor);
+}
 
-                if(subrect_encoding & rfbHextileAnySubrects) {
-                    uint8_t nr_subr = 0;
-                    if(!read_from_rfb_server(sock, (char*) &nr_subr, 1)) {
-#ifdef VNC_SAVE_MEMORY
-                freeSec(buf);
-#endif
-                        return false;
-                    }
-                    //DEBUG_VNC_HEXTILE("[_handle_hextile_encoded_message] nr_subr: %d\n", nr_subr);
-                    if(nr_subr) {
-                        if(subrect_encoding & rfbHextileSubrectsColoured) {
-                            if(!read_from_rfb_server(sock, buf, nr_subr * 4)) {
-#ifdef VNC_SAVE_MEMORY
-                freeSec(buf);
-#endif
-                                return false;
-                            }
+/**
+ * everything of a tile after its subencoding byte, read through hextile_span()
+ */
+bool arduinoVNC::hextile_tile_data(uint16_t * tile, uint32_t stride, uint32_t tile_w, uint32_t tile_h, uint8_t subrect_encoding, uint16_t * bgColor, uint16_t * fgColor) {
+    const uint8_t * p;
 
-                            HextileSubrectsColoured_t * bufPC = (HextileSubrectsColoured_t *) buf;
-                            for(uint8_t n = 0; n < nr_subr; n++) {
-                                //  DEBUG_VNC_HEXTILE("[_handle_hextile_encoded_message] Coloured nr_subr: %d bufPC: 0x%08X\n", n, bufPC);
-#ifdef VNC_FRAMEBUFFER
-                                fb.draw_rect(bufPC->x, bufPC->y, bufPC->w + 1, bufPC->h + 1, bufPC->color);
-#else
-                                display->draw_rect(rect_xW + bufPC->x, rect_yW + bufPC->y, bufPC->w+1, bufPC->h+1, Swap16IfLE(bufPC->color));
-#endif
-                                bufPC++;
-                            }
-                        } else {
+    if(subrect_encoding & rfbHextileRaw) {
+        if(!(p = hextile_span(tile_w * tile_h * 2))) {
+            return false;
+        }
+        for(uint32_t row = 0; row < tile_h; row++) {
+            memcpy(tile + row * stride, p, tile_w * 2);
+            p += tile_w * 2;
+        }
+        return true;
+    }
 
-                            if(!read_from_rfb_server(sock, buf, nr_subr * 2)) {
-#ifdef VNC_SAVE_MEMORY
-                freeSec(buf);
-#endif
-                                return false;
-                            }
+    /* check whether theres a new bg or fg colour specified */
+    if(subrect_encoding & rfbHextileBackgroundSpecified) {
+        if(!(p = hextile_span(2))) {
+            return false;
+        }
+        memcpy(bgColor, p, 2);
+    }
+    if(subrect_encoding & rfbHextileForegroundSpecified) {
+        if(!(p = hextile_span(2))) {
+            return false;
+        }
+        memcpy(fgColor, p, 2);
+    }
 
-                            HextileSubrects_t * bufP = (HextileSubrects_t *) buf;
-                            for(uint8_t n = 0; n < nr_subr; n++) {
+    hextile_fill(tile, stride, tile_w, tile_h, *bgColor);
 
-                                // DEBUG_VNC_HEXTILE("[_handle_hextile_encoded_message] nr_subr: %d bufP: 0x%08X\n", n, bufP);
-#ifdef VNC_FRAMEBUFFER
-                                fb.draw_rect(bufP->x, bufP->y, bufP->w + 1, bufP->h + 1, fgColor);
-#else
-                                display->draw_rect(rect_xW + bufP->x, rect_yW + bufP->y, bufP->w+1, bufP->h+1, Swap16IfLE(fgColor));
-#endif
-                                bufP++;
-                            }
-                        }
-                    }
-                }
-#ifdef VNC_FRAMEBUFFER
-                display->draw_area(rect_xW - opt.v_offset, rect_yW - opt.h_offset, tile_w, tile_h, fb.getPtr());
-#endif
-            }
-            j++;
-            delay(0);
-        }
-        remaining_w = rectheader.r.w;
-        tile_w = 16; /* reset for next row */
-        i++;
+    if(!(subrect_encoding & rfbHextileAnySubrects)) {
+        return true;
     }
 
-#ifdef VNC_SAVE_MEMORY
-#ifdef VNC_FRAMEBUFFER
-    fb.freeBuffer();
-#endif
-    freeSec(buf);
-#endif
+    if(!(p = hextile_span(1))) {
+        return false;
+    }
+    uint8_t nr_subr = *p;
 
-    DEBUG_VNC_HEXTILE("[_handle_hextile_encoded_message] ------------------------ Fin ------------------------\n");
+    // subrects are used in place from the receive buffer or the zlib window
+    bool coloured = subrect_encoding & rfbHextileSubrectsColoured;
+    if(!(p = hextile_span(nr_subr * (coloured ? 4 : 2)))) {
+        return false;
+    }
+
+    uint16_t color = *fgColor;
+    for(uint8_t n = 0; n < nr_subr; n++) {
+        if(coloured) {
+            memcpy(&color, p, 2);
+            p += 2;
+        }
+        uint32_t x = rfbHextileExtractX(p[0]);
+        uint32_t y = rfbHextileExtractY(p[0]);
+        uint32_t w = rfbHextileExtractW(p[1]);
+        uint32_t h = rfbHextileExtractH(p[1]);
+        p += 2;
+
+        // subrects reaching out of a smaller tile are cut
+        if(x < tile_w && y < tile_h) {
+            hextile_fill(tile + y * stride + x, stride, min(w, tile_w - x), min(h, tile_h - y), color);
+        }
+    }
     return true;
 }
 #endif
@@ -1574,119 +2340,200 @@ bool arduinoVNC::_handle_zlib_encoded_message(rfbFramebufferUpdateRectHeader rec
         return false;
     }
 
-    size_t remaining = Swap32IfLE(hdr.nBytes);
-
-    DEBUG_VNC_ZLIB("[_handle_zlib_encoded_message] Byte size %zu\n", remaining);
-
-    size_t processed = 0;
+    vnc_zstream_t * zs = zstreams.borrow(ZSTREAM_ZLIB);
+    if(!zs) {
+        return false;
+    }
+    zstream_zlen = Swap32IfLE(hdr.nBytes);
 
-    zin_next = zin;
-    mz_uint32 flags = TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_PARSE_ZLIB_HEADER;
+    DEBUG_VNC_ZLIB("[_handle_zlib_encoded_message] Byte size %zu\n", zstream_zlen);
 
     uint16_t w = rectheader.r.w;
     uint16_t h = rectheader.r.h;
 
-    size_t bytes_available = 0;
+    // inflated bytes of the rect not drawn yet
+    size_t remaining = (size_t) w * h * 2;
 
-    bool leftOver = false;
+    // clipping to the display is done by the display layers
+    display->area_update_start(rectheader.r.x, rectheader.r.y, w, h);
 
-    int32_t xOffset = rectheader.r.x - opt.v_offset;
-    int32_t yOffset = rectheader.r.y - opt.h_offset;
+    while(remaining) {
+        // a pixel split between two inflate steps waits for its second byte
+        if(zs->next - zs->read < 2 && !zstream_inflate_more(zs)) {
+            return false;
+        }
+        size_t pixels = min((size_t) (zs->next - zs->read), remaining) / 2;
+        display->area_update_data((char *) zs->read, pixels);
+        zs->read += pixels * 2;
+        remaining -= pixels * 2;
+    }
+
+    display->area_update_end();
+
+    DEBUG_VNC_ZLIB("[_handle_zlib_encoded_message] done (%d pixels)\n", w * h);
+
+    return zstream_finish(zs);
+}
+#endif
+
+#ifdef VNC_ZRLE
+/**
+ * one row of a packed palette tile, rows start on a byte boundary
+ * every input byte is one copy of its entry in the expand table, called
+ * with a constant bits so the copies get a fixed size
+ */
+static inline void zrle_unpack_row(uint16_t * p, const uint8_t * src, uint16_t w, const uint8_t bits, const uint8_t * table) {
+    const size_t stride = 16 / bits;
+    const uint16_t per_byte = 8 / bits;
+
+    for(; w >= per_byte; w -= per_byte) {
+        memcpy(p, table + *src++ * stride, stride);
+        p += per_byte;
+    }
+    if(w) {
+        memcpy(p, table + *src * stride, w * 2);
+    }
+}
 
-    int32_t xAvail = ((int32_t)display->getWidth())-xOffset;
-    int32_t yAvail = ((int32_t)display->getHeight())-yOffset;
+/**
+ * fill the expand table with the 8, 4 or 2 pixels of every input byte
+ * Text tiles mostly share their palette, the table is only rebuilt when it
+ * changes. The byte entries are put together from nibble entries.
+ * All 1 << bits palette slots end up in the table, also the ones above the
+ * palette size of the tile, so all of them are part of the cache key.
+ */
+void arduinoVNC::zrle_expand_table(uint8_t bits) {
+    size_t slots = 1 << bits;
+    if(bits == zrle_expand_bits && !memcmp(zrle_expand_palette, palette, slots * 2)) {
+        return;
+    }
 
-    bool allVisible =
-        xOffset >= 0 &&
-        yOffset >= 0 &&
-        w <= xAvail &&
-        h <= yAvail;
+    uint8_t mask = slots - 1;
+    size_t half = 8 / bits;
+    uint8_t nibble[16][8];
 
-    bool allHidden =
-        xOffset + w < 0 ||
-        yOffset + h < 0 ||
-        xOffset >= display->getWidth() ||
-        yOffset >= display->getHeight();
+    for(uint8_t n = 0; n < 16; n++) {
+        for(uint8_t i = 0; i < 4 / bits; i++) {
+            uint16_t color = palette[(n >> (4 - bits * (i + 1))) & mask];
+            memcpy(&nibble[n][i * 2], &color, 2);
+        }
+    }
 
-    display->area_update_start(
-        max((int32_t)0, xOffset),
-        max((int32_t)0, yOffset),
-        min(xAvail, (int32_t)w),
-        min(yAvail, (int32_t)h)
-        );
+    uint8_t * e = (uint8_t *) zrle_expand;
+    for(uint16_t b = 0; b < 256; b++) {
+        memcpy(e, nibble[b >> 4], half);
+        memcpy(e + half, nibble[b & 15], half);
+        e += half * 2;
+    }
 
-    DEBUG_VNC_ZLIB("[_handle_zlib_encoded_message] visi: %d hidden: %d\n", allVisible, allHidden);
+    zrle_expand_bits = bits;
+    memcpy(zrle_expand_palette, palette, slots * 2);
+}
 
-    while (remaining) {
-        size_t toRead = min(remaining, (size_t)ZRLE_INPUT_BUFFER - ((zin_next - zin) + bytes_available));
+/**
+ * decode a tile into framebuffer, its subencoding byte has been read
+ */
+bool arduinoVNC::zrle_tile(vnc_zstream_t * zs, uint8_t subrect_encoding, uint16_t tile_w, uint16_t tile_h) {
+    size_t tile_size = tile_w * tile_h;
+    const uint8_t * span;
 
-        /* Fill the buffer, obtaining data from the server. */
-        if (!read_from_rfb_server(sock, (char*)zin_next, toRead)) {
+    if (subrect_encoding == rfbTrleRaw) {
+        DEBUG_VNC_ZRLE("[zrle_tile] %d RAW w: %d h: %d\n", subrect_encoding, tile_w, tile_h);
+        if(!(span = zstream_span(zs, tile_size * 2))) {
             return false;
         }
-        if(!bytes_available) {
-            zin_next = zin;
-        }
-        remaining -= toRead;
-        bytes_available += toRead;
+        memcpy(framebuffer, span, tile_size * 2);
+        return true;
+    }
+
+    size_t paletteSize = subrect_encoding & 127;
+    if(!(span = zstream_span(zs, paletteSize * 2))) {
+        return false;
+    }
+    memcpy(palette, span, paletteSize * 2);
 
-        while(bytes_available) {
-            size_t bytes_decompressed = zout + ZRLE_OUTPUT_BUFFER - zout_next;
-            size_t bytes_consumed = bytes_available;
+    uint16_t * p = framebuffer;
 
-            tinfl_status last_status = tinfl_decompress(&inflator, zin_next, &bytes_consumed, zout, zout_next, &bytes_decompressed, flags);
-            if(last_status < TINFL_STATUS_DONE) {
-                DEBUG_VNC_ZLIB("[_handle_zlib_encoded_message] decoding failed: %d\n", last_status);
-                return false;
+    if (subrect_encoding == rfbTrleSolid) {
+        DEBUG_VNC_ZRLE("[zrle_tile] %d SOLID w: %d h: %d c: %d\n", subrect_encoding, tile_w, tile_h, palette[0]);
+        for(size_t i = 0; i < tile_size; i++) {
+            *p++ = palette[0];
+        }
+    } else if (subrect_encoding <= rfbTrleReusePackedPalette) {
+        uint8_t bits = (paletteSize == 2) ? 1 : (paletteSize <= 4) ? 2 : (paletteSize <= 16) ? 4 : 8;
+        size_t row_bytes = (tile_w * bits + 7) / 8;
+        DEBUG_VNC_ZRLE("[zrle_tile] %d %d-bit, w: %d h: %d\n", subrect_encoding, bits, tile_w, tile_h);
+
+        // the whole tile is one span, at most 4096 bytes
+        if(!(span = zstream_span(zs, row_bytes * tile_h))) {
+            return false;
+        }
+        if(bits == 8) {
+            for(size_t i = 0; i < tile_size; i++) {
+                *p++ = palette[*span++ & 127];
             }
-            bytes_available -= bytes_consumed;
-            zin_next += bytes_consumed;
-            // Consume byte left from last run
-            if(leftOver) {
-                bytes_decompressed++;
-                zout_next--;
+        } else {
+            zrle_expand_table(bits);
+            const uint8_t * table = (const uint8_t *) zrle_expand;
+            for(uint16_t row = 0; row < tile_h; row++) {
+                switch(bits) {
+                    case 1: zrle_unpack_row(p, span, tile_w, 1, table); break;
+                    case 2: zrle_unpack_row(p, span, tile_w, 2, table); break;
+                    default: zrle_unpack_row(p, span, tile_w, 4, table); break;
+                }
+                p += tile_w;
+                span += row_bytes;
             }
-            if(allVisible) {
-                display->area_update_data((char *)zout_next, bytes_decompressed / 2);
-                processed += bytes_decompressed / 2;
-            } else if (allHidden){
-                processed += bytes_decompressed / 2;
+        }
+    } else {
+        bool plain = (subrect_encoding == rfbTrlePlainRLE);
+        DEBUG_VNC_ZRLE("[zrle_tile] %d %s RLE w: %d h: %d\n", subrect_encoding, plain ? "Plain" : "Palette", tile_w, tile_h);
+
+        uint16_t * end = framebuffer + tile_size;
+        while (p < end) {
+            uint16_t color;
+            bool run;
+            if(plain) {
+                if(!(span = zstream_span(zs, 2))) {
+                    return false;
+                }
+                memcpy(&color, span, 2);
+                run = true;
             } else {
-                uint32_t n = 0;
-                while(n+1 < bytes_decompressed) {
-                    int32_t cX = (processed % w) + xOffset;
-                    int32_t cY = (processed / w) + yOffset;
-                    if(cX >= 0 && cY >= 0 && cX < display->getWidth() && cY < display->getHeight()) {
-                        // This could be further optimized to consider line wrapping, but doesn't seem worth the effort
-                        uint32_t printable = min(display->getWidth() - cX, (bytes_decompressed-n) / 2);
-                        display->area_update_data((char *)zout_next+n, printable);
-                        processed += printable;
-                        n += printable*2;
-                    } else {
-                        processed++;
-                        n += 2;
-                    }
+                if(!(span = zstream_span(zs, 1))) {
+                    return false;
                 }
+                color = palette[*span & 127];
+                run = (*span & 128) != 0;
+            }
+
+            size_t runLength = 1;
+            if(run) {
+                uint8_t runLenMinus1;
+                do {
+                    if(!(span = zstream_span(zs, 1))) {
+                        return false;
+                    }
+                    runLenMinus1 = *span;
+                    runLength += runLenMinus1;
+                } while (runLenMinus1 == 255);
+            }
+
+            if (runLength > (size_t) (end - p)) {
+                DEBUG_VNC_ZRLE("[zrle_tile] %d RLE run %d > %d left\n", subrect_encoding, runLength, end - p);
+                runLength = end - p;
             }
-            zout_next += bytes_decompressed;
-            // Check if we have a left over byte for next run
-            leftOver = bytes_decompressed % 2;
-            if(zout_next >= zout + ZRLE_OUTPUT_BUFFER) {
-                zout_next = zout;
+            while (runLength--) {
+                *p++ = color;
             }
-            DEBUG_VNC_ZLIB("[_handle_zlib_encoded_message] Avail: %zu Consumed: %zu Decomp: %zu AvailOut: %zu Status: %d\n", bytes_available, bytes_consumed, bytes_decompressed, zout + ZRLE_OUTPUT_BUFFER - zout_next, last_status);
         }
     }
-
-    display->area_update_end();
-
-    DEBUG_VNC_ZLIB("[_handle_zlib_encoded_message] done (%zu of %zu)\n", processed, w*h);
-
     return true;
 }
-#endif
 
-#ifdef VNC_ZRLE
+/**
+ * ZRLE rect, ZYWRLE rects come here as well
+ */
 bool arduinoVNC::_handle_zrle_encoded_message(rfbFramebufferUpdateRectHeader rectheader) {
     uint16_t x = rectheader.r.x;
     uint16_t y = rectheader.r.y;
@@ -1699,210 +2546,363 @@ bool arduinoVNC::_handle_zrle_encoded_message(rfbFramebufferUpdateRectHeader rec
     if (!read_from_rfb_server(sock, (char *)&zlh, sz_rfbZlibHeader)) {
         return false;
     }
-    uint32_t len = Swap32IfLE(zlh.nBytes);
+    vnc_zstream_t * zs = zstreams.borrow(ZSTREAM_ZRLE);
+    if(!zs) {
+        return false;
+    }
+    zstream_zlen = Swap32IfLE(zlh.nBytes);
+
+    DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] len: %zu\n", zstream_zlen);
 
-    DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] len: %zu\n", len);
+#ifdef VNC_ZYWRLE
+    // raw tiles of a ZYWRLE rect carry wavelet coefficients
+    uint8_t level = 0;
+    if(rectheader.encoding == rfbEncodingZYWRLE) {
+        level = zywrle_level;
+        if(!zywrle) {
+            zywrle = (vnc_zywrle_t *) malloc(sizeof(vnc_zywrle_t));
+            if(!zywrle) {
+                DEBUG_VNC("[_handle_zrle_encoded_message] too less memory!\n");
+                return false;
+            }
+        }
+    }
+#endif
 
-    msg_bytes_remain = len;
-    zin_next = zin;
-    bytes_available = 0;
-    zout_read = zout_next;
+    const uint8_t * span;
 
-    uint16_t rect_x, rect_y, rect_w, rect_h, i = 0, j = 0;
-    uint16_t rect_xW, rect_yW;
+    for(uint16_t ty = 0; ty < h; ty += 64) {
+        uint16_t tile_h = min(64, h - ty);
 
-    uint16_t tile_w = 64, tile_h = 64;
-    uint16_t remaining_w, remaining_h;
-    size_t tile_size;
-    uint16_t *p;
+        for(uint16_t tx = 0; tx < w; tx += 64) {
+            uint16_t tile_w = min(64, w - tx);
+            size_t tile_size = tile_w * tile_h;
+            uint16_t rect_xW = x + tx;
+            uint16_t rect_yW = y + ty;
 
-    CARD8 subrect_encoding;
+            if(!(span = zstream_span(zs, 1))) {
+                return false;
+            }
+            uint8_t subrect_encoding = *span;
 
-    uint16_t color;
-    size_t idx;
-    size_t paletteSize = 0;
+#ifdef VNC_ZYWRLE
+            if (subrect_encoding == rfbTrleRaw && level) {
+                // the coefficients follow as a tile of their own
+                DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] ZYWRLE level %d x: %d y: %d w: %d h: %d\n", level, rect_xW, rect_yW, tile_w, tile_h);
+                if(!(span = zstream_span(zs, 1)) || !zrle_tile(zs, *span, tile_w, tile_h)) {
+                    return false;
+                }
+                vnc_zywrle_synthesize(zywrle, framebuffer, tile_w, tile_h, level);
+                display->draw_area(rect_xW, rect_yW, tile_w, tile_h, (uint8_t *) framebuffer);
+                continue;
+            }
+#endif
 
-    rect_w = remaining_w = w;
-    rect_h = remaining_h = h;
-    rect_x = x;
-    rect_y = y;
+            if (subrect_encoding == rfbTrleRaw) {
+                DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d RAW x: %d y: %d w: %d h: %d\n", subrect_encoding, rect_xW, rect_yW, tile_w, tile_h);
+                if(!(span = zstream_span(zs, tile_size * 2))) {
+                    return false;
+                }
+                // pixels are read as uint16_t further down, only aligned spans go out directly
+                if(((uintptr_t) span & 1) == 0) {
+                    display->draw_area(rect_xW, rect_yW, tile_w, tile_h, (uint8_t *) span);
+                } else {
+                    memcpy(framebuffer, span, tile_size * 2);
+                    display->draw_area(rect_xW, rect_yW, tile_w, tile_h, (uint8_t *) framebuffer);
+                }
+                continue;
+            }
 
-    size_t runLengthCount = 0;
-    uint8_t runLenMinus1;
-    uint16_t runLength;
+            if (subrect_encoding == rfbTrleSolid) {
+                uint16_t color;
+                if(!(span = zstream_span(zs, 2))) {
+                    return false;
+                }
+                memcpy(&color, span, 2);
+                DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d SOLID x: %d y: %d w: %d h: %d c: %d\n", subrect_encoding, rect_xW, rect_yW, tile_w, tile_h, color);
+                display->draw_rect(rect_xW, rect_yW, tile_w, tile_h, SwapPixel(color));
+                continue;
+            }
 
-    while (i < rect_h) {
-        /* the rect is divided into tiles of width and height 64. Iterate over
-        * those */
-        /* the last tile in a column could be smaller than 16 */
-        if (remaining_h < 64) {
-            tile_h = remaining_h;
+            if(!zrle_tile(zs, subrect_encoding, tile_w, tile_h)) {
+                return false;
+            }
+            display->draw_area(rect_xW, rect_yW, tile_w, tile_h, (uint8_t *)framebuffer);
         }
+    }
 
-        /* the last tile in a row could also be smaller */
-        if (remaining_w < 64) {
-            tile_w = remaining_w;
-        } else {
-            remaining_w -= 64;
+    // the sync flush at the end leaves tinfl_decompress in the right state
+    if(!zstream_finish(zs)) {
+        return false;
+    }
+    DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] ------------------------ Fin ------------------------\n");
+    return true;
+}
+#endif // #ifdef VNC_ZRLE
+
+#ifdef VNC_TIGHT
+bool arduinoVNC::_handle_tight_encoded_message(rfbFramebufferUpdateRectHeader rectheader) {
+    uint16_t x = rectheader.r.x;
+    uint16_t y = rectheader.r.y;
+    uint16_t w = rectheader.r.w;
+    uint16_t h = rectheader.r.h;
+
+    uint8_t comp_ctl;
+    if(!rx_read8(&comp_ctl)) {
+        return false;
+    }
+
+    DEBUG_VNC_TIGHT("[_handle_tight_encoded_message] x: %d y: %d w: %d h: %d ctl: 0x%02X\n", x, y, w, h, comp_ctl);
+
+    // streams are reset even if the rect does not use zlib
+    for(uint8_t i = 0; i < TIGHT_STREAMS; i++) {
+        if(comp_ctl & (1 << i)) {
+            zstreams.reset(ZSTREAM_TIGHT + i);
         }
+    }
+    comp_ctl >>= 4;
 
-        tile_size = tile_w * tile_h;
-        rect_xW = rect_x + j;
-        rect_yW = rect_y + i;
+    if(comp_ctl == rfbTightFill) {
+        uint16_t color;
+        if(!rx_read16(&color)) {
+            return false;
+        }
+        display->draw_rect(x, y, w, h, SwapPixel(color));
+        return true;
+    }
 
-        read_from_z(&subrect_encoding, 1);
+    if(comp_ctl == rfbTightJpeg) {
+        return _handle_tight_jpeg(x, y, w, h);
+    }
 
-        if (subrect_encoding == rfbTrleRaw) {
-            DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d RAW x: %d y: %d w: %d h: %d\n", subrect_encoding, rect_xW, rect_yW, tile_w, tile_h);
-            read_from_z((uint8_t *)framebuffer, tile_size * 2);
-            display->draw_area(rect_xW, rect_yW, tile_w, tile_h, (uint8_t *)framebuffer);
-        } else {
-            paletteSize = subrect_encoding & 127;
+    bool compressed = true;
+    if((comp_ctl & ~rfbTightExplicitFilter) == rfbTightNoZlib) {
+        compressed = false;
+    } else if(comp_ctl > rfbTightMaxSubencoding) {
+        DEBUG_VNC("[_handle_tight_encoded_message] bad subencoding 0x%02X\n", comp_ctl);
+        return false;
+    }
 
-            read_from_z((uint8_t *)&palette, paletteSize * 2);
- 
-            if (subrect_encoding == rfbTrleSolid) {
-                DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d SOLID x: %d y: %d w: %d h: %d c: %d\n", subrect_encoding, rect_xW, rect_yW, tile_w, tile_h, palette[0]);
-                display->draw_rect(rect_xW, rect_yW, tile_w, tile_h, Swap16IfLE(palette[0]));
-            } else if (subrect_encoding <= rfbTrleReusePackedPalette) {
-                p = framebuffer;
-                uint8_t data = 0;
-                if (paletteSize == 2) { // 1-bit
-                    DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d 1-bit, x: %d y: %d w: %d h: %d\n", subrect_encoding, rect_xW, rect_yW, tile_w, tile_h);
-
-                    for (int hidx = 0; hidx < tile_h; ++hidx) {
-                        for (idx = 0; idx < tile_w; ++idx) {
-                            if ((idx & 0b111) == 0) { // new byte
-                                read_from_z(&data, 1);
-                            } else {
-                                data <<= 1;
-                            }
-                            *p++ = palette[(data >> 7) & 127];
-                        }
-                    }
-                } else if (paletteSize <= 4) { // 3-4 palettes, 2-bit
-                    DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d 2-bit, x: %d y: %d w: %d h: %d\n", subrect_encoding, rect_xW, rect_yW, tile_w, tile_h);
-
-                    for (int hidx = 0; hidx < tile_h; ++hidx) {
-                        for (idx = 0; idx < tile_w; ++idx) {
-                            if ((idx & 0b11) == 0) { // new byte
-                                read_from_z(&data, 1);
-                            } else {
-                                data <<= 2;
-                            }
-                            *p++ = palette[(data >> 6) & 127];
-                        }
-                    }
-                } else if (paletteSize <= 16) { // 5-16 palettes, 4-bit
-                    DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d 4-bit, x: %d y: %d w: %d h: %d\n", subrect_encoding, rect_xW, rect_yW, tile_w, tile_h);
-
-                    for (int hidx = 0; hidx < tile_h; ++hidx) {
-                        for (idx = 0; idx < tile_w; ++idx) {
-                            if ((idx & 1) == 0) { // new byte
-                                read_from_z(&data, 1);
-                            } else {
-                                data <<= 4;
-                            }
-                            *p++ = palette[(data >> 4) & 127];
-                        }
-                    }
-                } else { // > 16 palettes, 8-bit
-                    DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d 8-bit, x: %d y: %d w: %d h: %d\n", subrect_encoding, rect_xW, rect_yW, tile_w, tile_h);
+    uint8_t filter = rfbTightFilterCopy;
+    if((comp_ctl & rfbTightExplicitFilter) && !rx_read8(&filter)) {
+        return false;
+    }
+    uint8_t stream = comp_ctl & 0x03;
 
-                    for (idx = 0; idx < tile_size; ++idx) {
-                        read_from_z(&data, 1);
-                        *p++ = palette[data & 127];
-                    }
-                }
+    if(w > TIGHT_MAX_WIDTH) {
+        DEBUG_VNC("[_handle_tight_encoded_message] rect too wide: %d\n", w);
+        return false;
+    }
+    if(!tight_init_buffers()) {
+        return false;
+    }
 
-                display->draw_area(rect_xW, rect_yW, tile_w, tile_h, (uint8_t *)framebuffer);
-            } else if (subrect_encoding == rfbTrlePlainRLE) {
-                DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d Plain RLE x: %d y: %d w: %d h: %d\n", subrect_encoding, rect_xW, rect_yW, tile_w, tile_h);
-                p = framebuffer;
-                runLengthCount = 0;
-                while (runLengthCount < tile_size) {
-                    read_from_z((uint8_t *)&color, 2);
+    uint16_t palette[256];
+    size_t numColors = 0;
+    size_t rowBytes;
 
-                    runLength = 1;
-                    do {
-                        read_from_z(&runLenMinus1, 1);
+    switch(filter) {
+        case rfbTightFilterCopy:
+        case rfbTightFilterGradient:
+            rowBytes = w * 2;
+            break;
+        case rfbTightFilterPalette: {
+            uint8_t n;
+            if(!rx_read8(&n)) {
+                return false;
+            }
+            numColors = n + 1;
+            if(!read_from_rfb_server(sock, (char *) palette, numColors * 2)) {
+                return false;
+            }
+            rowBytes = (numColors == 2) ? ((w + 7) / 8) : w;
+            break;
+        }
+        default:
+            DEBUG_VNC("[_handle_tight_encoded_message] unknown filter %d\n", filter);
+            return false;
+    }
 
-                        runLength += runLenMinus1;
-                    } while (runLenMinus1 == 255);
+    // an empty rect ends after its palette, short data is never compressed
+    if(w == 0 || h == 0) {
+        return true;
+    }
 
-                    runLengthCount += runLength;
-                    if (runLengthCount > tile_size) {
-                        DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d Plain RLE runLengthCount(%d) > tile_size(%d)\n", subrect_encoding, runLengthCount, tile_size);
-                    } else {
-                        while (runLength--) {
-                            *p++ = color;
-                        }
-                    }
-                }
+    if(rowBytes * h < TIGHT_MIN_TO_COMPRESS) {
+        compressed = false;
+    }
+    vnc_zstream_t * zs = NULL;
+    if(compressed) {
+        if(!tight_read_compact_len(&zstream_zlen) || !(zs = zstreams.borrow(ZSTREAM_TIGHT + stream))) {
+            return false;
+        }
+    }
 
-                display->draw_area(rect_xW, rect_yW, tile_w, tile_h, (uint8_t *)framebuffer);
-            } else { // Palette RLE
-                DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d Palette RLE x: %d y: %d w: %d h: %d\n", subrect_encoding, rect_xW, rect_yW, tile_w, tile_h);
-                p = framebuffer;
-                runLengthCount = 0;
-                while (runLengthCount < tile_size) {
-                    read_from_z((uint8_t *)&idx, 1);
-
-                    runLength = 1;
-                    if ((idx & 128) != 0) {
-                        do {
-                            read_from_z(&runLenMinus1, 1);
-
-                            runLength += runLenMinus1;
-                        } while (runLenMinus1 == 255);
-                    }
+    if(filter == rfbTightFilterGradient) {
+        // the row above the rect is predicted as black
+        memset(tight_data, 0, w * 3);
+    }
 
-                    color = palette[idx & 127];
+    // decode and draw as many rows at once as the buffer holds
+    uint16_t rows = TIGHT_BUFFER_PIXELS / w;
+    for(uint16_t row = 0; row < h; row += rows) {
+        uint16_t n = min(rows, (uint16_t)(h - row));
+        uint16_t * p = tight_pixels;
 
-                    runLengthCount += runLength;
-                    // DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] Palette RLE idx: %d, runLength: %d, runLengthCount: %d.\n", idx, runLength, runLengthCount);
-                    if (runLengthCount > tile_size) {
-                        DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] %d Palette RLE runLengthCount(%d) > tile_size(%d)\n", subrect_encoding, runLengthCount, tile_size);
-                    } else {
-                        while (runLength--) {
-                            *p++ = color;
-                        }
+        if(filter == rfbTightFilterPalette) {
+            if(!tight_read(zs, tight_data, rowBytes * n)) {
+                return false;
+            }
+            const uint8_t * src = tight_data;
+            if(numColors == 2) {
+                for(uint16_t r = 0; r < n; r++) {
+                    for(uint16_t i = 0; i < w; i++) {
+                        *p++ = palette[(src[i >> 3] >> (7 - (i & 7))) & 1];
                     }
+                    src += rowBytes;
+                }
+            } else {
+                for(size_t i = 0; i < (size_t) w * n; i++) {
+                    *p++ = palette[src[i]];
                 }
+            }
+        } else {
+            if(!tight_read(zs, (uint8_t *) p, rowBytes * n)) {
+                return false;
+            }
+            if(filter == rfbTightFilterGradient) {
+                tight_filter_gradient(p, tight_data, w, n);
+            }
+        }
+
+        display->draw_area(x, y + row, w, n, (uint8_t *) tight_pixels);
+    }
+
+    if(zs) {
+        return zstream_finish(zs);
+    }
+    return true;
+}
+
+bool arduinoVNC::_handle_tight_jpeg(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+    size_t len;
+    const uint8_t * data;
+
+    if(!tight_read_compact_len(&len)) {
+        return false;
+    }
 
-                display->draw_area(rect_xW, rect_yW, tile_w, tile_h, (uint8_t *)framebuffer);
+    DEBUG_VNC_TIGHT("[_handle_tight_jpeg] x: %d y: %d w: %d h: %d len: %u\n", x, y, w, h, (unsigned) len);
+
+    if(len <= VNC_RX_BUFFER) {
+        // decode straight from the receive buffer
+        data = rx_span(len);
+        if(!data) {
+            return false;
+        }
+    } else {
+        if(len > tight_jpeg_size) {
+            uint8_t * buf = (uint8_t *) realloc(tight_jpeg, len);
+            if(!buf) {
+                DEBUG_VNC("[_handle_tight_jpeg] no memory for %u bytes\n", (unsigned) len);
+                return false;
             }
+            tight_jpeg = buf;
+            tight_jpeg_size = len;
+        }
+        if(!read_from_rfb_server(sock, (char *) tight_jpeg, len)) {
+            return false;
         }
+        data = tight_jpeg;
+    }
 
-        // next tile
-        j += 64;
-        if (j >= rect_w) {
-            j = 0;
-            remaining_w = w;
-            tile_w = 64; /* reset for next row */
-            i += 64;
+    if(!display->draw_jpeg(x, y, w, h, data, len)) {
+        DEBUG_VNC("[_handle_tight_jpeg] JPEG decoding failed\n");
+        return false;
+    }
+    return true;
+}
 
-            if (remaining_h >= 64) {
-                remaining_h -= 64;
-            } else {
-                break;
+/**
+ * undo the gradient filter in place
+ * each color component was sent as the difference to the prediction
+ * left + above - above left, prev holds the components of the row above
+ */
+void arduinoVNC::tight_filter_gradient(uint16_t * pixels, uint8_t * prev, uint16_t w, uint16_t rows) {
+    const int max[3] = { opt.client.redmax, opt.client.greenmax, opt.client.bluemax };
+    const int shift[3] = { opt.client.redshift, opt.client.greenshift, opt.client.blueshift };
+
+    while(rows--) {
+        int left[3] = { 0, 0, 0 };
+        int upleft[3] = { 0, 0, 0 };
+        uint8_t * above = prev;
+
+        for(uint16_t x = 0; x < w; x++) {
+            uint16_t diff = SwapPixel(*pixels);
+            uint16_t pixel = 0;
+            for(uint8_t c = 0; c < 3; c++) {
+                int est = above[c] + left[c] - upleft[c];
+                if(est < 0) {
+                    est = 0;
+                } else if(est > max[c]) {
+                    est = max[c];
+                }
+                left[c] = ((diff >> shift[c]) + est) & max[c];
+                upleft[c] = above[c];
+                above[c] = left[c];
+                pixel |= left[c] << shift[c];
             }
+            *pixels++ = SwapPixel(pixel);
+            above += 3;
         }
+    }
+}
 
-        // DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] loop i: %d, j: %d\n", i, j);
+bool arduinoVNC::tight_init_buffers(void) {
+    if(!tight_pixels) {
+        tight_pixels = (uint16_t *) malloc(TIGHT_BUFFER_PIXELS * 2);
+    }
+    if(!tight_data) {
+        tight_data = (uint8_t *) malloc(TIGHT_DATA_SIZE);
+    }
+    if(!tight_pixels || !tight_data) {
+        DEBUG_VNC("[tight_init_buffers] malloc failed!\n");
+        return false;
     }
+    return true;
+}
 
-    // We need to consume the remaining data to make sure the TCP buffer is 
-    // at correct position and tinfl_decompress is in the right state
-    while(msg_bytes_remain > 0) {
-        DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] reading left-over bytes from message: %d\n", msg_bytes_remain);
-        uint8_t skipped;
-        read_from_z(&skipped, 1);
+bool arduinoVNC::tight_read_compact_len(size_t * len) {
+    uint8_t b;
+    if(!rx_read8(&b)) {
+        return false;
+    }
+    *len = b & 0x7F;
+    if(b & 0x80) {
+        if(!rx_read8(&b)) {
+            return false;
+        }
+        *len |= (size_t) (b & 0x7F) << 7;
+        if(b & 0x80) {
+            if(!rx_read8(&b)) {
+                return false;
+            }
+            *len |= (size_t) b << 14;
+        }
     }
-    DEBUG_VNC_ZRLE("[_handle_zrle_encoded_message] ------------------------ Fin ------------------------\n");
     return true;
 }
-#endif // #ifdef VNC_ZRLE
+
+/**
+ * read n bytes of filter data, from zlib stream zs or as sent when it is NULL
+ */
+bool arduinoVNC::tight_read(vnc_zstream_t * zs, uint8_t * out, size_t n) {
+    if(!zs) {
+        return read_from_rfb_server(sock, (char *) out, n);
+    }
+    return zstream_read(zs, out, n);
+}
+#endif // #ifdef VNC_TIGHT
 
 bool arduinoVNC::_handle_cursor_pos_message(rfbFramebufferUpdateRectHeader rectheader) {
     DEBUG_VNC_RICH_CURSOR("[HandleCursorPos] x: %d y: %d w: %d h: %d\n", rectheader.r.x, rectheader.r.y, rectheader.r.w, rectheader.r.h);
@@ -1989,6 +2989,49 @@ bool arduinoVNC::_handle_server_continuous_updates_message(rfbFramebufferUpdateR
     return true;
 }
 
+bool arduinoVNC::_handle_server_fence_message(void) {
+    rfbFenceMsg fm;
+    uint8_t data[255];
+
+    if(!read_from_rfb_server(sock, ((char*) &fm) + 1, sz_rfbFenceMsg - 1)) {
+        return false;
+    }
+    uint32_t flags = Swap32IfLE(fm.flags);
+    if(!read_from_rfb_server(sock, (char*) data, fm.length)) {
+        return false;
+    }
+
+    fenceSupported = true;
+
+    if(flags & rfbFenceFlagRequest) {
+        // everything before it is processed and nothing after it has
+        // started yet, messages are handled one at a time
+        DEBUG_VNC("[_handle_server_fence_message] request flags: 0x%08X len: %d\n", flags, fm.length);
+        return rfb_send_fence(flags & (rfbFenceFlagBlockBefore | rfbFenceFlagBlockAfter | rfbFenceFlagSyncNext), data, fm.length);
+    }
+
+    // answer to a frame fence
+    if(fm.length == sizeof(fenceAcked)) {
+        memcpy(&fenceAcked, data, sizeof(fenceAcked));
+    }
+    return true;
+}
+
+bool arduinoVNC::_handle_end_of_continuous_updates_message(void) {
+    if(!cuSupported) {
+        DEBUG_VNC("[_handle_end_of_continuous_updates_message] server supports continuous updates\n");
+    }
+    cuSupported = true;
+    if(cuEndPending) {
+        // the answer to a pause
+        cuEndPending = false;
+    } else {
+        // the server stopped on its own, they are enabled again
+        cuActive = false;
+    }
+    return true;
+}
+
 //#############################################################################################
 //                                      Encryption
 //#############################################################################################
@@ -35,14 +35,22 @@
 
 #include "Arduino.h"
 
-#if defined(VNC_ZRLE) || defined(VNC_ZLIB)
-#include "miniz.h"
-#endif // #ifdef VNC_ZRLE
+#ifdef VNC_ZSTREAMS
+#include "zstream.h"
+#endif
+
+#ifdef VNC_TIGHT
+#include "tight.h"
+#endif
+
+#ifdef VNC_ZYWRLE
+#include "zywrle.h"
+#endif
 
 #ifdef USE_ARDUINO_TCP
 #ifdef ESP8266
 #include <ESP8266WiFi.h>
-#elif defined(ESP32)
+#elif defined(ESP32) || defined(VNC_HOST_BUILD)
 #include <WiFi.h>
 #else
 #include <UIPEthernet.h>
@@ -58,6 +66,9 @@
 
 #define MAX_ENCODINGS 20
 
+/// most encodings the automatic selection chooses from
+#define VNC_AUTO_CANDIDATES 5
+
 #ifdef WORDS_BIGENDIAN
 #define Swap16IfLE(s) (s)
 #define Swap32IfLE(l) (l)
@@ -66,6 +77,13 @@
 #define Swap32IfLE(l) __builtin_bswap32(l)
 #endif /* WORDS_BIGENDIAN */
 
+/// pixel values as received from the server -> native RGB565
+#ifdef VNC_NATIVE_PIXEL_ORDER
+#define SwapPixel(c) (c)
+#else
+#define SwapPixel(c) Swap16IfLE(c)
+#endif /* VNC_NATIVE_PIXEL_ORDER */
+
 typedef uint8_t     CARD8;
 typedef int8_t      INT8;
 typedef uint16_t    CARD16;
@@ -137,6 +155,37 @@ typedef struct
    unsigned int buttonmask;
 } mousestate_t;
 
+/// measured cost of the FramebufferUpdates, averaged over the last few
+typedef struct
+{
+   uint32_t updates;      // FramebufferUpdates received
+   uint32_t bytes;        // bytes per update
+   uint32_t decodeUs;     // time to decode an update
+   uint32_t presentUs;    // time from the end of an update until the display has shown it
+   uint32_t latencyUs;    // time from an update request to the start of its update
+   int32_t encoding;      // encoding of the last rect with pixels
+} vnc_update_stats_t;
+
+/// cost of one encoding, measured while the server used it
+typedef struct
+{
+   int32_t encoding;
+   uint32_t rects;         // rectangles measured
+   float bytesPerPixel;    // received bytes per pixel, averaged
+   float cpuNsPerPixel;    // decoding time per pixel without waiting for the network, averaged
+} vnc_encoding_cost_t;
+
+/// what the automatic encoding selection measured and decided
+typedef struct
+{
+   int32_t encoding;       // encoding asked for first
+   uint8_t compressLevel;  // 0..9, 99 = not asked for
+   uint8_t quality;        // JPEG and ZYWRLE quality 0..9, 99 = lossless only
+   uint32_t linkKbps;      // received while decoding, only a lower limit when waitPercent is low
+   uint8_t waitPercent;    // part of the decoding time spent waiting for the network
+   uint32_t changes;       // SetEncodings sent by the selection
+} vnc_encoding_choice_t;
+
 
 #include "rfbproto.h"
 
@@ -155,8 +204,10 @@ class VNCdisplay {
         virtual uint32_t getHeight(void) = 0;
         virtual uint32_t getWidth(void) = 0;
 
+        /// data is RGB565 in the negotiated byte order (see VNC_NATIVE_PIXEL_ORDER)
         virtual void draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t *data) = 0;
 
+        /// color is always a native RGB565 value
         virtual void draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color) = 0;
         virtual void copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h) = 0;
 
@@ -164,9 +215,50 @@ class VNCdisplay {
         virtual void area_update_data(char *data, uint32_t pixel) = 0;
         virtual void area_update_end(void) = 0;
 
+        /// JPEG support, Tight only asks for JPEG when the display can decode it
+        virtual bool hasJpeg(void) { return false; };
+
+        /// decode a JPEG image of w * h pixels to x/y, data is only valid during the call
+        virtual bool draw_jpeg(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t *data, size_t len) { return false; };
+
+        /// called before the first and after the last rectangle of a FramebufferUpdate
+        virtual void framebuffer_update_start(void) {};
+        virtual void framebuffer_update_end(void) {};
+
+        /// regions handed on that are not on the panel yet, update requests wait for them
+        virtual uint32_t present_backlog(void) { return 0; };
+
         virtual void vnc_options_override(dfb_vnc_options * opt) {};
 };
 
+#include "offset.h"
+
+#ifdef VNC_SCALING
+#include "scaler.h"
+#endif
+
+#ifdef VNC_VIEWPORT
+#include "frameBuffer.h"
+#include "viewport.h"
+#endif
+
+#ifdef VNC_METRICS
+#include "metrics.h"
+#endif
+
+#ifdef VNC_RECORDER
+/// receives every byte read from the server socket, in stream order
+class VNCrecorder {
+    public:
+        virtual ~VNCrecorder() {}
+
+        /// a new connection starts, the stream begins with the ProtocolVersion
+        virtual void session_start(void) {};
+        virtual void record(const uint8_t *data, size_t len) = 0;
+        virtual void session_end(void) {};
+};
+#endif
+
 class arduinoVNC {
     public:
         arduinoVNC(VNCdisplay * display);
@@ -187,12 +279,48 @@ class arduinoVNC {
 
         int forceFullUpdate(void);
 
+        /// upper limit, requests are also paced by how fast updates are decoded and shown
         void setMaxFPS(uint16_t fps);
+        const vnc_update_stats_t & getUpdateStats(void) { return stats; };
+        /// bytes received since connecting, wraps around
+        uint32_t getReceivedBytes(void) { return rx_total; };
         void mouseEvent(uint16_t x, uint16_t y, uint8_t buttonMask);
         void keyEvent(int key, int keyMask);
 
+        /// server position shown in the top left corner of a desktop larger than the display
         void setOffset(uint16_t x, uint16_t y);
 
+#ifdef VNC_SCALING
+        /// how a desktop larger than the display is shown, takes effect on the next connect
+        void setScaling(vnc_scale_mode_t mode);
+#endif
+
+#ifdef VNC_VIEWPORT
+        /// move the view by dx/dy display pixels, call from the task running loop()
+        bool panViewport(int dx, int dy);
+        /// zoom the view by factor around display position x/y
+        bool zoomViewport(float factor, int x, int y);
+        /// back to the initial view
+        bool resetViewport(void);
+        /// the view shows only a part of the desktop
+        bool canPanViewport(void);
+#endif
+
+#ifdef VNC_AUTO_ENCODING
+        const vnc_encoding_choice_t & getEncodingChoice(void) { return autoChoice; };
+        /// @return NULL if the encoding is not a candidate of the selection
+        const vnc_encoding_cost_t * getEncodingCost(int32_t encoding);
+#endif
+
+#ifdef VNC_RECORDER
+        void setRecorder(VNCrecorder * recorder);
+#endif
+
+#ifdef VNC_METRICS
+        /// counters since connecting
+        VNCmetrics & getMetrics(void) { return metrics; };
+#endif
+
     private:
         bool onlyFullUpdate;
         int port;
@@ -200,8 +328,70 @@ class arduinoVNC {
         String password;
         uint16_t updateDelay;
 
+        /// adaptive pacing of the update requests
+        vnc_update_stats_t stats;
+        bool requestPending;         // the last update request is not answered yet
+        unsigned long requestTime;   // millis() of the last update request
+        unsigned long requestUs;     // micros() of it
+        bool requestEarly;           // sent before the previous update was decoded
+        bool presentPending;         // the display has not shown the last update yet
+        unsigned long presentStart;  // micros() at the end of that update
+
+        bool rfb_update_wanted(void);
+
+#ifdef VNC_METRICS
+        VNCmetrics metrics;
+#endif
+
+#ifdef VNC_AUTO_ENCODING
+        /// automatic encoding selection, candidates are listed in vnc_auto_ladder
+        vnc_encoding_choice_t autoChoice;
+        vnc_encoding_cost_t autoCost[VNC_AUTO_CANDIDATES];
+        unsigned long autoTried[VNC_AUTO_CANDIDATES];   // millis() the candidate was last asked for
+        uint8_t autoStep;             // index of autoChoice.encoding in vnc_auto_ladder
+        uint8_t autoQualityMax;       // quality the configuration asks for
+        unsigned long autoTime;       // millis() of the last decision
+        // measured since the last decision
+        uint32_t autoPixels[VNC_AUTO_CANDIDATES];
+        uint32_t autoBytes[VNC_AUTO_CANDIDATES];
+        uint32_t autoCpuUs[VNC_AUTO_CANDIDATES];
+        uint32_t autoRxBytes;
+        uint32_t autoWallUs;
+        uint32_t autoWaitUs;
+
+        void rfb_auto_reset(void);
+        void rfb_auto_measure(int32_t encoding, uint32_t pixels, uint32_t wallUs, uint32_t bytes, uint32_t waitUs);
+        bool rfb_auto_faster(uint8_t step, float linkBytesPerUs);
+        bool rfb_auto_encoding(void);
+#endif
+
+        /// continuous updates, the server pushes changes and fences pace it
+        bool fenceSupported;     // the server sent a Fence
+        bool cuSupported;        // the server sent EndOfContinuousUpdates
+        bool cuActive;           // enabled, update requests are not polled
+        bool cuPaused;           // disabled until all fences are answered
+        bool cuEndPending;       // the server has not confirmed the pause yet
+        rfbRectangle cuRegion;   // region the updates were enabled for
+        uint32_t fenceSent;      // number of the last frame fence sent
+        uint32_t fenceAcked;     // number of the last one answered
+
 
+        // decoders draw to display in server coordinates, it is panel
+        // or one of the layers below that place the desktop on the panel
         VNCdisplay * display;
+        VNCdisplay * panel;
+        VNCoffset offset;
+#ifdef VNC_SCALING
+        VNCscaler scaler;
+        vnc_scale_mode_t scaleMode;
+#endif
+#ifdef VNC_VIEWPORT
+        VNCviewport viewport;
+        bool rfb_request_exposed(rfbRectangle old);
+#endif
+#ifdef VNC_RECORDER
+        VNCrecorder * recorder;
+#endif
 
         dfb_vnc_options opt;
 
@@ -215,12 +405,85 @@ class arduinoVNC {
 #endif
         /// TCP handling
         void disconnect(void);
+        bool tcp_connected(void);
         bool read_from_rfb_server(int sock, char *out, size_t n);
+        bool rx_fill(size_t n);
+
+        /// receive buffer, filled with large reads from the socket
+        uint8_t * rx_buf;
+        size_t rx_head;   // next byte to hand out
+        size_t rx_tail;   // end of received data
+        uint32_t rx_total;   // bytes received since connecting
+        uint32_t rx_waitUs;  // time spent waiting for the server to send more
+
+        inline uint32_t rx_consumed(void) {
+            return rx_total - (rx_tail - rx_head);
+        }
+
+        inline size_t rx_available(void) {
+            return rx_tail - rx_head;
+        }
+
+        /// small fixed-size reads, values are returned in wire byte order
+        inline bool rx_read8(uint8_t * out) {
+            if(rx_head == rx_tail && !rx_fill(1)) {
+                return false;
+            }
+            *out = rx_buf[rx_head++];
+            return true;
+        }
+
+        inline bool rx_read16(uint16_t * out) {
+            if(rx_available() < 2 && !rx_fill(2)) {
+                return false;
+            }
+            memcpy(out, rx_buf + rx_head, 2);
+            rx_head += 2;
+            return true;
+        }
+
+        inline bool rx_read32(uint32_t * out) {
+            if(rx_available() < 4 && !rx_fill(4)) {
+                return false;
+            }
+            memcpy(out, rx_buf + rx_head, 4);
+            rx_head += 4;
+            return true;
+        }
+
+        /// consume n bytes without copying, the pointer is valid until the next read
+        inline const uint8_t * rx_span(size_t n) {
+            if(rx_available() < n && !rx_fill(n)) {
+                return NULL;
+            }
+            const uint8_t * p = rx_buf + rx_head;
+            rx_head += n;
+            return p;
+        }
+
         bool write_exact(int sock, char *buf, size_t n);
         bool set_non_blocking(int sock);
 
+#ifdef VNC_ZSTREAMS
+        /// consume n inflated bytes of zs without copying, the pointer is valid until the next span
+        inline const uint8_t * zstream_span(vnc_zstream_t * zs, size_t n) {
+            if((size_t) (zs->next - zs->read) < n && !zstream_need(zs, n)) {
+                return NULL;
+            }
+            const uint8_t * p = zs->read;
+            zs->read += n;
+            return p;
+        }
+
+        bool zstream_need(vnc_zstream_t * zs, size_t n);
+        bool zstream_read(vnc_zstream_t * zs, uint8_t * out, size_t n);
+        bool zstream_inflate_more(vnc_zstream_t * zs);
+        bool zstream_finish(vnc_zstream_t * zs);
+#endif
+
 #ifdef VNC_ZRLE
-        bool read_from_z(uint8_t *out, size_t n);
+        void zrle_expand_table(uint8_t bits);
+        bool zrle_tile(vnc_zstream_t * zs, uint8_t subrect_encoding, uint16_t tile_w, uint16_t tile_h);
 #endif // #ifdef VNC_ZRLE
 
         /// Connect to Server
@@ -236,10 +499,19 @@ class arduinoVNC {
         bool _rfb_initialise_server(void);
 
 
+        /// view of the desktop, the same for update requests, decoders and the pointer
+        void rfb_place_desktop(void);
+        rfbRectangle rfb_view(void);
+        void rfb_to_server(int * x, int * y);
+
         bool rfb_set_format_and_encodings();
+        bool rfb_set_encodings();
         bool rfb_set_desktop_size();
         bool rfb_send_update_request(int incremental);
+        bool rfb_send_update_request(int incremental, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
         bool rfb_set_continuous_updates(bool enable);
+        bool rfb_send_fence(uint32_t flags, const uint8_t * data, uint8_t len);
+        bool rfb_pace_continuous_updates(void);
         bool rfb_handle_server_message();
         bool rfb_update_mouse();
         bool rfb_send_key_event(int key, int down_flag);
@@ -258,11 +530,19 @@ class arduinoVNC {
 #ifdef VNC_HEXTILE
         bool _handle_hextile_encoded_message(rfbFramebufferUpdateRectHeader rectheader);
 #endif
+#ifdef VNC_ZLIBHEX
+        bool _handle_zlibhex_encoded_message(rfbFramebufferUpdateRectHeader rectheader);
+#endif
 #ifdef VNC_ZLIB
         bool _handle_zlib_encoded_message(rfbFramebufferUpdateRectHeader rectheader);
 #endif
 #ifdef VNC_ZRLE
         bool _handle_zrle_encoded_message(rfbFramebufferUpdateRectHeader rectheader);
+#endif
+#ifdef VNC_TIGHT
+        bool _handle_tight_encoded_message(rfbFramebufferUpdateRectHeader rectheader);
+        bool _handle_tight_jpeg(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+        void tight_filter_gradient(uint16_t * pixels, uint8_t * prev, uint16_t w, uint16_t rows);
 #endif
         bool _handle_cursor_pos_message(rfbFramebufferUpdateRectHeader rectheader);
 #ifdef VNC_RICH_CURSOR
@@ -270,6 +550,8 @@ class arduinoVNC {
 #endif
 
         bool _handle_server_continuous_updates_message(rfbFramebufferUpdateRectHeader rectheader);
+        bool _handle_server_fence_message(void);
+        bool _handle_end_of_continuous_updates_message(void);
 
         /// Encryption
         void vncRandomBytes(unsigned char *bytes);
@@ -285,7 +567,7 @@ class arduinoVNC {
 #ifdef USE_ARDUINO_TCP
 #ifdef ESP8266
         WiFiClient TCPclient;
-#elif defined(ESP32)
+#elif defined(ESP32) || defined(VNC_HOST_BUILD)
         WiFiClient TCPclient;
 #else
 #ifdef UIPETHERNET_H
@@ -296,37 +578,78 @@ class arduinoVNC {
 #endif
 #endif  // USE_ARDUINO_TCP
 
-#if defined(VNC_ZLIB) || defined(VNC_ZRLE)
-#define ZRLE_INPUT_BUFFER (1024 * 10)
-#define ZRLE_OUTPUT_BUFFER (TINFL_LZ_DICT_SIZE * 2)
-        tinfl_decompressor inflator;
+#ifdef VNC_ZSTREAMS
+        VNCzstreams zstreams;
+
+        // compressed bytes of the current rect not read yet
+        size_t zstream_zlen;
+#endif
 
-        // Input buffer
-        uint8_t *zin;
+#ifdef VNC_ZRLE
+        uint16_t framebuffer[FB_SIZE];
 
-        // Current read position in input buffer
-        uint8_t *zin_next = 0;
+        uint16_t palette[127];
 
-        // Decompression buffer
-        mz_uint8 *zout;
+        // packed palette input byte -> its 8, 4 or 2 pixels, 16 / bits bytes per entry
+        uint64_t zrle_expand[256 * 2];
 
-        // Current write position in output buffer
-        uint8_t *zout_next;
+        // bits and palette the expand table was built for, 0 = not built
+        uint8_t zrle_expand_bits = 0;
+        uint16_t zrle_expand_palette[16];
 #endif
 
-#ifdef VNC_ZRLE
-        uint16_t framebuffer[FB_SIZE];
+#ifdef VNC_ZYWRLE
+        // coefficients of the tile being synthesized
+        vnc_zywrle_t * zywrle;
+
+        // wavelet level of ZYWRLE rects, 0 while ZYWRLE is not asked for
+        uint8_t zywrle_level;
+#endif
+
+#ifdef VNC_HEXTILE
+/// pixels of a row of tiles painted before one draw_area, a multiple of 16
+#ifdef VNC_SAVE_MEMORY
+#define HEXTILE_STRIP_WIDTH 16
+#else
+#define HEXTILE_STRIP_WIDTH 512
+#endif
+        // 16 rows of HEXTILE_STRIP_WIDTH pixels
+        uint16_t * hextile_strip;
 
-        // number of unprocessed bytes in zin
-        size_t bytes_available = 0;
-        
-        // number of unprocessed bytes for current msg
-        size_t msg_bytes_remain = 0;
+#ifdef VNC_ZLIBHEX
+        // stream the current ZlibHex tile is inflated from, NULL while tiles come uncompressed
+        vnc_zstream_t * hextile_zs;
+#endif
 
-        // Next position to read from
-        uint8_t *zout_read = 0;
+        // n bytes of the current tile
+        inline const uint8_t * hextile_span(size_t n) {
+#ifdef VNC_ZLIBHEX
+            if(hextile_zs) {
+                return zstream_span(hextile_zs, n);
+            }
+#endif
+            return rx_span(n);
+        }
 
-        uint16_t palette[127];
+        bool hextile_rect(rfbFramebufferUpdateRectHeader rectheader, bool zlib);
+        bool hextile_tile(uint16_t * tile, uint32_t stride, uint32_t tile_w, uint32_t tile_h, bool zlib, uint16_t * bgColor, uint16_t * fgColor);
+        bool hextile_tile_data(uint16_t * tile, uint32_t stride, uint32_t tile_w, uint32_t tile_h, uint8_t subrect_encoding, uint16_t * bgColor, uint16_t * fgColor);
+#endif
+
+#ifdef VNC_TIGHT
+        // decoded pixels, TIGHT_BUFFER_PIXELS
+        uint16_t * tight_pixels;
+
+        // filter input, TIGHT_DATA_SIZE
+        uint8_t * tight_data;
+
+        // JPEG images larger than the receive buffer
+        uint8_t * tight_jpeg;
+        size_t tight_jpeg_size;
+
+        bool tight_init_buffers(void);
+        bool tight_read_compact_len(size_t * len);
+        bool tight_read(vnc_zstream_t * zs, uint8_t * out, size_t n);
 #endif
 
 };
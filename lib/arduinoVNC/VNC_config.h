@@ -50,15 +50,41 @@
 #define VNC_ZRLE
 #endif
 
-// not implemented
+// Tight needs the miniz.h tinfl API as well, JPEG needs VNCdisplay::draw_jpeg()
 //#define VNC_TIGHT
+
+// Hextile with zlib compressed tiles, needs VNC_HEXTILE
+//#define VNC_ZLIBHEX
+
+// lossy wavelet ZRLE, asked for when the quality is below VNC_ZYWRLE_QUALITY, needs VNC_ZRLE
+//#define VNC_ZYWRLE
+
+// not implemented
 //#define VNC_RICH_CURSOR
 //#define VNC_SEC_TYPE_TIGHT
 
 /// Buffers
 #define VNC_FRAMEBUFFER
 
+// shrink desktops larger than the display instead of cropping them (arduinoVNC::setScaling)
+//#define VNC_SCALING
+
+// cache the whole desktop and show a pannable, zoomable part of it (arduinoVNC::panViewport)
+//#define VNC_VIEWPORT
+
+// choose the preferred encoding and compress/quality level from the measured link and
+// decoder speed instead of the fixed order (arduinoVNC::getEncodingChoice)
+//#define VNC_AUTO_ENCODING
+
+/// Pixel format
+// request RGB565 in CPU byte order, decoders pass pixels through unswapped
+//#define VNC_NATIVE_PIXEL_ORDER
+
 /// Testing
+// pass the received byte stream to a VNCrecorder (arduinoVNC::setRecorder)
+//#define VNC_RECORDER
+// count rects, bytes and decode/display/round trip times (arduinoVNC::getMetrics)
+//#define VNC_METRICS
 //#define FPS_BENCHMARK
 //#define FPS_BENCHMARK_FULL
 
@@ -70,20 +96,92 @@
 // zlib related
 #define VNC_COMPRESS_LEVEL 4
 
+// inflate with the built-in table driven decoder (inflate.cpp) instead of miniz
+//#define VNC_INFLATE_FAST
+// inflate through the zlib API, for builds that link zlib or zlib-ng in compat mode
+//#define VNC_INFLATE_ZLIB
+
+// JPEG quality 0..9 for Tight, leave undefined for lossless only
+//#define VNC_JPEG_QUALITY 6
+
 /// VNC Pseudo-encodes
 //#define SET_DESKTOP_SIZE // Set resolution according to display resolution
 
 #endif /* VNC_USER_SETUP_LOADED */
 
+// the viewport draws through the scaler
+#if defined(VNC_VIEWPORT) && !defined(VNC_SCALING)
+#define VNC_SCALING
+#endif
+
+// ZYWRLE rects are decoded by the ZRLE decoder
+#if defined(VNC_ZYWRLE) && !defined(VNC_ZRLE)
+#define VNC_ZRLE
+#endif
+
+// ZlibHex paints its tiles with the Hextile decoder
+#if defined(VNC_ZLIBHEX) && !defined(VNC_HEXTILE)
+#define VNC_HEXTILE
+#endif
+
+// the zlib based encodings borrow their streams from one VNCzstreams
+#if defined(VNC_ZLIB) || defined(VNC_ZRLE) || defined(VNC_TIGHT) || defined(VNC_ZLIBHEX)
+#define VNC_ZSTREAMS
+#endif
+
 #ifndef VNC_TCP_TIMEOUT
 #define VNC_TCP_TIMEOUT 5000
 #endif
 
+#ifndef VNC_UPDATE_TIMEOUT
+// ms until an unanswered update request is sent again
+#define VNC_UPDATE_TIMEOUT 1000
+#endif
+
+#ifndef VNC_AUTO_ENCODING_INTERVAL
+// ms between two decisions of the automatic encoding selection
+#define VNC_AUTO_ENCODING_INTERVAL 2000
+#endif
+
+#ifndef VNC_AUTO_ENCODING_RETRY
+// ms until an encoding measured as slower than the current one may be tried again
+#define VNC_AUTO_ENCODING_RETRY 30000
+#endif
+
+#ifndef VNC_AUTO_MIN_QUALITY
+// lowest JPEG quality the automatic encoding selection goes down to on a slow link
+#define VNC_AUTO_MIN_QUALITY 2
+#endif
+
+#ifndef VNC_ZYWRLE_QUALITY
+// ZYWRLE is asked for below this quality, 0..2 use wavelet level 3, 3..5 level 2, 6..8 level 1
+#define VNC_ZYWRLE_QUALITY 6
+#endif
+
+#ifndef VNC_FRAMES_IN_FLIGHT
+// continuous updates pause while more frames than this are not confirmed by a fence
+#define VNC_FRAMES_IN_FLIGHT 2
+#endif
+
+#ifndef VNC_ZSTREAM_SRAM_RESERVE
+// internal SRAM that stays free when zlib windows are placed there, further windows go to PSRAM
+#define VNC_ZSTREAM_SRAM_RESERVE (64 * 1024)
+#endif
+
 #ifndef VNC_SAVE_MEMORY
 // 15KB raw input buffer
 #define VNC_RAW_BUFFER 15360
 #endif
 
+#ifndef VNC_RX_BUFFER
+#ifdef VNC_SAVE_MEMORY
+#define VNC_RX_BUFFER 1024
+#else
+// 32KB TCP receive buffer
+#define VNC_RX_BUFFER (32 * 1024)
+#endif
+#endif
+
 /// Memory Options
 #ifdef VNC_ZRLE
 #define FB_SIZE (64 * 64)
@@ -105,6 +203,7 @@
 #define DEBUG_VNC_HEXTILE(...)
 #define DEBUG_VNC_ZLIB(...)
 #define DEBUG_VNC_ZRLE(...)
+#define DEBUG_VNC_TIGHT(...)
 #define DEBUG_VNC_RICH_CURSOR(...)
 
 #ifndef DEBUG_VNC
@@ -127,6 +226,10 @@
 #define DEBUG_VNC_ZRLE(...) DEBUG_VNC(__VA_ARGS__)
 #endif
 
+#ifndef DEBUG_VNC_TIGHT
+#define DEBUG_VNC_TIGHT(...) DEBUG_VNC(__VA_ARGS__)
+#endif
+
 #ifndef DEBUG_VNC_RICH_CURSOR
 #define DEBUG_VNC_RICH_CURSOR(...) DEBUG_VNC( __VA_ARGS__ )
 #endif
@@ -44,7 +44,7 @@ FrameBuffer::~FrameBuffer() {
     freeBuffer();
 }
 
-bool FrameBuffer::begin(uint32_t _w, uint32_t _h) {
+bool FrameBuffer::begin(uint32_t _w, uint32_t _h, bool psram) {
     w = _w;
     h = _h;
 
@@ -58,7 +58,11 @@ bool FrameBuffer::begin(uint32_t _w, uint32_t _h) {
         if((size < newSize)) {
             //DEBUG_VNC("[FrameBuffer::begin] (size < newSize)  realloc... <--------------------------------------\n");
             //delay(10);
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+            uint8_t * newbuffer = (uint8_t *) (psram ? ps_realloc(buffer, newSize) : realloc(buffer, newSize));
+#else
             uint8_t * newbuffer = (uint8_t *) realloc(buffer, newSize);
+#endif
             //DEBUG_VNC("[FrameBuffer::begin] newbuffer: 0x%08X\n", newbuffer);
             if(!newbuffer) {
                 freeBuffer();
@@ -71,7 +75,11 @@ bool FrameBuffer::begin(uint32_t _w, uint32_t _h) {
         return true;
     }
 
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+    buffer = (uint8_t *) (psram ? ps_malloc(newSize) : malloc(newSize));
+#else
     buffer = (uint8_t *) malloc(newSize);
+#endif
     if(buffer) {
         size = newSize;
         return true;
@@ -87,6 +95,13 @@ uint8_t * FrameBuffer::getPtr(void) {
     return buffer;
 }
 
+uint8_t * FrameBuffer::getPtr(uint32_t x, uint32_t y) {
+    if(!buffer) {
+        return 0;
+    }
+    return (uint8_t *) ((uint16_t*)buffer + ((y * w) + x));
+}
+
 void FrameBuffer::freeBuffer(void) {
     if(buffer) {
         //DEBUG_VNC("[FrameBuffer::draw_rect] free: 0x%08X\n", buffer);
@@ -129,3 +144,69 @@ void FrameBuffer::draw_rect(uint32_t x, uint32_t y, uint32_t rw, uint32_t rh, ui
     }
 }
 
+
+/**
+ * clip a rect at x/y against the buffer size
+ * @return false if nothing is left to draw
+ */
+bool FrameBuffer::clip(uint32_t x, uint32_t y, uint32_t * rw, uint32_t * rh) {
+    if(!buffer || x >= w || y >= h) {
+        return false;
+    }
+    if(x + *rw > w) {
+        *rw = w - x;
+    }
+    if(y + *rh > h) {
+        *rh = h - y;
+    }
+    return (*rw && *rh);
+}
+
+/**
+ * copy rw * rh pixels into the buffer, data is packed (stride rw)
+ */
+void FrameBuffer::draw_area(uint32_t x, uint32_t y, uint32_t rw, uint32_t rh, const uint8_t * data) {
+    uint32_t stride = rw * 2;
+    if(!clip(x, y, &rw, &rh)) {
+        return;
+    }
+
+    uint8_t * ptr = getPtr(x, y);
+
+    if(rw == w) {
+        memcpy(ptr, data, rw * rh * 2);
+        return;
+    }
+
+    while(rh--) {
+        memcpy(ptr, data, rw * 2);
+        ptr += w * 2;
+        data += stride;
+    }
+}
+
+/**
+ * move a rect inside the buffer, source and destination may overlap
+ */
+void FrameBuffer::copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t rw, uint32_t rh) {
+    if(!clip(src_x, src_y, &rw, &rh) || !clip(dest_x, dest_y, &rw, &rh)) {
+        return;
+    }
+
+    int32_t step = w * 2;
+    uint8_t * src = getPtr(src_x, src_y);
+    uint8_t * dest = getPtr(dest_x, dest_y);
+
+    // walk bottom up when moving down, so rows are not overwritten before they are read
+    if(dest_y > src_y) {
+        src += (rh - 1) * step;
+        dest += (rh - 1) * step;
+        step = -step;
+    }
+
+    while(rh--) {
+        memmove(dest, src, rw * 2);
+        src += step;
+        dest += step;
+    }
+}
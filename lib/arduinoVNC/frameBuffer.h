@@ -39,15 +39,22 @@ class FrameBuffer {
     public:
         FrameBuffer();
         ~FrameBuffer();
-        bool begin(uint32_t _w, uint32_t _h);
+        bool begin(uint32_t _w, uint32_t _h, bool psram = false);
 
         uint8_t * getPtr(void);
+        uint8_t * getPtr(uint32_t x, uint32_t y);
         void freeBuffer(void);
 
         void draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color);
+        void draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t * data);
+        void copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h);
         uint32_t currentSize() {return size;}
+        uint32_t getWidth() {return w;}
+        uint32_t getHeight() {return h;}
 
     private:
+        bool clip(uint32_t x, uint32_t y, uint32_t * rw, uint32_t * rh);
+
         uint32_t w;
         uint32_t h;
         uint32_t size;
@@ -0,0 +1,689 @@
+/*
+ * @file inflate.cpp
+ *
+ * Table driven inflater for the zlib streams
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "VNC_config.h"
+#include "VNC.h"
+
+#ifdef VNC_INFLATE_FAST
+
+/// where vnc_inflate() continues
+enum {
+    INF_HEADER,     // zlib header
+    INF_TYPE,       // block header
+    INF_STORED,     // length of a stored block
+    INF_COPY,       // data of a stored block
+    INF_TABLE,      // counts of a dynamic block
+    INF_LENLENS,    // code length code lengths
+    INF_CODELENS,   // literal/length and distance code lengths
+    INF_LEN,        // literal/length code
+    INF_LENEXT,     // extra bits of a length
+    INF_DIST,       // distance code
+    INF_DISTEXT,    // extra bits of a distance
+    INF_MATCH,      // copy of a match that did not fit the output
+    INF_CHECK,      // adler32 after the final block
+    INF_DONE,
+    INF_BAD
+};
+
+#define LIT_MASK ((1 << VNC_INFLATE_LIT_BITS) - 1)
+#define DIST_MASK ((1 << VNC_INFLATE_DIST_BITS) - 1)
+
+/// output room the fast loop needs, the longest match
+#define INFLATE_FAST_OUT 258
+
+// literal/length entry: bits of the entry and of its first symbol, kind, up to two symbols
+#define E_BITS(e) ((e) & 15)            // 0: the code is longer than the lookup
+#define E_FIRST(e) (((e) >> 4) & 15)
+#define E_KIND(e) (((e) >> 8) & 3)
+#define E_PAIR 0x400
+#define E_SYM(e) (((e) >> 16) & 0xFF)   // literal, or length symbol - 257
+#define E_SYM2(e) ((e) >> 24)
+
+#define KIND_LITERAL 0
+#define KIND_LENGTH 1
+#define KIND_END 2
+#define KIND_INVALID 3
+
+// basic entry: one symbol and its code length, length 0: longer than the lookup
+#define B_SYM(b) ((b) & 511)
+#define B_LEN(b) ((b) >> 9)
+#define B_ENTRY(sym, len) ((uint16_t) ((sym) | ((len) << 9)))
+#define B_NONE 511
+
+static const uint16_t len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t codelen_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static inline uint64_t inflate_load64(const uint8_t * p) {
+#ifdef WORDS_BIGENDIAN
+    uint64_t v = 0;
+    for(int8_t i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+#else
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+#endif
+}
+
+/**
+ * canonical Huffman code of n code lengths
+ * table resolves codes of up to root bits in one lookup. Longer codes leave a
+ * marker there and are decoded bit by bit from count and symbol.
+ * Entries no code reaches claim root bits, so they are only taken as
+ * invalid once root bits of input are there.
+ * @return false if the lengths oversubscribe the code
+ */
+static bool inflate_build(const uint8_t * lens, uint16_t n, uint16_t * table, uint8_t root, uint16_t * count, uint16_t * symbol) {
+    uint16_t offs[16];
+    uint16_t next[16];
+
+    memset(count, 0, 16 * sizeof(uint16_t));
+    for(uint16_t i = 0; i < n; i++) {
+        count[lens[i]]++;
+    }
+    count[0] = 0;
+
+    int32_t left = 1;
+    for(uint8_t len = 1; len < 16; len++) {
+        left = (left << 1) - count[len];
+        if(left < 0) {
+            return false;
+        }
+    }
+
+    offs[1] = 0;
+    for(uint8_t len = 1; len < 15; len++) {
+        offs[len + 1] = offs[len] + count[len];
+    }
+    for(uint16_t i = 0; i < n; i++) {
+        if(lens[i]) {
+            symbol[offs[lens[i]]++] = i;
+        }
+    }
+
+    for(uint16_t i = 0; i < (1 << root); i++) {
+        table[i] = B_ENTRY(B_NONE, root);
+    }
+
+    uint16_t code = 0;
+    for(uint8_t len = 1; len < 16; len++) {
+        code = (code + count[len - 1]) << 1;
+        next[len] = code;
+    }
+    for(uint16_t i = 0; i < n; i++) {
+        uint8_t len = lens[i];
+        if(!len) {
+            continue;
+        }
+        // deflate sends codes MSB first into an LSB first bit stream
+        uint16_t c = next[len]++;
+        uint16_t rev = 0;
+        for(uint8_t b = 0; b < len; b++) {
+            rev = (rev << 1) | ((c >> b) & 1);
+        }
+        if(len <= root) {
+            for(uint16_t j = rev; j < (1 << root); j += (1 << len)) {
+                table[j] = B_ENTRY(i, len);
+            }
+        } else {
+            table[rev & ((1 << root) - 1)] = B_ENTRY(0, 0);
+        }
+    }
+    return true;
+}
+
+/**
+ * turn the basic literal/length lookup into s->lit, where a literal whose
+ * code leaves room is paired with the literal that follows it
+ */
+static void inflate_lit_table(vnc_inflate_t * s) {
+    for(uint16_t i = 0; i <= LIT_MASK; i++) {
+        uint16_t b = s->basic[i];
+        uint32_t len = B_LEN(b);
+        uint32_t sym = B_SYM(b);
+        uint32_t e;
+
+        if(!len) {
+            e = 0;
+        } else if(sym < 256) {
+            e = len | (len << 4) | (KIND_LITERAL << 8) | (sym << 16);
+            uint16_t b2 = s->basic[i >> len];
+            if(B_LEN(b2) && len + B_LEN(b2) <= VNC_INFLATE_LIT_BITS && B_SYM(b2) < 256) {
+                e = (len + B_LEN(b2)) | (len << 4) | E_PAIR | (sym << 16) | ((uint32_t) B_SYM(b2) << 24);
+            }
+        } else if(sym == 256) {
+            e = len | (len << 4) | (KIND_END << 8);
+        } else if(sym < 286) {
+            e = len | (len << 4) | (KIND_LENGTH << 8) | ((sym - 257) << 16);
+        } else {
+            e = len | (len << 4) | (KIND_INVALID << 8);
+        }
+        s->lit[i] = e;
+    }
+}
+
+static bool inflate_fixed(vnc_inflate_t * s) {
+    uint16_t i = 0;
+    for(; i < 144; i++) {
+        s->lens[i] = 8;
+    }
+    for(; i < 256; i++) {
+        s->lens[i] = 9;
+    }
+    for(; i < 280; i++) {
+        s->lens[i] = 7;
+    }
+    for(; i < 288; i++) {
+        s->lens[i] = 8;
+    }
+    memset(s->lens + 288, 5, 30);
+
+    if(!inflate_build(s->lens, 288, s->basic, VNC_INFLATE_LIT_BITS, s->lcount, s->lsymbol) ||
+       !inflate_build(s->lens + 288, 30, s->dist_table, VNC_INFLATE_DIST_BITS, s->dcount, s->dsymbol)) {
+        return false;
+    }
+    inflate_lit_table(s);
+    return true;
+}
+
+/**
+ * decode a code longer than the lookup bit by bit
+ * @return the symbol, -1 if hold has too few bits, -2 for an invalid code
+ */
+static int inflate_slow_decode(uint64_t hold, uint8_t bits, const uint16_t * count, const uint16_t * symbol, uint8_t * used) {
+    int32_t code = 0;
+    int32_t first = 0;
+    int32_t index = 0;
+    for(uint8_t len = 1; len < 16; len++) {
+        if(len > bits) {
+            return -1;
+        }
+        code |= (hold >> (len - 1)) & 1;
+        if(code - first < count[len]) {
+            *used = len;
+            return symbol[index + code - first];
+        }
+        index += count[len];
+        first = (first + count[len]) << 1;
+        code <<= 1;
+    }
+    return -2;
+}
+
+/**
+ * copy a match of len bytes from dist bytes back in the circular window
+ * Nothing past the match is written: the bytes there are the oldest
+ * history and later matches may still reach them.
+ */
+static inline uint8_t * inflate_copy(uint8_t * out, uint8_t * window, uint32_t dist, uint32_t len) {
+    uint8_t * end = window + VNC_INFLATE_WINDOW;
+    uint8_t * src = out - dist;
+    if(src < window) {
+        src += VNC_INFLATE_WINDOW;
+    }
+
+    // 8 byte copies when every source byte is final before it is read
+    if(len >= 8 && src + len <= end && (src < out ? dist >= 8 : src - out >= 8)) {
+        uint8_t * stop = out + len;
+        const uint8_t * tail = src + len - 8;
+        uint64_t v;
+        while(out + 8 < stop) {
+            memcpy(&v, src, 8);
+            memcpy(out, &v, 8);
+            src += 8;
+            out += 8;
+        }
+        // the last copy overlaps the one before
+        memcpy(&v, tail, 8);
+        memcpy(stop - 8, &v, 8);
+        return stop;
+    }
+
+    if(src == out - 1) {
+        memset(out, *src, len);
+        return out + len;
+    }
+
+    while(len--) {
+        *out++ = *src++;
+        if(src == end) {
+            src = window;
+        }
+    }
+    return out;
+}
+
+/**
+ * the inner loop while 8 input bytes and a whole match of output room are left
+ * One 8 byte load tops the bit buffer up to at least 56 bits, enough for a
+ * whole length/distance pair, so nothing in between checks the input.
+ * @return false on corrupt data
+ */
+static bool inflate_fast(vnc_inflate_t * s, const uint8_t ** pin, const uint8_t * in_end, uint8_t * window, uint8_t ** pout, uint8_t * out_end) {
+    const uint8_t * in = *pin;
+    uint8_t * out = *pout;
+    uint64_t hold = s->hold;
+    uint8_t bits = s->bits;
+    bool ok = true;
+
+    while(in_end - in >= 8 && out_end - out >= INFLATE_FAST_OUT) {
+        // the bits above 56..63 are a part of the next byte, ORed in again by the next load
+        hold |= inflate_load64(in) << bits;
+        in += (63 - bits) >> 3;
+        bits |= 56;
+
+        uint32_t e = s->lit[hold & LIT_MASK];
+        uint32_t sym;
+        if(E_BITS(e)) {
+            hold >>= E_BITS(e);
+            bits -= E_BITS(e);
+            if(E_KIND(e) == KIND_LITERAL) {
+                *out++ = E_SYM(e);
+                if(e & E_PAIR) {
+                    *out++ = E_SYM2(e);
+                }
+                continue;
+            }
+            if(E_KIND(e) == KIND_LENGTH) {
+                sym = E_SYM(e);
+            } else if(E_KIND(e) == KIND_END) {
+                s->mode = s->last ? INF_CHECK : INF_TYPE;
+                break;
+            } else {
+                ok = false;
+                break;
+            }
+        } else {
+            uint8_t used;
+            int r = inflate_slow_decode(hold, bits, s->lcount, s->lsymbol, &used);
+            if(r < 0 || r > 285) {
+                ok = false;
+                break;
+            }
+            hold >>= used;
+            bits -= used;
+            if(r < 256) {
+                *out++ = r;
+                continue;
+            }
+            if(r == 256) {
+                s->mode = s->last ? INF_CHECK : INF_TYPE;
+                break;
+            }
+            sym = r - 257;
+        }
+
+        uint32_t len = len_base[sym] + (uint32_t) (hold & ((1U << len_extra[sym]) - 1));
+        hold >>= len_extra[sym];
+        bits -= len_extra[sym];
+
+        uint16_t d = s->dist_table[hold & DIST_MASK];
+        uint8_t used = B_LEN(d);
+        int dsym = B_SYM(d);
+        if(!used) {
+            dsym = inflate_slow_decode(hold, bits, s->dcount, s->dsymbol, &used);
+        }
+        if(dsym < 0 || dsym >= 30) {
+            ok = false;
+            break;
+        }
+        hold >>= used;
+        bits -= used;
+
+        uint32_t dist = dist_base[dsym] + (uint32_t) (hold & ((1U << dist_extra[dsym]) - 1));
+        hold >>= dist_extra[dsym];
+        bits -= dist_extra[dsym];
+
+        out = inflate_copy(out, window, dist, len);
+    }
+
+    s->hold = hold & ((1ULL << bits) - 1);
+    s->bits = bits;
+    *pin = in;
+    *pout = out;
+    return ok;
+}
+
+void vnc_inflate_init(vnc_inflate_t * s) {
+    s->mode = INF_HEADER;
+    s->last = false;
+    s->hold = 0;
+    s->bits = 0;
+    s->length = 0;
+    s->dist = 0;
+}
+
+#define BITS(n) ((uint32_t) (hold & ((1ULL << (n)) - 1)))
+#define DROPBITS(n) do { hold >>= (n); bits -= (n); } while(0)
+#define PULLBYTE() do { if(in == in_end) { goto leave; } hold |= (uint64_t) *in++ << bits; bits += 8; } while(0)
+#define NEEDBITS(n) do { while(bits < (n)) { PULLBYTE(); } } while(0)
+#define BAD(...) do { DEBUG_VNC(__VA_ARGS__); s->mode = INF_BAD; goto leave; } while(0)
+
+bool vnc_inflate(vnc_inflate_t * s, const uint8_t * in_start, size_t * in_size, uint8_t * window, uint8_t * next, size_t * out_size) {
+    const uint8_t * in = in_start;
+    const uint8_t * in_end = in_start + *in_size;
+    uint8_t * out = next;
+    uint8_t * out_end = next + *out_size;
+    uint64_t hold = s->hold;
+    uint8_t bits = s->bits;
+
+    for(;;) {
+        switch(s->mode) {
+            case INF_HEADER: {
+                NEEDBITS(16);
+                uint32_t cmf = BITS(8);
+                uint32_t flg = (hold >> 8) & 0xFF;
+                if((cmf & 15) != 8 || (cmf >> 4) > 7 || ((cmf << 8) | flg) % 31 || (flg & 0x20)) {
+                    BAD("[vnc_inflate] bad zlib header\n");
+                }
+                DROPBITS(16);
+                s->mode = INF_TYPE;
+                break;
+            }
+
+            case INF_TYPE: {
+                NEEDBITS(3);
+                s->last = BITS(1);
+                uint8_t type = (hold >> 1) & 3;
+                DROPBITS(3);
+                if(type == 0) {
+                    s->mode = INF_STORED;
+                } else if(type == 1) {
+                    if(!inflate_fixed(s)) {
+                        BAD("[vnc_inflate] fixed tables failed\n");
+                    }
+                    s->mode = INF_LEN;
+                } else if(type == 2) {
+                    s->mode = INF_TABLE;
+                } else {
+                    BAD("[vnc_inflate] bad block type\n");
+                }
+                break;
+            }
+
+            case INF_STORED:
+                DROPBITS(bits & 7);
+                NEEDBITS(32);
+                if((BITS(16) ^ (uint32_t) ((hold >> 16) & 0xFFFF)) != 0xFFFF) {
+                    BAD("[vnc_inflate] bad stored block length\n");
+                }
+                s->length = BITS(16);
+                DROPBITS(32);
+                s->mode = INF_COPY;
+                break;
+
+            case INF_COPY:
+                while(s->length && bits >= 8) {
+                    if(out == out_end) {
+                        goto leave;
+                    }
+                    *out++ = BITS(8);
+                    DROPBITS(8);
+                    s->length--;
+                }
+                while(s->length) {
+                    size_t n = min((size_t) s->length, min((size_t) (in_end - in), (size_t) (out_end - out)));
+                    if(!n) {
+                        goto leave;
+                    }
+                    memcpy(out, in, n);
+                    in += n;
+                    out += n;
+                    s->length -= n;
+                }
+                s->mode = s->last ? INF_CHECK : INF_TYPE;
+                break;
+
+            case INF_TABLE:
+                NEEDBITS(14);
+                s->nlen = BITS(5) + 257;
+                s->ndist = ((hold >> 5) & 31) + 1;
+                s->ncode = ((hold >> 10) & 15) + 4;
+                DROPBITS(14);
+                if(s->nlen > 286 || s->ndist > 30) {
+                    BAD("[vnc_inflate] too many length or distance codes\n");
+                }
+                s->have = 0;
+                s->mode = INF_LENLENS;
+                break;
+
+            case INF_LENLENS:
+                while(s->have < s->ncode) {
+                    NEEDBITS(3);
+                    s->lens[codelen_order[s->have++]] = BITS(3);
+                    DROPBITS(3);
+                }
+                while(s->have < 19) {
+                    s->lens[codelen_order[s->have++]] = 0;
+                }
+                // the code length codes are at most 7 bits, the lookup has all of them
+                if(!inflate_build(s->lens, 19, s->basic, 7, s->lcount, s->lsymbol)) {
+                    BAD("[vnc_inflate] bad code length code\n");
+                }
+                s->have = 0;
+                s->mode = INF_CODELENS;
+                break;
+
+            case INF_CODELENS:
+                while(s->have < s->nlen + s->ndist) {
+                    uint16_t b = s->basic[BITS(7)];
+                    uint8_t len = B_LEN(b);
+                    uint16_t sym = B_SYM(b);
+                    if(len > bits) {
+                        PULLBYTE();
+                        continue;
+                    }
+                    if(sym < 16) {
+                        DROPBITS(len);
+                        s->lens[s->have++] = sym;
+                        continue;
+                    }
+                    if(sym > 18) {
+                        BAD("[vnc_inflate] bad code length\n");
+                    }
+
+                    uint8_t eb = (sym == 16) ? 2 : (sym == 17) ? 3 : 7;
+                    NEEDBITS(len + eb);
+                    DROPBITS(len);
+                    uint8_t val = 0;
+                    uint16_t rep;
+                    if(sym == 16) {
+                        if(!s->have) {
+                            BAD("[vnc_inflate] repeat without a length\n");
+                        }
+                        val = s->lens[s->have - 1];
+                        rep = 3 + BITS(2);
+                    } else if(sym == 17) {
+                        rep = 3 + BITS(3);
+                    } else {
+                        rep = 11 + BITS(7);
+                    }
+                    DROPBITS(eb);
+                    if(s->have + rep > s->nlen + s->ndist) {
+                        BAD("[vnc_inflate] code lengths overflow\n");
+                    }
+                    while(rep--) {
+                        s->lens[s->have++] = val;
+                    }
+                }
+                if(!s->lens[256] ||
+                   !inflate_build(s->lens, s->nlen, s->basic, VNC_INFLATE_LIT_BITS, s->lcount, s->lsymbol) ||
+                   !inflate_build(s->lens + s->nlen, s->ndist, s->dist_table, VNC_INFLATE_DIST_BITS, s->dcount, s->dsymbol)) {
+                    BAD("[vnc_inflate] bad literal/length or distance code\n");
+                }
+                inflate_lit_table(s);
+                s->mode = INF_LEN;
+                break;
+
+            case INF_LEN: {
+                if(in_end - in >= 8 && out_end - out >= INFLATE_FAST_OUT) {
+                    s->hold = hold;
+                    s->bits = bits;
+                    if(!inflate_fast(s, &in, in_end, window, &out, out_end)) {
+                        BAD("[vnc_inflate] bad code\n");
+                    }
+                    hold = s->hold;
+                    bits = s->bits;
+                    break;
+                }
+                if(out == out_end) {
+                    goto leave;
+                }
+
+                // one symbol at a time, a pair entry only gives its first literal here
+                uint32_t e = s->lit[BITS(VNC_INFLATE_LIT_BITS)];
+                uint8_t used;
+                int sym;
+                if(E_BITS(e)) {
+                    used = E_FIRST(e);
+                    if(used > bits) {
+                        PULLBYTE();
+                        break;
+                    }
+                    switch(E_KIND(e)) {
+                        case KIND_LITERAL: sym = E_SYM(e); break;
+                        case KIND_LENGTH: sym = E_SYM(e) + 257; break;
+                        case KIND_END: sym = 256; break;
+                        default: sym = -2; break;
+                    }
+                } else {
+                    sym = inflate_slow_decode(hold, bits, s->lcount, s->lsymbol, &used);
+                    if(sym == -1) {
+                        PULLBYTE();
+                        break;
+                    }
+                }
+                if(sym < 0 || sym > 285) {
+                    BAD("[vnc_inflate] bad literal/length code\n");
+                }
+                DROPBITS(used);
+
+                if(sym < 256) {
+                    *out++ = sym;
+                } else if(sym == 256) {
+                    s->mode = s->last ? INF_CHECK : INF_TYPE;
+                } else {
+                    s->length = len_base[sym - 257];
+                    s->extra = len_extra[sym - 257];
+                    s->mode = INF_LENEXT;
+                }
+                break;
+            }
+
+            case INF_LENEXT:
+                NEEDBITS(s->extra);
+                s->length += BITS(s->extra);
+                DROPBITS(s->extra);
+                s->mode = INF_DIST;
+                break;
+
+            case INF_DIST: {
+                uint16_t d = s->dist_table[BITS(VNC_INFLATE_DIST_BITS)];
+                uint8_t used = B_LEN(d);
+                int sym = B_SYM(d);
+                if(used) {
+                    if(used > bits) {
+                        PULLBYTE();
+                        break;
+                    }
+                } else {
+                    sym = inflate_slow_decode(hold, bits, s->dcount, s->dsymbol, &used);
+                    if(sym == -1) {
+                        PULLBYTE();
+                        break;
+                    }
+                }
+                if(sym < 0 || sym >= 30) {
+                    BAD("[vnc_inflate] bad distance code\n");
+                }
+                DROPBITS(used);
+                s->dist = dist_base[sym];
+                s->extra = dist_extra[sym];
+                s->mode = INF_DISTEXT;
+                break;
+            }
+
+            case INF_DISTEXT:
+                NEEDBITS(s->extra);
+                s->dist += BITS(s->extra);
+                DROPBITS(s->extra);
+                s->mode = INF_MATCH;
+                break;
+
+            case INF_MATCH: {
+                size_t n = min((size_t) s->length, (size_t) (out_end - out));
+                if(!n) {
+                    goto leave;
+                }
+                out = inflate_copy(out, window, s->dist, n);
+                s->length -= n;
+                if(!s->length) {
+                    s->mode = INF_LEN;
+                }
+                break;
+            }
+
+            case INF_CHECK:
+                // the adler32 is not verified, the window would need a second pass
+                DROPBITS(bits & 7);
+                NEEDBITS(32);
+                DROPBITS(32);
+                s->mode = INF_DONE;
+                break;
+
+            case INF_DONE:
+                goto leave;
+
+            default:
+                goto leave;
+        }
+    }
+
+leave:
+    s->hold = hold;
+    s->bits = bits;
+    *in_size = in - in_start;
+    *out_size = out - next;
+    return s->mode != INF_BAD;
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * @file inflate.h
+ *
+ * Table driven inflater for the zlib streams
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef VNC_INFLATE_H_
+#define VNC_INFLATE_H_
+
+/// history of deflate, also the size of the circular output window
+#define VNC_INFLATE_WINDOW 32768
+
+/// bits resolved by one lookup in the literal/length and distance tables
+#define VNC_INFLATE_LIT_BITS 10
+#define VNC_INFLATE_DIST_BITS 8
+
+/// state of one zlib stream, resumable at any input or output boundary
+typedef struct {
+    uint8_t mode;           // where vnc_inflate() continues
+    bool last;              // the current block is the final one
+    uint8_t bits;           // valid bits in hold
+    uint64_t hold;          // input bits, LSB first
+    uint32_t length;        // stored bytes or match bytes left
+    uint32_t dist;          // distance of the current match
+    uint8_t extra;          // extra bits of the current length or distance
+    uint16_t nlen, ndist, ncode, have;   // dynamic block header
+
+    uint8_t lens[320];      // code lengths of the current block
+    uint32_t lit[1 << VNC_INFLATE_LIT_BITS];     // literal/length lookup, up to two literals per entry
+    uint16_t dist_table[1 << VNC_INFLATE_DIST_BITS];
+    uint16_t basic[1 << VNC_INFLATE_LIT_BITS];   // code length codes, then one symbol per entry for lit
+    uint16_t lcount[16], lsymbol[288];          // canonical codes longer than the lookup
+    uint16_t dcount[16], dsymbol[32];
+} vnc_inflate_t;
+
+void vnc_inflate_init(vnc_inflate_t * s);
+
+/**
+ * inflate a zlib stream into the circular window that starts at window
+ * works like tinfl_decompress() with TINFL_FLAG_HAS_MORE_INPUT and
+ * TINFL_FLAG_PARSE_ZLIB_HEADER: output goes to [next, next + *out_size),
+ * matches may reach back into the whole window
+ * @param in_size bytes available at in, returns the bytes consumed
+ * @param out_size room at next, returns the bytes produced
+ * @return false on corrupt data
+ */
+bool vnc_inflate(vnc_inflate_t * s, const uint8_t * in, size_t * in_size, uint8_t * window, uint8_t * next, size_t * out_size);
+
+#endif /* VNC_INFLATE_H_ */
@@ -0,0 +1,152 @@
+/*
+ * @file metrics.cpp
+ *
+ * Counters and timing histograms of a VNC session
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "VNC_config.h"
+#include "VNC.h"
+
+#ifdef VNC_METRICS
+
+/// slot shared by the encodings that did not get one of their own
+#define VNC_METRICS_OTHER 0x7FFFFFFF
+
+VNCmetrics::VNCmetrics() {
+    reset();
+}
+
+void VNCmetrics::reset(void) {
+    encodingCount = 0;
+    memset(perEncoding, 0, sizeof(perEncoding));
+    updates = 0;
+    updateBytes = 0;
+    inflatedBytes = 0;
+    inflateUs = 0;
+    updateTime = { 0 };
+    presentTime = { 0 };
+    latencyTime = { 0 };
+}
+
+void VNCmetrics::add(vnc_histogram_t * h, uint32_t us) {
+    uint8_t b = 0;
+    while(b < VNC_METRICS_BUCKETS - 1 && us >= (16UL << b)) {
+        b++;
+    }
+    h->bucket[b]++;
+    h->count++;
+    h->totalUs += us;
+    h->maxUs = max(h->maxUs, us);
+}
+
+void VNCmetrics::rect(int32_t encoding, uint32_t pixels, uint32_t bytes, uint32_t us) {
+    vnc_encoding_metrics_t * e = NULL;
+
+    for(uint8_t i = 0; i < encodingCount; i++) {
+        if(perEncoding[i].encoding == encoding) {
+            e = &perEncoding[i];
+            break;
+        }
+    }
+    if(!e) {
+        if(encodingCount < VNC_METRICS_ENCODINGS - 1) {
+            e = &perEncoding[encodingCount++];
+            e->encoding = encoding;
+        } else {
+            e = &perEncoding[VNC_METRICS_ENCODINGS - 1];
+            e->encoding = VNC_METRICS_OTHER;
+            encodingCount = VNC_METRICS_ENCODINGS;
+        }
+    }
+
+    e->rects++;
+    e->pixels += pixels;
+    e->bytes += bytes;
+    add(&e->decode, us);
+}
+
+void VNCmetrics::update(uint32_t bytes, uint32_t us) {
+    updates++;
+    updateBytes += bytes;
+    add(&updateTime, us);
+}
+
+const vnc_encoding_metrics_t * VNCmetrics::find(int32_t encoding) {
+    for(uint8_t i = 0; i < encodingCount; i++) {
+        if(perEncoding[i].encoding == encoding) {
+            return &perEncoding[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t VNCmetrics::percentile(const vnc_histogram_t & h, uint8_t pct) {
+    if(!h.count) {
+        return 0;
+    }
+
+    uint32_t want = ((uint64_t) h.count * pct + 99) / 100;
+    uint32_t seen = 0;
+    for(uint8_t b = 0; b < VNC_METRICS_BUCKETS - 1; b++) {
+        seen += h.bucket[b];
+        if(seen >= want) {
+            return min((uint32_t) (16UL << b), h.maxUs);
+        }
+    }
+    return h.maxUs;
+}
+
+void VNCmetrics::format(char * buf, size_t len, const char * name, const vnc_histogram_t & h) {
+    snprintf(buf, len, "%s n=%u avg=%u p50=%u p90=%u p99=%u max=%u", name, (unsigned) h.count,
+             h.count ? (unsigned) (h.totalUs / h.count) : 0u,
+             (unsigned) percentile(h, 50), (unsigned) percentile(h, 90), (unsigned) percentile(h, 99), (unsigned) h.maxUs);
+}
+
+void VNCmetrics::dump(vnc_metrics_line_t line) {
+    char buf[160];
+    char hist[96];
+
+    for(uint8_t i = 0; i < encodingCount; i++) {
+        const vnc_encoding_metrics_t & e = perEncoding[i];
+        format(hist, sizeof(hist), "us", e.decode);
+        snprintf(buf, sizeof(buf), "[metrics] enc=%d rects=%u px=%llu bytes=%llu %s", (int) e.encoding, (unsigned) e.rects,
+                 (unsigned long long) e.pixels, (unsigned long long) e.bytes, hist);
+        line(buf);
+    }
+
+    format(hist, sizeof(hist), "us", updateTime);
+    snprintf(buf, sizeof(buf), "[metrics] update bytes=%llu %s", (unsigned long long) updateBytes, hist);
+    line(buf);
+
+    snprintf(buf, sizeof(buf), "[metrics] inflate bytes=%llu us=%llu MB/s=%.1f",
+             (unsigned long long) inflatedBytes, (unsigned long long) inflateUs,
+             inflateUs ? (double) inflatedBytes / inflateUs : 0.0);
+    line(buf);
+
+    format(hist, sizeof(hist), "us", presentTime);
+    snprintf(buf, sizeof(buf), "[metrics] present %s", hist);
+    line(buf);
+
+    format(hist, sizeof(hist), "us", latencyTime);
+    snprintf(buf, sizeof(buf), "[metrics] latency %s", hist);
+    line(buf);
+}
+
+#endif
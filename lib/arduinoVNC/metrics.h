@@ -0,0 +1,113 @@
+/*
+ * @file metrics.h
+ *
+ * Counters and timing histograms of a VNC session
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef VNC_METRICS_H_
+#define VNC_METRICS_H_
+
+/// histogram buckets, bucket i counts times below 16us << i, the last one the rest
+#define VNC_METRICS_BUCKETS 16
+
+/// encodings counted separately, further ones share the last slot (encoding 0x7FFFFFFF)
+#define VNC_METRICS_ENCODINGS 12
+
+typedef struct
+{
+   uint32_t count;
+   uint64_t totalUs;
+   uint32_t maxUs;
+   uint32_t bucket[VNC_METRICS_BUCKETS];
+} vnc_histogram_t;
+
+typedef struct
+{
+   int32_t encoding;
+   uint32_t rects;
+   uint64_t pixels;
+   uint64_t bytes;        // received, including the rect header
+   vnc_histogram_t decode;
+} vnc_encoding_metrics_t;
+
+/// receives one line of dump(), without line end
+typedef void (*vnc_metrics_line_t)(const char * line);
+
+/**
+ * Where the time of a session goes: rects and bytes per encoding, decode
+ * times, inflated bytes, display and round trip times.
+ *
+ * Recording only adds to counters, the arrays are fixed. Not thread safe,
+ * query it from the task that runs arduinoVNC::loop().
+ */
+class VNCmetrics {
+    public:
+        VNCmetrics();
+
+        void reset(void);
+
+        /// one decoded rect
+        void rect(int32_t encoding, uint32_t pixels, uint32_t bytes, uint32_t us);
+        /// one whole FramebufferUpdate
+        void update(uint32_t bytes, uint32_t us);
+        /// bytes produced by the inflater in us
+        void inflated(uint32_t bytes, uint32_t us) { inflatedBytes += bytes; inflateUs += us; };
+        /// end of an update until the display has shown it
+        void present(uint32_t us) { add(&presentTime, us); };
+        /// update request until its update starts
+        void latency(uint32_t us) { add(&latencyTime, us); };
+
+        uint8_t encodings(void) { return encodingCount; };
+        const vnc_encoding_metrics_t & encoding(uint8_t i) { return perEncoding[i]; };
+        /// @return NULL if the encoding has not been received
+        const vnc_encoding_metrics_t * find(int32_t encoding);
+
+        uint32_t getUpdates(void) { return updates; };
+        uint64_t getBytes(void) { return updateBytes; };
+        uint64_t getInflated(void) { return inflatedBytes; };
+        /// time spent in the inflater, inflated bytes per us are MB/s
+        uint64_t getInflateUs(void) { return inflateUs; };
+        const vnc_histogram_t & getDecode(void) { return updateTime; };
+        const vnc_histogram_t & getPresent(void) { return presentTime; };
+        const vnc_histogram_t & getLatency(void) { return latencyTime; };
+
+        /// upper limit of the bucket holding the pct percentile, 0 without samples
+        static uint32_t percentile(const vnc_histogram_t & h, uint8_t pct);
+
+        /// compact lines, one per encoding and one per histogram
+        void dump(vnc_metrics_line_t line);
+
+    private:
+        uint8_t encodingCount;
+        vnc_encoding_metrics_t perEncoding[VNC_METRICS_ENCODINGS];
+
+        uint32_t updates;
+        uint64_t updateBytes;
+        uint64_t inflatedBytes;
+        uint64_t inflateUs;
+        vnc_histogram_t updateTime;
+        vnc_histogram_t presentTime;
+        vnc_histogram_t latencyTime;
+
+        static void add(vnc_histogram_t * h, uint32_t us);
+        static void format(char * buf, size_t len, const char * name, const vnc_histogram_t & h);
+};
+
+#endif /* VNC_METRICS_H_ */
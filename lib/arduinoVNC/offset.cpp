@@ -0,0 +1,197 @@
+/*
+ * @file offset.cpp
+ *
+ * Remote desktop shown at 1:1 somewhere else than the top left corner
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "VNC_config.h"
+#include "VNC.h"
+
+VNCoffset::VNCoffset() {
+    display = NULL;
+    src_w = src_h = 0;
+    off_x = off_y = 0;
+    vis_x = vis_y = vis_w = vis_h = 0;
+    area_x = area_y = area_w = area_h = 0;
+    area_col = area_row = 0;
+    area_vis = { 0 };
+}
+
+void VNCoffset::begin(VNCdisplay * _display, uint32_t server_w, uint32_t server_h, int32_t x, int32_t y) {
+    display = _display;
+    src_w = server_w;
+    src_h = server_h;
+    off_x = x;
+    off_y = y;
+
+    int32_t x0 = max(off_x, (int32_t) 0);
+    int32_t y0 = max(off_y, (int32_t) 0);
+    int32_t x1 = min(off_x + (int32_t) display->getWidth(), (int32_t) src_w);
+    int32_t y1 = min(off_y + (int32_t) display->getHeight(), (int32_t) src_h);
+
+    if(x1 <= x0 || y1 <= y0) {
+        vis_x = vis_y = vis_w = vis_h = 0;
+        return;
+    }
+    vis_x = x0;
+    vis_y = y0;
+    vis_w = x1 - x0;
+    vis_h = y1 - y0;
+}
+
+rfbRectangle VNCoffset::visible(void) {
+    rfbRectangle r;
+    r.x = vis_x;
+    r.y = vis_y;
+    r.w = vis_w;
+    r.h = vis_h;
+    return r;
+}
+
+bool VNCoffset::clip(uint32_t * x, uint32_t * y, uint32_t * w, uint32_t * h) {
+    uint32_t x0 = max(*x, vis_x);
+    uint32_t y0 = max(*y, vis_y);
+    uint32_t x1 = min(*x + *w, vis_x + vis_w);
+    uint32_t y1 = min(*y + *h, vis_y + vis_h);
+
+    if(x1 <= x0 || y1 <= y0) {
+        return false;
+    }
+    *x = x0;
+    *y = y0;
+    *w = x1 - x0;
+    *h = y1 - y0;
+    return true;
+}
+
+void VNCoffset::draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t *data) {
+    uint32_t cx = x, cy = y, cw = w, ch = h;
+    if(!clip(&cx, &cy, &cw, &ch)) {
+        return;
+    }
+
+    uint8_t * p = data + ((cy - y) * w + (cx - x)) * 2;
+    if(cw == w) {
+        display->draw_area(cx - off_x, cy - off_y, cw, ch, p);
+        return;
+    }
+    // rows are no longer contiguous
+    for(uint32_t row = 0; row < ch; row++) {
+        display->draw_area(cx - off_x, cy - off_y + row, cw, 1, p + row * w * 2);
+    }
+}
+
+void VNCoffset::draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color) {
+    if(clip(&x, &y, &w, &h)) {
+        display->draw_rect(x - off_x, y - off_y, w, h, color);
+    }
+}
+
+void VNCoffset::copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h) {
+    // only advertised while the whole desktop is visible, clip in case the view moved since
+    uint32_t x = src_x, y = src_y;
+    if(!clip(&x, &y, &w, &h)) {
+        return;
+    }
+    dest_x += x - src_x;
+    dest_y += y - src_y;
+
+    uint32_t dx = dest_x, dy = dest_y;
+    if(!clip(&dx, &dy, &w, &h)) {
+        return;
+    }
+    x += dx - dest_x;
+    y += dy - dest_y;
+
+    display->copy_rect(x - off_x, y - off_y, dx - off_x, dy - off_y, w, h);
+}
+
+bool VNCoffset::draw_jpeg(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t *data, size_t len) {
+    uint32_t cx = x, cy = y, cw = w, ch = h;
+    if(!clip(&cx, &cy, &cw, &ch)) {
+        return true;
+    }
+    if(cw != w || ch != h) {
+        // sent before the view moved, the next update repaints it
+        DEBUG_VNC("[VNCoffset::draw_jpeg] dropped a partly visible JPEG\n");
+        return true;
+    }
+    return display->draw_jpeg(x - off_x, y - off_y, w, h, data, len);
+}
+
+void VNCoffset::area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    area_x = x;
+    area_y = y;
+    area_w = w;
+    area_h = h;
+    area_col = 0;
+    area_row = 0;
+
+    uint32_t cx = x, cy = y, cw = w, ch = h;
+    if(!clip(&cx, &cy, &cw, &ch)) {
+        area_vis = { 0 };
+        return;
+    }
+    area_vis.x = cx;
+    area_vis.y = cy;
+    area_vis.w = cw;
+    area_vis.h = ch;
+    display->area_update_start(cx - off_x, cy - off_y, cw, ch);
+}
+
+void VNCoffset::area_update_data(char *data, uint32_t pixel) {
+    if(!area_vis.w) {
+        return;
+    }
+    if(area_vis.w == area_w && area_vis.h == area_h) {
+        display->area_update_data(data, pixel);
+        return;
+    }
+
+    // pass on the visible part of every row
+    uint32_t vx0 = area_vis.x - area_x;
+    uint32_t vx1 = vx0 + area_vis.w;
+    uint32_t vy0 = area_vis.y - area_y;
+    uint32_t vy1 = vy0 + area_vis.h;
+
+    while(pixel && area_row < area_h) {
+        uint32_t span = min(pixel, area_w - area_col);
+        if(area_row >= vy0 && area_row < vy1) {
+            uint32_t c0 = max(area_col, vx0);
+            uint32_t c1 = min(area_col + span, vx1);
+            if(c1 > c0) {
+                display->area_update_data(data + (c0 - area_col) * 2, c1 - c0);
+            }
+        }
+        data += span * 2;
+        pixel -= span;
+        area_col += span;
+        if(area_col == area_w) {
+            area_col = 0;
+            area_row++;
+        }
+    }
+}
+
+void VNCoffset::area_update_end(void) {
+    if(area_vis.w) {
+        display->area_update_end();
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ * @file offset.h
+ *
+ * Remote desktop shown at 1:1 somewhere else than the top left corner
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef VNC_OFFSET_H_
+#define VNC_OFFSET_H_
+
+/**
+ * VNCdisplay that moves everything drawn in server coordinates by an
+ * offset and clips it to the display. Server position off_x/off_y is
+ * drawn in the top left corner, a negative offset centers a desktop
+ * smaller than the display.
+ *
+ * CopyRect and JPEG are only passed on while the whole desktop is
+ * visible, a copy from outside the display has no pixels to copy and a
+ * JPEG can not be clipped.
+ */
+class VNCoffset : public VNCdisplay {
+    public:
+        VNCoffset();
+
+        void begin(VNCdisplay * display, uint32_t server_w, uint32_t server_h, int32_t off_x, int32_t off_y);
+
+        /// part of the desktop on the display
+        rfbRectangle visible(void);
+
+        /// display position -> server position
+        void to_server(int * x, int * y) { *x += off_x; *y += off_y; };
+
+        /// the decoders work in server coordinates
+        uint32_t getWidth(void) { return src_w; };
+        uint32_t getHeight(void) { return src_h; };
+
+        bool hasCopyRect(void) { return whole() && display->hasCopyRect(); };
+        bool hasJpeg(void) { return whole() && display->hasJpeg(); };
+
+        void draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t *data);
+        void draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color);
+        void copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h);
+        bool draw_jpeg(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t *data, size_t len);
+
+        void area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+        void area_update_data(char *data, uint32_t pixel);
+        void area_update_end(void);
+
+        void framebuffer_update_start(void) { display->framebuffer_update_start(); };
+        void framebuffer_update_end(void) { display->framebuffer_update_end(); };
+        uint32_t present_backlog(void) { return display->present_backlog(); };
+
+    private:
+        VNCdisplay * display;
+
+        uint32_t src_w, src_h;      // desktop size
+        int32_t off_x, off_y;       // server position of the top left display pixel
+        uint32_t vis_x, vis_y;      // part of the desktop on the display
+        uint32_t vis_w, vis_h;
+
+        // area update in progress and its visible part
+        uint32_t area_x, area_y, area_w, area_h;
+        uint32_t area_col, area_row;
+        rfbRectangle area_vis;
+
+        bool whole(void) { return vis_w == src_w && vis_h == src_h; };
+
+        /// clip a rect to the visible part, @return false if nothing is left
+        bool clip(uint32_t * x, uint32_t * y, uint32_t * w, uint32_t * h);
+};
+
+#endif /* VNC_OFFSET_H_ */
@@ -858,7 +858,9 @@ typedef struct _rfbZlibHeader {
 #define rfbTightFilterPalette          0x01
 #define rfbTightFilterGradient         0x02
 
+#endif
 
+#ifdef VNC_ZLIBHEX
 /*- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
  * ZLIBHEX - zlib compressed Hextile Encoding.  Essentially, this is the
  * hextile encoding with zlib compression on the tiles that can not be
@@ -0,0 +1,375 @@
+/*
+ * @file scaler.cpp
+ *
+ * Client side scaling of a remote desktop larger than the display
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "VNC_config.h"
+#include "VNC.h"
+
+#ifdef VNC_SCALING
+
+/// box averages at most this many source pixels per axis, 5 * 5 sums fit the spread format
+#define SCALER_BOX_MAX 5
+
+/// RGB565 with gaps between the components, sums of up to 32 pixels do not overflow
+static inline uint32_t spread565(uint16_t c) {
+    return (c | ((uint32_t) c << 16)) & 0x07E0F81F;
+}
+
+static inline uint16_t pack565(uint32_t v) {
+    v &= 0x07E0F81F;
+    return (uint16_t) (v | (v >> 16));
+}
+
+/// blend two spread pixels, w is the weight of b in 1/32
+static inline uint32_t blend565(uint32_t a, uint32_t b, uint32_t w) {
+    return ((a * (32 - w) + b * w) >> 5) & 0x07E0F81F;
+}
+
+static void * scaler_alloc(size_t size) {
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+    return ps_malloc(size);
+#else
+    return malloc(size);
+#endif
+}
+
+VNCscaler::VNCscaler() {
+    display = NULL;
+    mode = VNC_SCALE_NONE;
+    src_w = src_h = 0;
+    win_x = win_y = win_w = win_h = 0;
+    dst_w = dst_h = 0;
+    off_x = off_y = 0;
+    col_src = row_src = NULL;
+    col_arg = row_arg = NULL;
+    out = NULL;
+    band = NULL;
+    band_x = band_y = band_w = band_h = 0;
+    band_row = band_fill = 0;
+
+    recip[0] = 0;
+    for(uint32_t n = 1; n < 256; n++) {
+        recip[n] = (65536 + n - 1) / n;
+    }
+}
+
+VNCscaler::~VNCscaler() {
+    end();
+}
+
+bool VNCscaler::begin(VNCdisplay * _display, uint32_t server_w, uint32_t server_h, vnc_scale_mode_t _mode) {
+    end();
+
+    if(_mode == VNC_SCALE_NONE || !_display || !server_w || !server_h) {
+        return false;
+    }
+
+    uint32_t cw = _display->getWidth();
+    uint32_t ch = _display->getHeight();
+
+    // the tables hold one entry per display column / row
+    col_src = (uint16_t *) malloc(cw * sizeof(uint16_t));
+    col_arg = (uint8_t *) malloc(cw);
+    row_src = (uint16_t *) malloc(ch * sizeof(uint16_t));
+    row_arg = (uint8_t *) malloc(ch);
+    out = (uint16_t *) malloc(max((uint32_t) SCALER_BUFFER_PIXELS, cw) * sizeof(uint16_t));
+
+    if(!col_src || !col_arg || !row_src || !row_arg || !out) {
+        DEBUG_VNC("[VNCscaler::begin] no memory for a %dx%d display\n", cw, ch);
+        end();
+        return false;
+    }
+
+    display = _display;
+    mode = _mode;
+    src_w = server_w;
+    src_h = server_h;
+
+    // fit the longer side, keep the aspect ratio, never magnify
+    uint32_t dw = src_w;
+    uint32_t dh = src_h;
+    if(src_w > cw || src_h > ch) {
+        if(src_w * ch > src_h * cw) {
+            dw = cw;
+            dh = max((uint32_t) 1, src_h * cw / src_w);
+        } else {
+            dh = ch;
+            dw = max((uint32_t) 1, src_w * ch / src_h);
+        }
+    }
+    setWindow(0, 0, src_w, src_h, dw, dh);
+
+    DEBUG_VNC("[VNCscaler::begin] %dx%d -> %dx%d at %d/%d, %s\n", src_w, src_h, dst_w, dst_h, off_x, off_y,
+              mode == VNC_SCALE_BOX ? "box" : "bilinear");
+    return true;
+}
+
+void VNCscaler::end(void) {
+    if(col_src) {
+        free(col_src);
+        col_src = NULL;
+    }
+    if(col_arg) {
+        free(col_arg);
+        col_arg = NULL;
+    }
+    if(row_src) {
+        free(row_src);
+        row_src = NULL;
+    }
+    if(row_arg) {
+        free(row_arg);
+        row_arg = NULL;
+    }
+    if(out) {
+        free(out);
+        out = NULL;
+    }
+    if(band) {
+        free(band);
+        band = NULL;
+    }
+    display = NULL;
+    mode = VNC_SCALE_NONE;
+    dst_w = dst_h = 0;
+}
+
+void VNCscaler::setWindow(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t dw, uint32_t dh) {
+    uint32_t cw = display->getWidth();
+    uint32_t ch = display->getHeight();
+    bool resized = (dw != dst_w || dh != dst_h);
+
+    win_x = x;
+    win_y = y;
+    win_w = max(w, (uint32_t) 1);
+    win_h = max(h, (uint32_t) 1);
+    dst_w = min(max(dw, (uint32_t) 1), cw);
+    dst_h = min(max(dh, (uint32_t) 1), ch);
+    off_x = (cw - dst_w) / 2;
+    off_y = (ch - dst_h) / 2;
+
+    build_table(col_src, col_arg, win_x, win_w, dst_w);
+    build_table(row_src, row_arg, win_y, win_h, dst_h);
+
+    // the bars around the picture are never drawn by the server
+    if(resized) {
+        if(off_y) {
+            display->draw_rect(0, 0, cw, off_y, 0);
+            display->draw_rect(0, off_y + dst_h, cw, ch - off_y - dst_h, 0);
+        }
+        if(off_x) {
+            display->draw_rect(0, 0, off_x, ch, 0);
+            display->draw_rect(off_x + dst_w, 0, cw - off_x - dst_w, ch, 0);
+        }
+    }
+}
+
+void VNCscaler::build_table(uint16_t * src, uint8_t * arg, uint32_t start, uint32_t size, uint32_t dst) {
+    for(uint32_t d = 0; d < dst; d++) {
+        if(mode == VNC_SCALE_BOX) {
+            if(size <= dst) {
+                // magnified, take the pixel under the center
+                src[d] = start + ((2 * d + 1) * size) / (2 * dst);
+                arg[d] = 1;
+                continue;
+            }
+            uint32_t first = d * size / dst;
+            uint32_t n = ((d + 1) * size + dst - 1) / dst - first;
+            if(n > SCALER_BOX_MAX) {
+                // keep the center of a larger box
+                first += (n - SCALER_BOX_MAX) / 2;
+                n = SCALER_BOX_MAX;
+            }
+            src[d] = start + first;
+            arg[d] = n;
+        } else {
+            // source position of the pixel center in 1/256, minus half a pixel
+            int32_t u = (int32_t) (((uint64_t) (2 * d + 1) * size * 256) / (2 * dst)) - 128;
+            if(u < 0) {
+                u = 0;
+            }
+            src[d] = start + (u >> 8);
+            arg[d] = u & 0xFF;
+        }
+    }
+}
+
+void VNCscaler::to_server(int * x, int * y) {
+    int sx = (int) win_x + ((2 * (*x - (int) off_x) + 1) * (int) win_w) / (int) (2 * dst_w);
+    int sy = (int) win_y + ((2 * (*y - (int) off_y) + 1) * (int) win_h) / (int) (2 * dst_h);
+    *x = min(max(sx, (int) win_x), (int) (win_x + win_w) - 1);
+    *y = min(max(sy, (int) win_y), (int) (win_y + win_h) - 1);
+}
+
+void VNCscaler::draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t *data) {
+    render(x, y, w, h, (const uint16_t *) data, w, x, y, w, h);
+}
+
+void VNCscaler::draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color) {
+    uint32_t dx = map_x(x);
+    uint32_t dy = map_y(y);
+    uint32_t dw = map_x(x + w) - dx;
+    uint32_t dh = map_y(y + h) - dy;
+    if(dw && dh) {
+        display->draw_rect(off_x + dx, off_y + dy, dw, dh, color);
+    }
+}
+
+void VNCscaler::copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h) {
+    // only reached if the server sends CopyRect unasked, the result may be off by a pixel
+    uint32_t dx = map_x(dest_x);
+    uint32_t dy = map_y(dest_y);
+    uint32_t dw = map_x(dest_x + w) - dx;
+    uint32_t dh = map_y(dest_y + h) - dy;
+    if(dw && dh && display->hasCopyRect()) {
+        display->copy_rect(off_x + map_x(src_x), off_y + map_y(src_y), off_x + dx, off_y + dy, dw, dh);
+    }
+}
+
+void VNCscaler::area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    band_x = x;
+    band_y = y;
+    band_w = min(w, src_w);
+    band_h = h;
+    band_row = 0;
+    band_fill = 0;
+
+    if(!band) {
+        band = (uint16_t *) scaler_alloc(SCALER_BAND_ROWS * src_w * sizeof(uint16_t));
+        if(!band) {
+            DEBUG_VNC("[VNCscaler::area_update_start] no memory for the band buffer\n");
+            band_w = 0;
+        }
+    }
+}
+
+void VNCscaler::area_update_data(char *data, uint32_t pixel) {
+    if(!band_w) {
+        return;
+    }
+    uint32_t rows = (SCALER_BAND_ROWS * src_w) / band_w;
+
+    while(pixel) {
+        uint32_t left = min(rows, band_h - band_row) * band_w;
+        if(left <= band_fill) {
+            return;
+        }
+        uint32_t n = min(pixel, left - band_fill);
+        memcpy(band + band_fill, data, n * 2);
+        band_fill += n;
+        data += n * 2;
+        pixel -= n;
+        if(band_fill == left) {
+            flush_band();
+        }
+    }
+}
+
+void VNCscaler::area_update_end(void) {
+    if(band_w) {
+        flush_band();
+    }
+    band_w = 0;
+}
+
+void VNCscaler::flush_band(void) {
+    uint32_t rows = band_fill / band_w;
+    if(rows) {
+        uint32_t y = band_y + band_row;
+        render(band_x, y, band_w, rows, band, band_w, band_x, y, band_w, rows);
+        band_row += rows;
+    }
+    band_fill = 0;
+}
+
+void VNCscaler::render(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint16_t * base, uint32_t stride,
+                       uint32_t bx, uint32_t by, uint32_t bw, uint32_t bh) {
+    uint32_t dx0 = map_x(x);
+    uint32_t dx1 = map_x(x + w);
+    uint32_t dy0 = map_y(y);
+    uint32_t dy1 = map_y(y + h);
+    if(dx0 >= dx1 || dy0 >= dy1) {
+        return;
+    }
+
+    uint32_t dw = dx1 - dx0;
+    uint32_t batch = max((uint32_t) SCALER_BUFFER_PIXELS, display->getWidth()) / dw;
+    uint32_t bx1 = bx + bw;
+    uint32_t by1 = by + bh;
+    bool copy = (win_w == dst_w && win_h == dst_h);
+    uint32_t dy = dy0;
+
+    while(dy < dy1) {
+        uint32_t rows = min(batch, dy1 - dy);
+        uint16_t * o = out;
+
+        for(uint32_t r = 0; r < rows; r++, dy++) {
+            if(copy) {
+                // 1:1, the window is only cropped
+                memcpy(o, base + (win_y + dy - by) * stride + (win_x + dx0 - bx), dw * 2);
+                o += dw;
+            } else if(mode == VNC_SCALE_BOX) {
+                // clip the box to the source, the pixel center is always inside
+                uint32_t sy0 = max((uint32_t) row_src[dy], by);
+                uint32_t sy1 = min((uint32_t) row_src[dy] + row_arg[dy], by1);
+                const uint16_t * line = base + (sy0 - by) * stride;
+
+                for(uint32_t dx = dx0; dx < dx1; dx++) {
+                    uint32_t sx0 = max((uint32_t) col_src[dx], bx);
+                    uint32_t sx1 = min((uint32_t) col_src[dx] + col_arg[dx], bx1);
+                    const uint16_t * p = line + (sx0 - bx);
+                    uint32_t sum = 0;
+                    for(uint32_t sy = sy0; sy < sy1; sy++) {
+                        for(uint32_t i = 0; i < sx1 - sx0; i++) {
+                            sum += spread565(SwapPixel(p[i]));
+                        }
+                        p += stride;
+                    }
+                    uint32_t n = recip[(sy1 - sy0) * (sx1 - sx0)];
+                    uint32_t c = ((((sum & 0x7FF) * n) >> 16) & 0x1F) |
+                                 (((((sum >> 11) & 0x3FF) * n) >> 16) << 11) |
+                                 ((((sum >> 21) * n) >> 16) << 5);
+                    *o++ = SwapPixel((uint16_t) c);
+                }
+            } else {
+                uint32_t sy = max((uint32_t) row_src[dy], by);
+                uint32_t wy = (row_src[dy] < by) ? 0 : (row_arg[dy] >> 3);
+                const uint16_t * top = base + (sy - by) * stride;
+                const uint16_t * bottom = (sy + 1 < by1) ? top + stride : top;
+
+                for(uint32_t dx = dx0; dx < dx1; dx++) {
+                    uint32_t sx = max((uint32_t) col_src[dx], bx);
+                    uint32_t wx = (col_src[dx] < bx) ? 0 : (col_arg[dx] >> 3);
+                    uint32_t i = sx - bx;
+                    uint32_t j = (sx + 1 < bx1) ? i + 1 : i;
+                    uint32_t t = blend565(spread565(SwapPixel(top[i])), spread565(SwapPixel(top[j])), wx);
+                    uint32_t b = blend565(spread565(SwapPixel(bottom[i])), spread565(SwapPixel(bottom[j])), wx);
+                    *o++ = SwapPixel(pack565(blend565(t, b, wy)));
+                }
+            }
+        }
+
+        display->draw_area(off_x + dx0, off_y + dy - rows, dw, rows, (uint8_t *) out);
+    }
+}
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * @file scaler.h
+ *
+ * Client side scaling of a remote desktop larger than the display
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef VNC_SCALER_H_
+#define VNC_SCALER_H_
+
+typedef enum {
+    VNC_SCALE_NONE,      // crop the remote desktop to the display
+    VNC_SCALE_BOX,       // average the source pixels under each display pixel
+    VNC_SCALE_BILINEAR   // interpolate between the 4 nearest source pixels
+} vnc_scale_mode_t;
+
+/// scaled pixels per draw_area call on the display
+#ifdef VNC_SAVE_MEMORY
+#define SCALER_BUFFER_PIXELS 1024
+#else
+#define SCALER_BUFFER_PIXELS 4096
+#endif
+
+/// source rows collected from area updates before they are scaled
+#define SCALER_BAND_ROWS 16
+
+/**
+ * VNCdisplay that shrinks everything drawn in server coordinates onto the
+ * real display, keeping the aspect ratio and centering the picture.
+ *
+ * Every rect is scaled on its own as it is decoded, samples never reach
+ * into neighbouring rects. A display pixel belongs to the rect that holds
+ * the source position of its center, so adjoining rects cover the display
+ * without gaps or overlap.
+ *
+ * Only a window of the desktop may be shown (see VNCviewport), rects are
+ * clipped to it. Windows smaller than the picture are magnified.
+ */
+class VNCscaler : public VNCdisplay {
+    public:
+        VNCscaler();
+        ~VNCscaler();
+
+        /// show the whole desktop, shrunk to fit if it is larger than the display
+        bool begin(VNCdisplay * display, uint32_t server_w, uint32_t server_h, vnc_scale_mode_t mode);
+        void end(void);
+
+        /// show the window x/y/w/h of the desktop as a picture of dw * dh pixels
+        void setWindow(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t dw, uint32_t dh);
+
+        /**
+         * scale the part of rect x/y/w/h inside the window to the display
+         * @param base source pixel bx/by, samples are taken from bx/by/bw/bh only
+         * @param stride source pixels per row
+         */
+        void render(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint16_t * base, uint32_t stride,
+                    uint32_t bx, uint32_t by, uint32_t bw, uint32_t bh);
+
+        /// display position -> server position
+        void to_server(int * x, int * y);
+
+        /// source pixels next to a rect that can still change display pixels of it
+        uint32_t reach(void) { return (win_w + dst_w - 1) / dst_w + 1; };
+
+        /// the decoders work in server coordinates
+        uint32_t getWidth(void) { return src_w; };
+        uint32_t getHeight(void) { return src_h; };
+
+        /// scaled copies would drift by a pixel, let the server send pixels
+        bool hasCopyRect(void) { return false; };
+
+        void draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t *data);
+        void draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color);
+        void copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h);
+
+        void area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+        void area_update_data(char *data, uint32_t pixel);
+        void area_update_end(void);
+
+        void framebuffer_update_start(void) { display->framebuffer_update_start(); };
+        void framebuffer_update_end(void) { display->framebuffer_update_end(); };
+        uint32_t present_backlog(void) { return display->present_backlog(); };
+
+    private:
+        VNCdisplay * display;
+        vnc_scale_mode_t mode;
+
+        uint32_t src_w, src_h;     // server size
+        uint32_t win_x, win_y;     // shown part of the desktop
+        uint32_t win_w, win_h;
+        uint32_t dst_w, dst_h;     // size of the scaled picture
+        uint32_t off_x, off_y;     // position of the scaled picture
+
+        // per display column / row: first source pixel and, for box, the
+        // number of source pixels or, for bilinear, the 8 bit fraction
+        uint16_t * col_src;
+        uint8_t * col_arg;
+        uint16_t * row_src;
+        uint8_t * row_arg;
+
+        // reciprocals for the box average, 65536 / n rounded up
+        uint32_t recip[256];
+
+        uint16_t * out;            // scaled pixels, at least one display row
+
+        uint16_t * band;           // SCALER_BAND_ROWS * src_w source pixels, allocated on first use
+        uint32_t band_x, band_y, band_w, band_h;
+        uint32_t band_row;         // first row of the update held in band
+        uint32_t band_fill;        // pixels in band
+
+        /// first display column whose center lies at or right of source column x
+        inline uint32_t map_x(uint32_t x) {
+            x = min(max(x, win_x), win_x + win_w) - win_x;
+            return (2 * x * dst_w + win_w - 1) / (2 * win_w);
+        }
+
+        inline uint32_t map_y(uint32_t y) {
+            y = min(max(y, win_y), win_y + win_h) - win_y;
+            return (2 * y * dst_h + win_h - 1) / (2 * win_h);
+        }
+
+        void build_table(uint16_t * src, uint8_t * arg, uint32_t start, uint32_t size, uint32_t dst);
+        void flush_band(void);
+};
+
+#endif /* VNC_SCALER_H_ */
@@ -0,0 +1,50 @@
+/*
+ * @file tight.h
+ *
+ * Tight encoding helpers
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef VNC_TIGHT_H_
+#define VNC_TIGHT_H_
+
+/// number of zlib streams the server can switch between
+#define TIGHT_STREAMS 4
+
+/// rects are never wider than this (see NOTE 4 in rfbproto.h)
+#define TIGHT_MAX_WIDTH 2048
+
+/// data shorter than this is sent without zlib compression
+#define TIGHT_MIN_TO_COMPRESS 12
+
+/// decoded pixels per draw_area call, at least one row of TIGHT_MAX_WIDTH
+#ifdef VNC_SAVE_MEMORY
+#define TIGHT_BUFFER_PIXELS TIGHT_MAX_WIDTH
+#else
+#define TIGHT_BUFFER_PIXELS (4 * TIGHT_MAX_WIDTH)
+#endif
+
+/// filter input: palette indices or the previous row of the gradient filter
+#if TIGHT_BUFFER_PIXELS > (3 * TIGHT_MAX_WIDTH)
+#define TIGHT_DATA_SIZE TIGHT_BUFFER_PIXELS
+#else
+#define TIGHT_DATA_SIZE (3 * TIGHT_MAX_WIDTH)
+#endif
+
+#endif /* VNC_TIGHT_H_ */
@@ -0,0 +1,226 @@
+/*
+ * @file viewport.cpp
+ *
+ * Pannable and zoomable view of a cached remote desktop
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "VNC_config.h"
+#include "VNC.h"
+
+#ifdef VNC_VIEWPORT
+
+VNCviewport::VNCviewport() {
+    display = NULL;
+    src_w = src_h = 0;
+    scale = fit = start = 1.0f;
+    cx = cy = 0;
+    win_x = win_y = win_w = win_h = 0;
+    area_x = area_y = area_w = area_h = 0;
+    area_col = area_row = area_shown = 0;
+}
+
+VNCviewport::~VNCviewport() {
+    end();
+}
+
+bool VNCviewport::begin(VNCdisplay * _display, uint32_t server_w, uint32_t server_h, vnc_scale_mode_t mode) {
+    end();
+
+    if(!_display || !server_w || !server_h) {
+        return false;
+    }
+
+    if(!cache.begin(server_w, server_h, true)) {
+        DEBUG_VNC("[VNCviewport::begin] no memory for a %dx%d cache\n", server_w, server_h);
+        return false;
+    }
+    memset(cache.getPtr(), 0, cache.currentSize());
+
+    if(!scaler.begin(_display, server_w, server_h, mode == VNC_SCALE_NONE ? VNC_SCALE_BOX : mode)) {
+        cache.freeBuffer();
+        return false;
+    }
+
+    display = _display;
+    src_w = server_w;
+    src_h = server_h;
+
+    float cw = display->getWidth();
+    float ch = display->getHeight();
+    fit = min(1.0f, min(cw / src_w, ch / src_h));
+    start = (mode == VNC_SCALE_NONE) ? 1.0f : fit;
+
+    // nothing is shown yet, apply() must not skip the first window
+    win_w = win_h = 0;
+
+    reset();
+    return true;
+}
+
+void VNCviewport::end(void) {
+    scaler.end();
+    cache.freeBuffer();
+    display = NULL;
+}
+
+bool VNCviewport::pan(int dx, int dy) {
+    return apply(scale, cx + dx / scale, cy + dy / scale);
+}
+
+bool VNCviewport::zoom(float factor, int x, int y) {
+    float cw = display->getWidth();
+    float ch = display->getHeight();
+    float s = min(max(scale * factor, fit), VIEWPORT_MAX_ZOOM);
+
+    // keep the desktop position under x/y where it is
+    int sx = x;
+    int sy = y;
+    scaler.to_server(&sx, &sy);
+    return apply(s, sx + (cw / 2 - x) / s, sy + (ch / 2 - y) / s);
+}
+
+bool VNCviewport::reset(void) {
+    // a fitted desktop is centered, 1:1 starts in the top left corner
+    if(start == fit) {
+        return apply(start, src_w / 2.0f, src_h / 2.0f);
+    }
+    return apply(start, 0, 0);
+}
+
+rfbRectangle VNCviewport::window(void) {
+    rfbRectangle r;
+    r.x = win_x;
+    r.y = win_y;
+    r.w = win_w;
+    r.h = win_h;
+    return r;
+}
+
+/**
+ * move the window to show desktop position x/y in the center at scale s
+ * @return false if the window did not change
+ */
+bool VNCviewport::apply(float s, float x, float y) {
+    uint32_t cw = display->getWidth();
+    uint32_t ch = display->getHeight();
+
+    s = min(max(s, fit), VIEWPORT_MAX_ZOOM);
+
+    uint32_t w = min(src_w, max((uint32_t) 1, (uint32_t) (cw / s + 0.5f)));
+    uint32_t h = min(src_h, max((uint32_t) 1, (uint32_t) (ch / s + 0.5f)));
+    int32_t wx = (int32_t) (x - w / 2.0f + 0.5f);
+    int32_t wy = (int32_t) (y - h / 2.0f + 0.5f);
+    wx = min(max(wx, (int32_t) 0), (int32_t) (src_w - w));
+    wy = min(max(wy, (int32_t) 0), (int32_t) (src_h - h));
+
+    if(s == scale && w == win_w && h == win_h && (uint32_t) wx == win_x && (uint32_t) wy == win_y) {
+        return false;
+    }
+
+    scale = s;
+    win_x = wx;
+    win_y = wy;
+    win_w = w;
+    win_h = h;
+    cx = win_x + win_w / 2.0f;
+    cy = win_y + win_h / 2.0f;
+
+    scaler.setWindow(win_x, win_y, win_w, win_h,
+                     min(cw, (uint32_t) (win_w * s + 0.5f)), min(ch, (uint32_t) (win_h * s + 0.5f)));
+
+    display->framebuffer_update_start();
+    show(win_x, win_y, win_w, win_h);
+    display->framebuffer_update_end();
+    return true;
+}
+
+/**
+ * pass a changed part of the cache on to the display, including the
+ * display pixels around it whose samples reach into it
+ */
+void VNCviewport::show(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    uint32_t r = scaler.reach();
+    uint32_t x0 = (x > r) ? x - r : 0;
+    uint32_t y0 = (y > r) ? y - r : 0;
+    uint32_t x1 = min(x + w + r, src_w);
+    uint32_t y1 = min(y + h + r, src_h);
+
+    scaler.render(x0, y0, x1 - x0, y1 - y0, (const uint16_t *) cache.getPtr(), src_w, 0, 0, src_w, src_h);
+}
+
+void VNCviewport::draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t *data) {
+    cache.draw_area(x, y, w, h, data);
+    show(x, y, w, h);
+}
+
+void VNCviewport::draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color) {
+    if(x >= src_w || y >= src_h) {
+        return;
+    }
+    w = min(w, src_w - x);
+    h = min(h, src_h - y);
+    // the cache keeps pixels in the negotiated byte order
+    cache.draw_rect(x, y, w, h, SwapPixel(color));
+    show(x, y, w, h);
+}
+
+void VNCviewport::copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h) {
+    cache.copy_rect(src_x, src_y, dest_x, dest_y, w, h);
+    show(dest_x, dest_y, w, h);
+}
+
+void VNCviewport::area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    area_x = x;
+    area_y = y;
+    area_w = w;
+    area_h = h;
+    area_col = 0;
+    area_row = 0;
+    area_shown = 0;
+}
+
+void VNCviewport::area_update_data(char *data, uint32_t pixel) {
+    while(pixel && area_w && area_row < area_h) {
+        uint32_t span = min(pixel, area_w - area_col);
+        cache.draw_area(area_x + area_col, area_y + area_row, span, 1, (const uint8_t *) data);
+        data += span * 2;
+        pixel -= span;
+        area_col += span;
+        if(area_col == area_w) {
+            area_col = 0;
+            area_row++;
+        }
+    }
+
+    if(area_row - area_shown >= VIEWPORT_AREA_ROWS) {
+        show(area_x, area_y + area_shown, area_w, area_row - area_shown);
+        area_shown = area_row;
+    }
+}
+
+void VNCviewport::area_update_end(void) {
+    uint32_t rows = area_row + (area_col ? 1 : 0);
+    if(rows > area_shown) {
+        show(area_x, area_y + area_shown, area_w, rows - area_shown);
+    }
+    area_w = 0;
+}
+
+#endif
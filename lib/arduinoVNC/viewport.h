@@ -0,0 +1,115 @@
+/*
+ * @file viewport.h
+ *
+ * Pannable and zoomable view of a cached remote desktop
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef VNC_VIEWPORT_H_
+#define VNC_VIEWPORT_H_
+
+/// largest zoom, display pixels per desktop pixel
+#ifndef VIEWPORT_MAX_ZOOM
+#define VIEWPORT_MAX_ZOOM 4.0f
+#endif
+
+/// rows of an area update written to the cache before they are shown
+#define VIEWPORT_AREA_ROWS 16
+
+/**
+ * VNCdisplay that keeps the whole remote desktop in a cache (PSRAM on the
+ * ESP32) and shows a window of it through a VNCscaler.
+ *
+ * Decoders draw into the cache, the part inside the window is passed on to
+ * the display. Moving or zooming the window redraws the display from the
+ * cache, the server only has to refresh the newly exposed parts.
+ */
+class VNCviewport : public VNCdisplay {
+    public:
+        VNCviewport();
+        ~VNCviewport();
+
+        /**
+         * mode NONE starts at 1:1 in the top left corner, BOX and BILINEAR
+         * start with the whole desktop shrunk to fit
+         * @return false if there is no memory for the cache
+         */
+        bool begin(VNCdisplay * display, uint32_t server_w, uint32_t server_h, vnc_scale_mode_t mode);
+        void end(void);
+
+        /// move the window by dx/dy display pixels, @return false if it did not move
+        bool pan(int dx, int dy);
+
+        /// zoom by factor around display position x/y, @return false if nothing changed
+        bool zoom(float factor, int x, int y);
+
+        /// back to the view begin() started with
+        bool reset(void);
+
+        /// the window does not show the whole desktop
+        bool canPan(void) { return win_w < src_w || win_h < src_h; };
+
+        /// shown part of the desktop
+        rfbRectangle window(void);
+
+        /// display position -> server position
+        void to_server(int * x, int * y) { scaler.to_server(x, y); };
+
+        /// the decoders work in server coordinates
+        uint32_t getWidth(void) { return src_w; };
+        uint32_t getHeight(void) { return src_h; };
+
+        /// copies are done in the cache
+        bool hasCopyRect(void) { return true; };
+
+        void draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t *data);
+        void draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color);
+        void copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h);
+
+        void area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+        void area_update_data(char *data, uint32_t pixel);
+        void area_update_end(void);
+
+        void framebuffer_update_start(void) { display->framebuffer_update_start(); };
+        void framebuffer_update_end(void) { display->framebuffer_update_end(); };
+        uint32_t present_backlog(void) { return display->present_backlog(); };
+
+    private:
+        VNCdisplay * display;
+        VNCscaler scaler;
+        FrameBuffer cache;          // the whole desktop, negotiated byte order
+
+        uint32_t src_w, src_h;      // desktop size
+        float scale;                // display pixels per desktop pixel
+        float fit;                  // scale showing the whole desktop, at most 1
+        float start;                // scale begin() started with
+        float cx, cy;               // desktop position in the center of the display
+        uint32_t win_x, win_y;      // shown part of the desktop
+        uint32_t win_w, win_h;
+
+        // area update in progress
+        uint32_t area_x, area_y, area_w, area_h;
+        uint32_t area_col, area_row;
+        uint32_t area_shown;        // rows already passed on to the display
+
+        bool apply(float scale, float cx, float cy);
+        void show(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+};
+
+#endif /* VNC_VIEWPORT_H_ */
@@ -0,0 +1,248 @@
+/*
+ * @file zstream.cpp
+ *
+ * zlib streams of the compressed encodings
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "VNC_config.h"
+#include "VNC.h"
+
+#ifdef VNC_ZSTREAMS
+
+/// guard of each stream: a raw 64x64 tile for ZRLE, some bytes for the pixels of Zlib,
+/// the largest read of a ZlibHex tile
+static const size_t zstream_guard[ZSTREAM_COUNT] = {
+    0, 0, 0, 0,         // Tight copies its reads out
+    16,                 // Zlib
+    64 * 64 * 2,        // ZRLE
+    16 * 16 * 2,        // ZlibHex raw tiles
+    1024,               // ZlibHex subrects, up to 255 * 4 bytes
+};
+
+static void * zstream_alloc_internal(size_t size) {
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+    return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+    return malloc(size);
+#endif
+}
+
+/**
+ * window memory: internal SRAM while enough of it stays free, else PSRAM
+ */
+static void * zstream_alloc_window(size_t size, bool * internal) {
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+    if(heap_caps_get_free_size(MALLOC_CAP_INTERNAL) > size + VNC_ZSTREAM_SRAM_RESERVE) {
+        void * p = zstream_alloc_internal(size);
+        if(p) {
+            *internal = true;
+            return p;
+        }
+    }
+    *internal = false;
+    return ps_malloc(size);
+#else
+    *internal = true;
+    return malloc(size);
+#endif
+}
+
+/*
+ * inflate backends: begin and end a stream, start it over, and one step
+ * from in into [next, next + *out_size) of the circular window
+ */
+#if defined(VNC_INFLATE_FAST)
+static bool zstream_backend_begin(vnc_inflater_t * z) {
+    return true;
+}
+
+static void zstream_backend_end(vnc_inflater_t * z) {
+}
+
+static void zstream_backend_reset(vnc_inflater_t * z) {
+    vnc_inflate_init(z);
+}
+
+static bool zstream_backend_inflate(vnc_inflater_t * z, const uint8_t * in, size_t * in_size, uint8_t * window, uint8_t * next, size_t * out_size) {
+    return vnc_inflate(z, in, in_size, window, next, out_size);
+}
+#elif defined(VNC_INFLATE_ZLIB)
+// zlib keeps its own history, the window only takes the output
+static bool zstream_backend_begin(vnc_inflater_t * z) {
+    memset(z, 0, sizeof(*z));
+    return inflateInit(z) == Z_OK;
+}
+
+static void zstream_backend_end(vnc_inflater_t * z) {
+    inflateEnd(z);
+}
+
+static void zstream_backend_reset(vnc_inflater_t * z) {
+    inflateReset(z);
+}
+
+static bool zstream_backend_inflate(vnc_inflater_t * z, const uint8_t * in, size_t * in_size, uint8_t * window, uint8_t * next, size_t * out_size) {
+    z->next_in = (Bytef *) in;
+    z->avail_in = *in_size;
+    z->next_out = next;
+    z->avail_out = *out_size;
+    int ret = inflate(z, Z_SYNC_FLUSH);
+    *in_size -= z->avail_in;
+    *out_size -= z->avail_out;
+    if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+        DEBUG_VNC("[zstream_backend_inflate] zlib error: %d\n", ret);
+        return false;
+    }
+    return true;
+}
+#else
+static bool zstream_backend_begin(vnc_inflater_t * z) {
+    return true;
+}
+
+static void zstream_backend_end(vnc_inflater_t * z) {
+}
+
+static void zstream_backend_reset(vnc_inflater_t * z) {
+    tinfl_init(z);
+}
+
+static bool zstream_backend_inflate(vnc_inflater_t * z, const uint8_t * in, size_t * in_size, uint8_t * window, uint8_t * next, size_t * out_size) {
+    tinfl_status status = tinfl_decompress(z, in, in_size, window, next, out_size, TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_PARSE_ZLIB_HEADER);
+    if(status < TINFL_STATUS_DONE) {
+        DEBUG_VNC("[zstream_backend_inflate] decompression failed: %d\n", status);
+        return false;
+    }
+    return true;
+}
+#endif
+
+VNCzstreams::VNCzstreams() {
+    memset(streams, 0, sizeof(streams));
+}
+
+VNCzstreams::~VNCzstreams() {
+    end();
+}
+
+vnc_zstream_t * VNCzstreams::borrow(uint8_t id) {
+    if(id >= ZSTREAM_COUNT) {
+        return NULL;
+    }
+    if(streams[id]) {
+        return streams[id];
+    }
+
+    vnc_zstream_t * zs = (vnc_zstream_t *) zstream_alloc_internal(sizeof(vnc_zstream_t));
+    if(!zs) {
+        DEBUG_VNC("[VNCzstreams::borrow] no memory for stream %d\n", id);
+        return NULL;
+    }
+
+    if(!zstream_backend_begin(&zs->inflater)) {
+        DEBUG_VNC("[VNCzstreams::borrow] inflater of stream %d failed\n", id);
+        free(zs);
+        return NULL;
+    }
+
+    zs->guard = zstream_guard[id];
+    uint8_t * mem = (uint8_t *) zstream_alloc_window(zs->guard + ZSTREAM_WINDOW, &zs->internal);
+    if(!mem) {
+        DEBUG_VNC("[VNCzstreams::borrow] no memory for the window of stream %d\n", id);
+        zstream_backend_end(&zs->inflater);
+        free(zs);
+        return NULL;
+    }
+    zs->window = mem + zs->guard;
+
+    DEBUG_VNC("[VNCzstreams::borrow] stream %d, window in %s\n", id, zs->internal ? "SRAM" : "PSRAM");
+
+    streams[id] = zs;
+    reset(id);
+    return zs;
+}
+
+void VNCzstreams::reset(uint8_t id) {
+    vnc_zstream_t * zs = (id < ZSTREAM_COUNT) ? streams[id] : NULL;
+    if(!zs) {
+        return;
+    }
+    zstream_backend_reset(&zs->inflater);
+    zs->next = zs->window;
+    zs->read = zs->window;
+}
+
+void VNCzstreams::resetAll(void) {
+    for(uint8_t i = 0; i < ZSTREAM_COUNT; i++) {
+        reset(i);
+    }
+}
+
+void VNCzstreams::end(void) {
+    for(uint8_t i = 0; i < ZSTREAM_COUNT; i++) {
+        if(streams[i]) {
+            zstream_backend_end(&streams[i]->inflater);
+            free(streams[i]->window - streams[i]->guard);
+            freeSec(streams[i]);
+        }
+    }
+}
+
+size_t VNCzstreams::internalBytes(void) {
+    size_t n = 0;
+    for(uint8_t i = 0; i < ZSTREAM_COUNT; i++) {
+        if(streams[i] && streams[i]->internal) {
+            n += streams[i]->guard + ZSTREAM_WINDOW;
+        }
+    }
+    return n;
+}
+
+size_t VNCzstreams::psramBytes(void) {
+    size_t n = 0;
+    for(uint8_t i = 0; i < ZSTREAM_COUNT; i++) {
+        if(streams[i] && !streams[i]->internal) {
+            n += streams[i]->guard + ZSTREAM_WINDOW;
+        }
+    }
+    return n;
+}
+
+bool VNCzstreams::inflate(vnc_zstream_t * zs, const uint8_t * in, size_t * in_size, size_t * out_size) {
+    if(zs->next == zs->window + ZSTREAM_WINDOW) {
+        size_t rest = zs->next - zs->read;
+        if(rest > zs->guard) {
+            DEBUG_VNC("[VNCzstreams::inflate] %d unread bytes do not fit the guard\n", (int) rest);
+            return false;
+        }
+        memmove(zs->window - rest, zs->read, rest);
+        zs->read = zs->window - rest;
+        zs->next = zs->window;
+    }
+
+    *out_size = zs->window + ZSTREAM_WINDOW - zs->next;
+    if(!zstream_backend_inflate(&zs->inflater, in, in_size, zs->window, zs->next, out_size)) {
+        return false;
+    }
+    zs->next += *out_size;
+    return true;
+}
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * @file zstream.h
+ *
+ * zlib streams of the compressed encodings
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef VNC_ZSTREAM_H_
+#define VNC_ZSTREAM_H_
+
+// inflate backend, selected in VNC_config.h
+#if defined(VNC_INFLATE_FAST)
+#include "inflate.h"
+typedef vnc_inflate_t vnc_inflater_t;
+#elif defined(VNC_INFLATE_ZLIB)
+#include <zlib.h>
+typedef z_stream vnc_inflater_t;
+#else
+#include "miniz.h"
+typedef tinfl_decompressor vnc_inflater_t;
+#endif
+
+/// ids of the zlib streams, RFB keeps one per encoding, Tight has four and ZlibHex two
+#define ZSTREAM_TIGHT 0
+#define ZSTREAM_ZLIB 4
+#define ZSTREAM_ZRLE 5
+#define ZSTREAM_ZLIBHEX_RAW 6
+#define ZSTREAM_ZLIBHEX 7
+#define ZSTREAM_COUNT 8
+
+/// output window of each stream, the full deflate history
+#define ZSTREAM_WINDOW 32768
+
+/// state of one zlib stream
+typedef struct {
+    vnc_inflater_t inflater;
+    uint8_t * window;   // circular output window, ZSTREAM_WINDOW bytes
+    uint8_t * next;     // next write position in window
+    uint8_t * read;     // next decompressed byte not handed out yet
+    size_t guard;       // room in front of window for unread bytes when it wraps
+    bool internal;      // window in internal SRAM, else PSRAM
+} vnc_zstream_t;
+
+/**
+ * The zlib streams of a session, each with its own inflater and dictionary.
+ *
+ * A decoder borrows the stream of its encoding by id, so the server can
+ * switch between Zlib, ZRLE and Tight from one rect to the next. Streams are
+ * allocated on first use: the inflater in internal SRAM, the window there
+ * too while VNC_ZSTREAM_SRAM_RESERVE bytes stay free, else in PSRAM.
+ *
+ * The unread output [read, next) is always contiguous. When the window is
+ * full, inflate() moves it into the guard in front of the window, so a
+ * stream with a guard can hand out spans of up to guard bytes.
+ */
+class VNCzstreams {
+    public:
+        VNCzstreams();
+        ~VNCzstreams();
+
+        /// stream id, allocated and started on first use, NULL without memory
+        vnc_zstream_t * borrow(uint8_t id);
+
+        /// start stream id over, as requested by the server
+        void reset(uint8_t id);
+        /// start all streams over, for a new connection
+        void resetAll(void);
+        /// free all streams
+        void end(void);
+
+        /// bytes of window memory in internal SRAM and in PSRAM
+        size_t internalBytes(void);
+        size_t psramBytes(void);
+
+        /**
+         * one step of the inflate backend of zs into its window
+         * @param in_size bytes available at in, returns the bytes consumed
+         * @param out_size returns the bytes produced
+         * @return false on corrupt data or when unread bytes do not fit the guard
+         */
+        static bool inflate(vnc_zstream_t * zs, const uint8_t * in, size_t * in_size, size_t * out_size);
+
+    private:
+        vnc_zstream_t * streams[ZSTREAM_COUNT];
+};
+
+#endif /* VNC_ZSTREAM_H_ */
@@ -0,0 +1,160 @@
+/*
+ * @file zywrle.cpp
+ *
+ * Inverse wavelet transform of ZYWRLE tiles
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "VNC_config.h"
+#include "VNC.h"
+
+#ifdef VNC_ZYWRLE
+
+/**
+ * piecewise linear Haar step of one coefficient pair
+ * The step is its own inverse for all values but -128, which the encoder
+ * never produces, so synthesis runs the same step as the analysis.
+ */
+static inline void zywrle_haar(int8_t * a, int8_t * b) {
+    int x0 = *a;
+    int x1 = *b;
+    if((x0 ^ x1) & 0x80) {
+        // different signs
+        x1 += x0;
+        if(((x1 ^ *b) & 0x80) == 0) {
+            x0 -= x1;
+        }
+    } else {
+        // same sign
+        x0 -= x1;
+        if(((x0 ^ *a) & 0x80) == 0) {
+            x1 += x0;
+        }
+    }
+    *a = (int8_t) x1;
+    *b = (int8_t) x0;
+}
+
+/// undo level l of a w x h plane, columns first, then rows
+static void zywrle_inverse_level(int8_t * p, uint16_t w, uint16_t h, uint8_t l) {
+    const uint16_t half = 1 << l;
+    const uint16_t step = 2 << l;
+
+    // the pairs of a column are half rows apart, walked row by row
+    for(uint16_t y = 0; y < h; y += step) {
+        int8_t * r0 = p + y * w;
+        int8_t * r1 = r0 + half * w;
+        for(uint16_t x = 0; x < w; x += half) {
+            zywrle_haar(r0 + x, r1 + x);
+        }
+    }
+    for(uint16_t y = 0; y < h; y += half) {
+        int8_t * r = p + y * w;
+        for(uint16_t x = 0; x < w; x += step) {
+            zywrle_haar(r + x, r + x + half);
+        }
+    }
+}
+
+/// read the coefficients of band r (1: H, 2: V, 3: HV, 0: the rest) of level l
+static const uint16_t * zywrle_unpack(vnc_zywrle_t * z, const uint16_t * src, uint16_t w, uint16_t h, uint8_t l, uint8_t r) {
+    const uint16_t half = 1 << l;
+    const uint16_t step = 2 << l;
+
+    for(uint16_t y = (r & 2) ? half : 0; y < h; y += step) {
+        for(uint16_t x = (r & 1) ? half : 0; x < w; x += step) {
+            // V, Y and U take the places of red, green and blue
+            uint16_t c = SwapPixel(*src++);
+            size_t i = y * w + x;
+            z->v[i] = (int8_t) ((c >> 8) & 0xF8);
+            z->y[i] = (int8_t) ((c >> 3) & 0xFC);
+            z->u[i] = (int8_t) ((c << 3) & 0xF8);
+        }
+    }
+    return src;
+}
+
+static inline int zywrle_clamp(int c) {
+    return (c < 0) ? 0 : (c > 255) ? 255 : c;
+}
+
+void vnc_zywrle_synthesize(vnc_zywrle_t * z, uint16_t * tile, uint16_t tile_w, uint16_t tile_h, uint8_t level) {
+    const uint16_t mask = (1 << level) - 1;
+    const uint16_t w = tile_w & ~mask;
+    const uint16_t h = tile_h & ~mask;
+    if(!w || !h) {
+        return;
+    }
+
+    // coefficients, finest level first, the low pass band last
+    const uint16_t * src = tile;
+    for(uint8_t l = 0; l < level; l++) {
+        src = zywrle_unpack(z, src, w, h, l, 3);
+        src = zywrle_unpack(z, src, w, h, l, 2);
+        src = zywrle_unpack(z, src, w, h, l, 1);
+    }
+    src = zywrle_unpack(z, src, w, h, level - 1, 0);
+
+    // the pixels outside follow, they are moved to their places below
+    size_t rest = (size_t) tile_w * tile_h - (size_t) w * h;
+    memcpy(z->rest, src, rest * 2);
+
+    for(int8_t l = level - 1; l >= 0; l--) {
+        zywrle_inverse_level(z->y, w, h, l);
+        zywrle_inverse_level(z->u, w, h, l);
+        zywrle_inverse_level(z->v, w, h, l);
+    }
+
+    size_t i = 0;
+    for(uint16_t y = 0; y < h; y++) {
+        uint16_t * p = tile + y * tile_w;
+        for(uint16_t x = 0; x < w; x++, i++) {
+            int Y = z->y[i] + 128;
+            int U = z->u[i] * 2;
+            int V = z->v[i] * 2;
+            int G = Y - ((U + V) >> 2);
+            int B = zywrle_clamp(U + G);
+            int R = zywrle_clamp(V + G);
+            G = zywrle_clamp(G);
+            p[x] = SwapPixel((uint16_t) (((R & 0xF8) << 8) | ((G & 0xFC) << 3) | (B >> 3)));
+        }
+    }
+
+    // right edge, bottom edge, then the corner
+    const uint16_t * r = z->rest;
+    const uint16_t uw = tile_w - w;
+    const uint16_t uh = tile_h - h;
+    if(uw) {
+        for(uint16_t y = 0; y < h; y++, r += uw) {
+            memcpy(tile + y * tile_w + w, r, uw * 2);
+        }
+    }
+    if(uh) {
+        for(uint16_t y = h; y < tile_h; y++, r += w) {
+            memcpy(tile + y * tile_w, r, w * 2);
+        }
+        if(uw) {
+            for(uint16_t y = h; y < tile_h; y++, r += uw) {
+                memcpy(tile + y * tile_w + w, r, uw * 2);
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * @file zywrle.h
+ *
+ * Inverse wavelet transform of ZYWRLE tiles
+ * This file is part of the VNC client for Arduino.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, a copy can be downloaded from
+ * http://www.gnu.org/licenses/gpl.html, or obtained by writing to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef VNC_ZYWRLE_H_
+#define VNC_ZYWRLE_H_
+
+/// ZYWRLE works on the 64x64 tiles of ZRLE
+#define ZYWRLE_TILE 64
+
+/// most pixels outside the transformed part of a tile, level 3 on a 63x63 tile
+#define ZYWRLE_REST (ZYWRLE_TILE * ZYWRLE_TILE - 56 * 56)
+
+/// wavelet coefficients of one tile
+typedef struct {
+    int8_t y[ZYWRLE_TILE * ZYWRLE_TILE];   // planes with rows of the transformed width
+    int8_t u[ZYWRLE_TILE * ZYWRLE_TILE];
+    int8_t v[ZYWRLE_TILE * ZYWRLE_TILE];
+    uint16_t rest[ZYWRLE_REST];             // untransformed pixels at the right and bottom edge
+} vnc_zywrle_t;
+
+/// wavelet level libvncserver uses for an RFB quality level, 1 when none was sent (above 9)
+static inline uint8_t vnc_zywrle_level(uint8_t quality) {
+    return (quality < 3) ? 3 : (quality < 6) ? 2 : 1;
+}
+
+/**
+ * turn a decoded ZYWRLE tile back into pixels, in place
+ * The tile holds the packed coefficients of the largest part whose sides are
+ * multiples of 1 << level, followed by the pixels outside of it. Tiles with
+ * no such part are left as they are.
+ * @param tile w * h pixels in the negotiated byte order
+ */
+void vnc_zywrle_synthesize(vnc_zywrle_t * z, uint16_t * tile, uint16_t w, uint16_t h, uint8_t level);
+
+#endif /* VNC_ZYWRLE_H_ */
@@ -0,0 +1,201 @@
+/**
+ * @file BenchmarkSession.cpp
+ * @brief Synthetic sessions for decoder benchmarks in the native build
+ */
+
+#include "BenchmarkSession.h"
+
+#include <string.h>
+#include <vector>
+#include "VNC.h"
+#include "SessionBuilder.h"
+
+static const uint32_t CELL_WIDTH = 8;
+static const uint32_t CELL_HEIGHT = 16;
+static const uint32_t GLYPHS = 95;
+
+/// milliseconds between updates in paced replay
+static const uint32_t FRAME_INTERVAL = 33;
+
+struct BenchmarkEncoding {
+    const char* name;
+    int32_t encoding;
+};
+
+static const BenchmarkEncoding encodings[] = {
+    { "raw", rfbEncodingRaw },
+#ifdef VNC_RRE
+    { "rre", rfbEncodingRRE },
+#endif
+#ifdef VNC_CORRE
+    { "corre", rfbEncodingCoRRE },
+#endif
+#ifdef VNC_HEXTILE
+    { "hextile", rfbEncodingHextile },
+#endif
+#ifdef VNC_ZLIBHEX
+    { "zlibhex", rfbEncodingZlibHex },
+#endif
+#ifdef VNC_ZLIB
+    { "zlib", rfbEncodingZlib },
+#endif
+#ifdef VNC_TIGHT
+    { "tight", rfbEncodingTight },
+#endif
+#ifdef VNC_ZRLE
+    { "zrle", rfbEncodingZRLE },
+#endif
+};
+
+static uint32_t hash32(uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t h = a * 0x9E3779B1u ^ b * 0x85EBCA77u ^ c * 0xC2B2AE3Du;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return h;
+}
+
+/**
+ * levels of the pixels of a glyph cell: 0 background, 3 stroke, 2 and 1
+ * the antialiased pixels right and left of a stroke
+ */
+static uint8_t glyph_levels[GLYPHS][CELL_HEIGHT][CELL_WIDTH];
+
+static void build_glyphs(void) {
+    static bool built = false;
+    if (built) return;
+
+    bool ink[CELL_HEIGHT][CELL_WIDTH + 2];
+    for (uint32_t code = 0; code < GLYPHS; code++) {
+        memset(ink, 0, sizeof(ink));
+        for (uint32_t y = 2; y < 14; y++) {
+            for (uint32_t x = 1; x < 7; x++) {
+                ink[y][x + 1] = hash32(code, x, y) & 1;
+            }
+        }
+        for (uint32_t y = 0; y < CELL_HEIGHT; y++) {
+            for (uint32_t x = 0; x < CELL_WIDTH; x++) {
+                uint8_t level = 0;
+                if (ink[y][x + 1]) {
+                    level = 3;
+                } else if (ink[y][x]) {
+                    level = 2;
+                } else if (ink[y][x + 2]) {
+                    level = 1;
+                }
+                glyph_levels[code][y][x] = level;
+            }
+        }
+    }
+    built = true;
+}
+
+/**
+ * three panes of text scrolling up by one line per frame: a terminal in
+ * two colors, an antialiased editor in four and antialiased syntax colored
+ * code
+ */
+static void draw_text(uint16_t* image, uint16_t width, uint16_t height, uint32_t frame) {
+    static const uint16_t editor[4] = { 0xFFFF, 0xC618, 0x8410, 0x0000 };
+    static const uint16_t tokens[6] = { 0xFFE0, 0x07FF, 0xF81F, 0xFD20, 0x87F0, 0xDEFB };
+    uint32_t paneWidth = (width / 3 / CELL_WIDTH) * CELL_WIDTH;
+    uint32_t columns = paneWidth / CELL_WIDTH;
+
+    build_glyphs();
+    for (uint32_t y = 0; y < height; y++) {
+        uint32_t line = y / CELL_HEIGHT + frame;
+        uint32_t gy = y % CELL_HEIGHT;
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t pane = paneWidth ? min(x / paneWidth, 2u) : 0;
+            uint32_t column = (x - pane * paneWidth) / CELL_WIDTH;
+            uint32_t length = columns - hash32(line, pane, 0) % (columns / 3 + 1);
+            uint32_t code = hash32(line, column, pane + 1) % GLYPHS;
+            uint8_t level = 0;
+            if (column < length && code % 8) {
+                level = glyph_levels[code][gy][x % CELL_WIDTH];
+            }
+
+            uint16_t color;
+            if (pane == 0) {
+                color = (level == 3) ? 0xC618 : 0x0000;
+            } else if (pane == 1) {
+                color = editor[level];
+            } else {
+                uint16_t token = tokens[hash32(line, column / 6, 7) % 6];
+                color = (level == 3) ? token : level ? ((token >> 1) & 0x7BEF) : 0x2104;
+            }
+            image[y * width + x] = color;
+        }
+    }
+}
+
+/// a gradient moving right by 8 pixels per frame, with one bit of noise
+static void draw_photo(uint16_t* image, uint16_t width, uint16_t height, uint32_t frame) {
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t r = ((x + frame * 8) >> 5) & 0x1F;
+            uint32_t g = ((y >> 3) + frame) & 0x3F;
+            uint32_t b = ((x + y) >> 6) & 0x1F;
+            g ^= hash32(x, y, frame) & 1;
+            image[y * width + x] = (r << 11) | (g << 5) | b;
+        }
+    }
+}
+
+struct BenchmarkContent {
+    const char* name;
+    void (*draw)(uint16_t* image, uint16_t width, uint16_t height, uint32_t frame);
+};
+
+static const BenchmarkContent contents[] = {
+    { "text", draw_text },
+    { "photo", draw_photo },
+};
+
+bool build_benchmark_session(const char* name, ReplayServer& server, uint16_t width, uint16_t height, uint32_t frames) {
+    const char* dash = strchr(name, '-');
+    if (!dash) return false;
+
+    const BenchmarkEncoding* encoding = nullptr;
+    for (const BenchmarkEncoding& e : encodings) {
+        if (strlen(e.name) == (size_t)(dash - name) && !strncmp(name, e.name, dash - name)) {
+            encoding = &e;
+        }
+    }
+    const BenchmarkContent* content = nullptr;
+    for (const BenchmarkContent& c : contents) {
+        if (!strcmp(dash + 1, c.name)) {
+            content = &c;
+        }
+    }
+    if (!encoding || !content) return false;
+
+    SessionBuilder session(server, width, height);
+    std::vector<uint16_t> image((size_t)width * height);
+
+    session.handshake(name);
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        content->draw(image.data(), width, height, frame);
+        session.beginUpdate();
+        session.rect(encoding->encoding, 0, 0, width, height, image.data(), width);
+        session.endUpdate();
+        session.flush(frame * FRAME_INTERVAL);
+    }
+    // keep the connection open until the client has read the last update
+    session.flush(frames * FRAME_INTERVAL + 300);
+    return true;
+}
+
+void print_benchmark_names(FILE* f) {
+    fprintf(f, "      encodings:");
+    for (const BenchmarkEncoding& e : encodings) {
+        fprintf(f, " %s", e.name);
+    }
+    fprintf(f, "\n      contents:");
+    for (const BenchmarkContent& c : contents) {
+        fprintf(f, " %s", c.name);
+    }
+    fprintf(f, "\n");
+}
@@ -0,0 +1,41 @@
+/**
+ * @file BenchmarkSession.h
+ * @brief Synthetic sessions for decoder benchmarks in the native build
+ *
+ * A benchmark is named <encoding>-<content>, e.g. zrle-text. It sends a
+ * number of full screen updates of generated content in one encoding. The
+ * content moves every frame, so each update is decoded in full.
+ *
+ * text:  terminal and editor windows side by side. A terminal pane with
+ *        two colors, an antialiased editor pane with four, and a syntax
+ *        colored pane with up to 16. ZRLE sends them mostly as 1, 2 and
+ *        4 bit packed palette tiles, Hextile and RRE as many small subrects.
+ * photo: a smooth image with noise, sent mostly as raw pixels.
+ */
+
+#pragma once
+
+#ifndef BENCHMARKSESSION_H
+#define BENCHMARKSESSION_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "ReplayServer.h"
+
+/**
+ * @brief Build a benchmark session into a replay server
+ * @param name Benchmark name, <encoding>-<content>
+ * @param server Replay server the session is added to
+ * @param width Desktop width
+ * @param height Desktop height
+ * @param frames Number of updates
+ * @return false if the name is unknown or the encoding is not built in
+ */
+bool build_benchmark_session(const char* name, ReplayServer& server, uint16_t width, uint16_t height, uint32_t frames);
+
+/**
+ * @brief List the encodings and contents benchmark names are made of
+ */
+void print_benchmark_names(FILE* f);
+
+#endif // BENCHMARKSESSION_H
@@ -0,0 +1,77 @@
+/**
+ * @file FbsRecorder.cpp
+ * @brief Session recorder writing the server byte stream as an FBS file
+ */
+
+#include "FbsRecorder.h"
+
+static bool write_be32(FILE* f, uint32_t value) {
+    uint8_t buf[4] = {
+        (uint8_t)(value >> 24),
+        (uint8_t)(value >> 16),
+        (uint8_t)(value >> 8),
+        (uint8_t)value
+    };
+    return fwrite(buf, 1, sizeof(buf), f) == sizeof(buf);
+}
+
+FbsRecorder::FbsRecorder(const char* path)
+    : _path(path)
+    , _file(nullptr)
+    , _done(false)
+    , _failed(false)
+    , _start(0)
+    , _bytes(0)
+{
+}
+
+FbsRecorder::~FbsRecorder() {
+    close();
+}
+
+void FbsRecorder::session_start(void) {
+    if (_done || _file) return;
+
+    _file = fopen(_path, "wb");
+    if (!_file || fwrite(FBS_VERSION, 1, FBS_VERSION_LEN, _file) != FBS_VERSION_LEN) {
+        _failed = true;
+        close();
+        _done = true;
+        return;
+    }
+    _start = millis();
+}
+
+void FbsRecorder::record(const uint8_t* data, size_t len) {
+    if (!_file) return;
+
+    static const uint8_t padding[3] = { 0, 0, 0 };
+    size_t pad = (4 - (len & 3)) & 3;
+
+    bool ok = write_be32(_file, len);
+    ok = ok && fwrite(data, 1, len, _file) == len;
+    ok = ok && fwrite(padding, 1, pad, _file) == pad;
+    ok = ok && write_be32(_file, millis() - _start);
+    if (!ok) {
+        _failed = true;
+        close();
+        return;
+    }
+    _bytes += len;
+}
+
+void FbsRecorder::session_end(void) {
+    if (_file) {
+        close();
+    }
+}
+
+void FbsRecorder::close() {
+    if (_file) {
+        if (fclose(_file) != 0) {
+            _failed = true;
+        }
+        _file = nullptr;
+        _done = true;
+    }
+}
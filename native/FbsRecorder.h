@@ -0,0 +1,66 @@
+/**
+ * @file FbsRecorder.h
+ * @brief Session recorder writing the server byte stream as an FBS file
+ *
+ * The file uses the FBS 001.000 layout of rfbproxy, so recordings can also
+ * be inspected or played back with existing tools:
+ *
+ *   "FBS 001.000\n"
+ *   repeated: uint32 length (big endian), data padded to 4 bytes,
+ *             uint32 milliseconds since the session start (big endian)
+ */
+
+#pragma once
+
+#ifndef FBSRECORDER_H
+#define FBSRECORDER_H
+
+#include "VNC.h"
+
+#include <stdio.h>
+
+#define FBS_VERSION "FBS 001.000\n"
+#define FBS_VERSION_LEN 12
+
+/**
+ * @class FbsRecorder
+ * @brief VNCrecorder that writes one block per socket read
+ *
+ * Only the first session is recorded; when arduinoVNC reconnects the file is
+ * already complete and later data is ignored.
+ */
+class FbsRecorder : public VNCrecorder {
+public:
+    /**
+     * @brief Constructor
+     * @param path Output file, created on the first connection
+     */
+    explicit FbsRecorder(const char* path);
+    ~FbsRecorder() override;
+
+    void session_start(void) override;
+    void record(const uint8_t* data, size_t len) override;
+    void session_end(void) override;
+
+    /**
+     * @brief Check if the output could not be written
+     */
+    bool failed() const { return _failed; }
+
+    /**
+     * @brief Number of payload bytes recorded
+     */
+    uint64_t bytes() const { return _bytes; }
+
+private:
+    void close();
+
+    const char* _path;
+    FILE* _file;
+    bool _done;
+    bool _failed;
+    unsigned long _start;
+    uint64_t _bytes;
+};
+
+#endif // FBSRECORDER_H
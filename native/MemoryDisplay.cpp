@@ -0,0 +1,160 @@
+/**
+ * @file MemoryDisplay.cpp
+ * @brief In-memory VNC display for the native (Linux) build
+ */
+
+#include "MemoryDisplay.h"
+
+#include <setjmp.h>
+// rfbproto.h already defines INT32
+#define XMD_H
+#include <jpeglib.h>
+
+MemoryDisplay::MemoryDisplay(uint32_t width, uint32_t height)
+    : _width(width)
+    , _height(height)
+    , _stats()
+    , _updateX(0)
+    , _updateY(0)
+    , _updateW(0)
+    , _updateH(0)
+    , _updateCol(0)
+    , _updateRow(0)
+{
+    _fb.begin(width, height);
+    memset(_fb.getPtr(), 0, _fb.currentSize());
+}
+
+void MemoryDisplay::draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t* data) {
+    _fb.draw_area(x, y, w, h, data);
+    _stats.rects++;
+    _stats.pixels += (uint64_t)w * h;
+}
+
+void MemoryDisplay::draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color) {
+    // the framebuffer keeps pixels in the negotiated byte order
+    _fb.draw_rect(x, y, w, h, SwapPixel(color));
+    _stats.rects++;
+    _stats.pixels += (uint64_t)w * h;
+}
+
+void MemoryDisplay::copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h) {
+    _fb.copy_rect(src_x, src_y, dest_x, dest_y, w, h);
+    _stats.rects++;
+    _stats.pixels += (uint64_t)w * h;
+}
+
+struct JpegError {
+    struct jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    longjmp(((JpegError*)cinfo->err)->jump, 1);
+}
+
+bool MemoryDisplay::draw_jpeg(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t* data, size_t len) {
+    struct jpeg_decompress_struct cinfo;
+    JpegError err;
+    uint8_t* rgb = nullptr;
+    uint16_t* row = nullptr;
+
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = jpeg_error_exit;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        free(rgb);
+        free(row);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, data, len);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    rgb = (uint8_t*)malloc(cinfo.output_width * 3);
+    row = (uint16_t*)malloc(cinfo.output_width * 2);
+    if (!rgb || !row) {
+        longjmp(err.jump, 1);
+    }
+
+    // RGB888 to RGB565 in the negotiated byte order, clipped to the rect
+    uint32_t cw = min(w, (uint32_t)cinfo.output_width);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        uint32_t line = cinfo.output_scanline;
+        jpeg_read_scanlines(&cinfo, &rgb, 1);
+        if (line >= h) continue;
+        for (uint32_t i = 0; i < cw; i++) {
+            const uint8_t* c = &rgb[i * 3];
+            row[i] = SwapPixel((uint16_t)(((c[0] & 0xF8) << 8) | ((c[1] & 0xFC) << 3) | (c[2] >> 3)));
+        }
+        _fb.draw_area(x, y + line, cw, 1, (const uint8_t*)row);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    free(rgb);
+    free(row);
+
+    _stats.rects++;
+    _stats.pixels += (uint64_t)w * h;
+    return true;
+}
+
+void MemoryDisplay::area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    _updateX = x;
+    _updateY = y;
+    _updateW = w;
+    _updateH = h;
+    _updateCol = 0;
+    _updateRow = 0;
+    _stats.rects++;
+}
+
+void MemoryDisplay::area_update_data(char* data, uint32_t pixel) {
+    const uint8_t* src = (const uint8_t*)data;
+    while (pixel && _updateRow < _updateH) {
+        uint32_t span = min(pixel, _updateW - _updateCol);
+        _fb.draw_area(_updateX + _updateCol, _updateY + _updateRow, span, 1, src);
+        _stats.pixels += span;
+        src += span * 2;
+        pixel -= span;
+        _updateCol += span;
+        if (_updateCol == _updateW) {
+            _updateCol = 0;
+            _updateRow++;
+        }
+    }
+}
+
+void MemoryDisplay::area_update_end(void) {
+    _updateCol = 0;
+    _updateRow = 0;
+}
+
+uint16_t MemoryDisplay::getPixel(uint32_t x, uint32_t y) {
+    uint16_t pixel;
+    memcpy(&pixel, _fb.getPtr(x, y), sizeof(pixel));
+    return SwapPixel(pixel);
+}
+
+bool MemoryDisplay::savePPM(const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+
+    fprintf(f, "P6\n%u %u\n255\n", _width, _height);
+    for (uint32_t y = 0; y < _height; y++) {
+        for (uint32_t x = 0; x < _width; x++) {
+            uint16_t c = getPixel(x, y);
+            uint8_t rgb[3] = {
+                (uint8_t)(((c >> 11) & 0x1F) << 3),
+                (uint8_t)(((c >> 5) & 0x3F) << 2),
+                (uint8_t)((c & 0x1F) << 3)
+            };
+            fwrite(rgb, 1, sizeof(rgb), f);
+        }
+    }
+    return fclose(f) == 0;
+}
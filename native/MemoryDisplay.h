@@ -0,0 +1,90 @@
+/**
+ * @file MemoryDisplay.h
+ * @brief In-memory VNC display for the native (Linux) build
+ *
+ * Implements the VNCdisplay interface on a FrameBuffer, so arduinoVNC and
+ * its decoders can run on a host without a panel. Counts what it is asked
+ * to draw and can dump the framebuffer as a PPM image.
+ */
+
+#pragma once
+
+#ifndef MEMORYDISPLAY_H
+#define MEMORYDISPLAY_H
+
+#include "VNC.h"
+#include "frameBuffer.h"
+
+/**
+ * @struct MemoryDisplayStats
+ * @brief Counters of the in-memory display
+ */
+struct MemoryDisplayStats {
+    uint32_t updates;   ///< FramebufferUpdate messages completed
+    uint32_t rects;     ///< draw_area/draw_rect/copy_rect/area_update calls
+    uint64_t pixels;    ///< Pixels written
+};
+
+class MemoryDisplay : public VNCdisplay {
+public:
+    /**
+     * @brief Constructor
+     * @param width Display width in pixels
+     * @param height Display height in pixels
+     */
+    MemoryDisplay(uint32_t width, uint32_t height);
+
+    bool hasCopyRect(void) override { return true; }
+    uint32_t getHeight(void) override { return _height; }
+    uint32_t getWidth(void) override { return _width; }
+
+    void draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t* data) override;
+    void draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color) override;
+    void copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h) override;
+
+    void area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h) override;
+    void area_update_data(char* data, uint32_t pixel) override;
+    void area_update_end(void) override;
+
+    bool hasJpeg(void) override { return true; }
+    bool draw_jpeg(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t* data, size_t len) override;
+
+    void framebuffer_update_end(void) override { _stats.updates++; }
+
+    /**
+     * @brief Get the counters
+     */
+    const MemoryDisplayStats& getStats() const { return _stats; }
+
+    /**
+     * @brief Native RGB565 value of a pixel
+     */
+    uint16_t getPixel(uint32_t x, uint32_t y);
+
+    /**
+     * @brief Write the framebuffer as binary PPM (P6)
+     * @return false if the file could not be written
+     */
+    bool savePPM(const char* path);
+
+protected:
+    /**
+     * @brief Framebuffer the decoders draw into, in the negotiated byte order
+     */
+    FrameBuffer& frameBuffer() { return _fb; }
+
+private:
+    uint32_t _width;
+    uint32_t _height;
+    FrameBuffer _fb;
+    MemoryDisplayStats _stats;
+
+    uint32_t _updateX;
+    uint32_t _updateY;
+    uint32_t _updateW;
+    uint32_t _updateH;
+    uint32_t _updateCol;
+    uint32_t _updateRow;
+};
+
+#endif // MEMORYDISPLAY_H
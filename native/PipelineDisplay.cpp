@@ -0,0 +1,165 @@
+/**
+ * @file PipelineDisplay.cpp
+ * @brief Host build of the decode/present pipeline of the Tab5 driver
+ */
+
+#include "PipelineDisplay.h"
+
+#include <chrono>
+
+PipelineDisplay::PipelineDisplay(uint32_t width, uint32_t height)
+    : MemoryDisplay(width, height)
+    , _area()
+    , _inUpdate(false)
+    , _backlog(0)
+    , _panelRate(0)
+    , _notified(false)
+    , _stopping(false)
+    , _pipelineStats()
+{
+}
+
+PipelineDisplay::~PipelineDisplay() {
+    stop();
+}
+
+void PipelineDisplay::start(double panelRate) {
+    if (_thread.joinable()) return;
+    if (!_panel.getPtr()) {
+        _panel.begin(getWidth(), getHeight());
+        memset(_panel.getPtr(), 0, _panel.currentSize());
+    }
+    _panelRate = panelRate;
+    _stopping = false;
+    _thread = std::thread(&PipelineDisplay::run, this);
+}
+
+void PipelineDisplay::stop() {
+    if (!_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_one();
+    _thread.join();
+}
+
+void PipelineDisplay::draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t* data) {
+    MemoryDisplay::draw_area(x, y, w, h, data);
+    markDirty(x, y, w, h);
+}
+
+void PipelineDisplay::draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color) {
+    MemoryDisplay::draw_rect(x, y, w, h, color);
+    markDirty(x, y, w, h);
+}
+
+void PipelineDisplay::copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h) {
+    MemoryDisplay::copy_rect(src_x, src_y, dest_x, dest_y, w, h);
+    markDirty(dest_x, dest_y, w, h);
+}
+
+bool PipelineDisplay::draw_jpeg(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t* data, size_t len) {
+    if (!MemoryDisplay::draw_jpeg(x, y, w, h, data, len)) {
+        return false;
+    }
+    markDirty(x, y, w, h);
+    return true;
+}
+
+void PipelineDisplay::area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    MemoryDisplay::area_update_start(x, y, w, h);
+    _area = { x, y, w, h };
+}
+
+void PipelineDisplay::area_update_end(void) {
+    MemoryDisplay::area_update_end();
+    markDirty(_area.x, _area.y, _area.w, _area.h);
+}
+
+void PipelineDisplay::framebuffer_update_start(void) {
+    _inUpdate = true;
+}
+
+void PipelineDisplay::framebuffer_update_end(void) {
+    MemoryDisplay::framebuffer_update_end();
+    _inUpdate = false;
+    flush();
+}
+
+uint16_t PipelineDisplay::getPanelPixel(uint32_t x, uint32_t y) {
+    uint16_t pixel;
+    memcpy(&pixel, _panel.getPtr(x, y), sizeof(pixel));
+    return SwapPixel(pixel);
+}
+
+void PipelineDisplay::markDirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (!_thread.joinable()) return;
+    _dirty.add(x, y, w, h);
+    if (!_inUpdate) {
+        flush();
+    }
+}
+
+void PipelineDisplay::flush() {
+    if (_dirty.isEmpty()) return;
+
+    for (uint8_t i = 0; i < _dirty.count(); i++) {
+        // a full queue means the panel is the bottleneck, wait for it
+        while (!_queue.push(_dirty.rect(i))) {
+            _pipelineStats.stalls++;
+            notify();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        _pipelineStats.queued++;
+        _backlog++;
+    }
+    _pipelineStats.maxDepth = max(_pipelineStats.maxDepth, _queue.size());
+    _dirty.flushed();
+    notify();
+}
+
+void PipelineDisplay::notify() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _notified = true;
+    }
+    _wake.notify_one();
+}
+
+void PipelineDisplay::run() {
+    while (true) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this] { return _notified || _stopping; });
+            _notified = false;
+            stopping = _stopping;
+        }
+        present();
+        if (stopping) break;
+    }
+}
+
+void PipelineDisplay::present() {
+    FrameBuffer& shadow = frameBuffer();
+
+    // The decode thread may already be writing newer pixels into a region
+    // while it is copied here; that region is queued again by its flush.
+    DirtyRect r;
+    while (_queue.pop(r)) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t row = 0; row < r.h; row++) {
+            _panel.draw_area(r.x, r.y + row, r.w, 1, shadow.getPtr(r.x, r.y + row));
+        }
+        if (_panelRate > 0) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds((uint64_t)(r.w * r.h / _panelRate)));
+        }
+        uint32_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        _pipelineStats.presented++;
+        _pipelineStats.writeUs += us;
+        _pipelineStats.maxWriteUs = max(_pipelineStats.maxWriteUs, us);
+        _backlog--;
+    }
+}
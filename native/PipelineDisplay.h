@@ -0,0 +1,120 @@
+/**
+ * @file PipelineDisplay.h
+ * @brief Host build of the decode/present pipeline of the Tab5 driver
+ *
+ * Works like M5GFX_VNCDriver with the shadow framebuffer and a present task.
+ * Decoders draw into the shadow, and the rects of an update are merged in
+ * a DirtyRegion. At the end of the update they go through a RingQueue to a
+ * present thread, which copies them to a second framebuffer standing in
+ * for the panel. The panel can be given a speed, so queue depth and decode
+ * stalls can be measured against a transfer slower than the host. Until
+ * start() it draws like a MemoryDisplay.
+ */
+
+#pragma once
+
+#ifndef PIPELINEDISPLAY_H
+#define PIPELINEDISPLAY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "MemoryDisplay.h"
+#include "DirtyRegion.h"
+#include "RingQueue.h"
+
+/**
+ * @struct PipelineStats
+ * @brief Counters of the present queue, as PresentStats of the driver
+ */
+struct PipelineStats {
+    uint32_t queued;     ///< Regions handed to the present thread
+    uint32_t presented;  ///< Regions copied to the panel
+    uint32_t stalls;     ///< Times the decode thread waited on a full queue
+    uint32_t maxDepth;   ///< Highest queue depth seen
+    uint64_t writeUs;    ///< Time spent copying to the panel
+    uint32_t maxWriteUs; ///< Longest single copy
+};
+
+class PipelineDisplay : public MemoryDisplay {
+public:
+    /**
+     * @brief Constructor
+     * @param width Display width in pixels
+     * @param height Display height in pixels
+     */
+    PipelineDisplay(uint32_t width, uint32_t height);
+    ~PipelineDisplay();
+
+    /**
+     * @brief Start the present thread
+     * @param panelRate Panel speed in Mpixel/s, 0 copies as fast as the host can
+     */
+    void start(double panelRate);
+
+    /**
+     * @brief Present what is still queued and stop the present thread
+     */
+    void stop();
+
+    void draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t* data) override;
+    void draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color) override;
+    void copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h) override;
+    bool draw_jpeg(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t* data, size_t len) override;
+    void area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h) override;
+    void area_update_end(void) override;
+
+    void framebuffer_update_start(void) override;
+    void framebuffer_update_end(void) override;
+    uint32_t present_backlog(void) override { return _backlog; }
+
+    /**
+     * @brief Native RGB565 value of a pixel on the panel, after start()
+     */
+    uint16_t getPanelPixel(uint32_t x, uint32_t y);
+
+    /**
+     * @brief Get the counters of the present queue
+     *
+     * The present thread updates them until stop().
+     */
+    const PipelineStats& getPipelineStats() const { return _pipelineStats; }
+
+    /**
+     * @brief Get the counters of the dirty rectangle tracker
+     */
+    const DirtyStats& getDirtyStats() const { return _dirty.stats(); }
+
+private:
+    /// record a changed region of the shadow, decode thread
+    void markDirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
+    /// queue the dirty regions for the present thread, decode thread
+    void flush();
+
+    /// wake the present thread
+    void notify();
+
+    /// body of the present thread
+    void run();
+
+    /// copy the queued regions to the panel, present thread
+    void present();
+
+    FrameBuffer _panel;         ///< Stands in for the panel
+    DirtyRegion _dirty;         ///< Regions of the shadow not yet queued
+    DirtyRect _area;            ///< Current area update
+    bool _inUpdate;             ///< Inside a FramebufferUpdate message
+    RingQueue<DirtyRect, 64> _queue;    ///< Regions waiting for the present thread
+    std::atomic<uint32_t> _backlog;     ///< Queued regions not yet on the panel
+    double _panelRate;          ///< Panel speed in Mpixel/s, 0 = unlimited
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _notified;             ///< Guarded by _mutex, like a task notification
+    bool _stopping;             ///< Guarded by _mutex
+    PipelineStats _pipelineStats;
+};
+
+#endif // PIPELINEDISPLAY_H
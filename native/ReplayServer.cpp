@@ -0,0 +1,172 @@
+/**
+ * @file ReplayServer.cpp
+ * @brief Local server replaying a recorded FBS session
+ */
+
+#include "ReplayServer.h"
+#include "FbsRecorder.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static uint32_t read_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+ReplayServer::ReplayServer()
+    : _listenFd(-1)
+    , _paced(false)
+    , _finished(false)
+{
+}
+
+ReplayServer::~ReplayServer() {
+    wait();
+    if (_listenFd >= 0) {
+        close(_listenFd);
+    }
+}
+
+bool ReplayServer::load(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+
+    std::vector<uint8_t> file;
+    uint8_t chunk[64 * 1024];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        file.insert(file.end(), chunk, chunk + len);
+    }
+    fclose(f);
+
+    if (file.size() < FBS_VERSION_LEN || memcmp(file.data(), "FBS 001.", 8) != 0) {
+        fprintf(stderr, "%s: not an FBS 001 file\n", path);
+        return false;
+    }
+
+    // keep the payload contiguous, blocks only index into it
+    _data.clear();
+    _blocks.clear();
+    size_t pos = FBS_VERSION_LEN;
+    while (pos + 4 <= file.size()) {
+        size_t length = read_be32(&file[pos]);
+        size_t padded = (length + 3) & ~(size_t)3;
+        if (pos + 4 + padded + 4 > file.size()) {
+            fprintf(stderr, "%s: truncated block at %zu\n", path, pos);
+            return false;
+        }
+        Block block = { _data.size(), length, read_be32(&file[pos + 4 + padded]) };
+        _data.insert(_data.end(), &file[pos + 4], &file[pos + 4 + length]);
+        _blocks.push_back(block);
+        pos += 4 + padded + 4;
+    }
+    return !_blocks.empty();
+}
+
+void ReplayServer::addBlock(const uint8_t* data, size_t length, uint32_t timestamp) {
+    Block block = { _data.size(), length, timestamp };
+    _data.insert(_data.end(), data, data + length);
+    _blocks.push_back(block);
+}
+
+uint16_t ReplayServer::start(bool paced) {
+    struct sockaddr_in addr = {};
+    socklen_t addrlen = sizeof(addr);
+
+    _paced = paced;
+    _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listenFd < 0) return 0;
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(_listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(_listenFd, 1) < 0 ||
+        getsockname(_listenFd, (struct sockaddr*)&addr, &addrlen) < 0) {
+        close(_listenFd);
+        _listenFd = -1;
+        return 0;
+    }
+
+    _thread = std::thread(&ReplayServer::serve, this);
+    return ntohs(addr.sin_port);
+}
+
+void ReplayServer::wait() {
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+/**
+ * read the client messages and keep them
+ * @return false once the client has closed the connection
+ */
+bool ReplayServer::drain(int fd, int timeout) {
+    uint8_t buf[4096];
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while (poll(&pfd, 1, timeout) > 0) {
+        ssize_t len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len <= 0) return false;
+        _client.insert(_client.end(), buf, buf + len);
+        timeout = 0;
+    }
+    return true;
+}
+
+void ReplayServer::serve() {
+    int fd = accept(_listenFd, nullptr, nullptr);
+    close(_listenFd);
+    _listenFd = -1;
+    if (fd < 0) {
+        _finished = true;
+        return;
+    }
+
+    uint64_t start = now_ms();
+    for (const Block& block : _blocks) {
+        if (_paced) {
+            while (now_ms() - start < block.timestamp) {
+                if (!drain(fd, 1)) break;
+            }
+        }
+
+        const uint8_t* p = &_data[block.offset];
+        size_t left = block.length;
+        while (left) {
+            // never block on a full send buffer while the client waits for
+            // us to read its requests
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            poll(&pfd, 1, 10);
+            if (!drain(fd, 0)) {
+                left = 0;
+                break;
+            }
+            ssize_t len = send(fd, p, left, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (len > 0) {
+                p += len;
+                left -= len;
+            }
+        }
+    }
+
+    // a close with unread client data would reset the connection and drop
+    // the tail of the stream, so only half-close and wait for the client
+    shutdown(fd, SHUT_WR);
+    _finished = true;
+    while (drain(fd, 100)) {
+    }
+    close(fd);
+}
@@ -0,0 +1,97 @@
+/**
+ * @file ReplayServer.h
+ * @brief Local server replaying a recorded FBS session
+ *
+ * Listens on a loopback port and sends the recorded server byte stream to
+ * the first client that connects, either at the recorded pace or as fast as
+ * the client reads it. Whatever the client sends is read and kept aside, it
+ * never changes what is sent, so the same recording drives every run with
+ * identical input. Sessions can also be put together in memory.
+ */
+
+#pragma once
+
+#ifndef REPLAYSERVER_H
+#define REPLAYSERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ReplayServer
+ * @brief Single-client FBS replay on 127.0.0.1
+ */
+class ReplayServer {
+public:
+    ReplayServer();
+    ~ReplayServer();
+
+    /**
+     * @brief Read an FBS file into memory
+     * @return false if the file is missing or malformed
+     */
+    bool load(const char* path);
+
+    /**
+     * @brief Append a block of server data
+     * @param timestamp Milliseconds since the session start, not before the last block
+     *
+     * Used to build a session in memory instead of loading it, before start().
+     */
+    void addBlock(const uint8_t* data, size_t length, uint32_t timestamp);
+
+    /**
+     * @brief Start listening and serve one client in a thread
+     * @param paced true to keep the recorded timing, false for full speed
+     * @return The port to connect to, 0 on error
+     */
+    uint16_t start(bool paced);
+
+    /**
+     * @brief Check if the whole recording has been sent
+     */
+    bool finished() const { return _finished; }
+
+    /**
+     * @brief Wait until the client has closed the connection
+     */
+    void wait();
+
+    /**
+     * @brief Everything the client sent, complete after wait()
+     */
+    const std::vector<uint8_t>& clientData() const { return _client; }
+
+    /**
+     * @brief Size of the recorded stream in bytes
+     */
+    uint64_t bytes() const { return _data.size(); }
+
+    /**
+     * @brief Duration of the recording in milliseconds
+     */
+    uint32_t duration() const { return _blocks.empty() ? 0 : _blocks.back().timestamp; }
+
+private:
+    struct Block {
+        size_t offset;      ///< Start of the data in _data
+        size_t length;      ///< Payload length
+        uint32_t timestamp; ///< Milliseconds since the session start
+    };
+
+    void serve();
+    bool drain(int fd, int timeout);
+
+    std::vector<uint8_t> _data;
+    std::vector<Block> _blocks;
+    std::vector<uint8_t> _client;
+    int _listenFd;
+    bool _paced;
+    std::thread _thread;
+    std::atomic<bool> _finished;
+};
+
+#endif // REPLAYSERVER_H
@@ -0,0 +1,784 @@
+/**
+ * @file SessionBuilder.cpp
+ * @brief Server side of a synthetic RFB session for the native build
+ */
+
+#include "SessionBuilder.h"
+
+#include <string.h>
+#include "VNC.h"
+#ifdef VNC_TIGHT
+// rfbproto.h already defines INT32
+#define XMD_H
+#include <jpeglib.h>
+#endif
+
+/// the value the client keeps in memory, in its negotiated byte order
+static void append_pixel(std::vector<uint8_t>& out, uint16_t color) {
+    uint16_t wire = SwapPixel(color);
+    const uint8_t* p = (const uint8_t*)&wire;
+    out.insert(out.end(), p, p + 2);
+}
+
+static void append_be16(std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+/**
+ * collect the colors of a rect
+ * @return number of colors, max + 1 if there are more than max
+ */
+static size_t collect_palette(const uint16_t* pixels, uint32_t stride, uint16_t w, uint16_t h, uint16_t* palette, size_t max) {
+    size_t n = 0;
+    for (uint16_t y = 0; y < h; y++) {
+        for (uint16_t x = 0; x < w; x++) {
+            uint16_t c = pixels[y * stride + x];
+            size_t i = 0;
+            while (i < n && palette[i] != c) i++;
+            if (i < n) continue;
+            if (n == max) return max + 1;
+            palette[n++] = c;
+        }
+    }
+    return n;
+}
+
+static uint8_t palette_index(const uint16_t* palette, size_t n, uint16_t c) {
+    size_t i = 0;
+    while (i < n - 1 && palette[i] != c) i++;
+    return i;
+}
+
+/// ZRLE run length: length - 1 in bytes of 255 and a last smaller one
+static void append_run_length(std::vector<uint8_t>& out, size_t length) {
+    length--;
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(length);
+}
+
+static size_t run_length_bytes(size_t length) {
+    return (length - 1) / 255 + 1;
+}
+
+SessionBuilder::SessionBuilder(ReplayServer& server, uint16_t width, uint16_t height)
+    : _server(server)
+    , _width(width)
+    , _height(height)
+    , _flushed(0)
+    , _updateStart(0)
+    , _updateRects(0)
+    , _quality(99)
+{
+    memset(_streams, 0, sizeof(_streams));
+    memset(_streamOpen, 0, sizeof(_streamOpen));
+}
+
+SessionBuilder::~SessionBuilder() {
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (_streamOpen[i]) {
+            deflateEnd(&_streams[i]);
+        }
+    }
+}
+
+void SessionBuilder::handshake(const char* name) {
+    const char* version = "RFB 003.008\n";
+    _pending.insert(_pending.end(), version, version + 12);
+
+    // one security type, None, and its result
+    put8(1);
+    put8(rfbSecTypeNone);
+    put32(0);
+
+    put16(_width);
+    put16(_height);
+    // the client replaces the pixel format with its own before any update
+    put8(16);
+    put8(16);
+    put8(1);
+    put8(1);
+    put16(31);
+    put16(63);
+    put16(31);
+    put8(11);
+    put8(5);
+    put8(0);
+    put8(0);
+    put16(0);
+
+    size_t len = strlen(name);
+    put32(len);
+    _pending.insert(_pending.end(), name, name + len);
+}
+
+void SessionBuilder::beginUpdate() {
+    put8(rfbFramebufferUpdate);
+    put8(0);
+    _updateStart = _pending.size();
+    _updateRects = 0;
+    put16(0);
+}
+
+void SessionBuilder::endUpdate() {
+    _pending[_updateStart] = _updateRects >> 8;
+    _pending[_updateStart + 1] = _updateRects;
+}
+
+bool SessionBuilder::rect(int32_t encoding, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride) {
+    switch (encoding) {
+        case rfbEncodingRaw: raw(x, y, w, h, pixels, stride); break;
+        case rfbEncodingRRE: rre(x, y, w, h, pixels, stride, false); break;
+        case rfbEncodingCoRRE: rre(x, y, w, h, pixels, stride, true); break;
+        case rfbEncodingHextile: hextile(x, y, w, h, pixels, stride, false); break;
+#ifdef VNC_ZLIBHEX
+        case rfbEncodingZlibHex: hextile(x, y, w, h, pixels, stride, true); break;
+#endif
+        case rfbEncodingZlib: zlibRect(x, y, w, h, pixels, stride); break;
+#ifdef VNC_TIGHT
+        case rfbEncodingTight: tight(x, y, w, h, pixels, stride); break;
+#endif
+        case rfbEncodingZRLE: zrle(x, y, w, h, pixels, stride, 0); break;
+#ifdef VNC_ZYWRLE
+        case rfbEncodingZYWRLE: zrle(x, y, w, h, pixels, stride, vnc_zywrle_level(_quality)); break;
+#endif
+        default: return false;
+    }
+    return true;
+}
+
+void SessionBuilder::copyRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t src_x, uint16_t src_y) {
+    putRect(x, y, w, h, rfbEncodingCopyRect);
+    put16(src_x);
+    put16(src_y);
+}
+
+void SessionBuilder::flush(uint32_t timestamp) {
+    _server.addBlock(_pending.data(), _pending.size(), timestamp);
+    _flushed += _pending.size();
+    _pending.clear();
+}
+
+void SessionBuilder::put8(uint8_t v) {
+    _pending.push_back(v);
+}
+
+void SessionBuilder::put16(uint16_t v) {
+    put8(v >> 8);
+    put8(v);
+}
+
+void SessionBuilder::put32(uint32_t v) {
+    put16(v >> 16);
+    put16(v);
+}
+
+void SessionBuilder::putBytes(const std::vector<uint8_t>& data) {
+    _pending.insert(_pending.end(), data.begin(), data.end());
+}
+
+void SessionBuilder::putRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, int32_t encoding) {
+    put16(x);
+    put16(y);
+    put16(w);
+    put16(h);
+    put32(encoding);
+    _updateRects++;
+}
+
+void SessionBuilder::raw(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride) {
+    putRect(x, y, w, h, rfbEncodingRaw);
+    for (uint16_t row = 0; row < h; row++) {
+        for (uint16_t i = 0; i < w; i++) {
+            append_pixel(_pending, pixels[row * stride + i]);
+        }
+    }
+}
+
+/**
+ * the first pixel is the background, every horizontal run of another
+ * color becomes a subrect of height 1
+ */
+void SessionBuilder::rre(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride, bool compact) {
+    if (compact && (w > 255 || h > 255)) {
+        for (uint16_t cy = 0; cy < h; cy += 255) {
+            for (uint16_t cx = 0; cx < w; cx += 255) {
+                rre(x + cx, y + cy, min(w - cx, 255), min(h - cy, 255), pixels + cy * stride + cx, stride, true);
+            }
+        }
+        return;
+    }
+
+    uint16_t bg = pixels[0];
+    std::vector<uint8_t> subrects;
+    uint32_t count = 0;
+
+    for (uint16_t row = 0; row < h; row++) {
+        const uint16_t* p = pixels + row * stride;
+        for (uint16_t i = 0; i < w;) {
+            uint16_t len = 1;
+            while (i + len < w && p[i + len] == p[i]) len++;
+            if (p[i] != bg) {
+                append_pixel(subrects, p[i]);
+                if (compact) {
+                    subrects.push_back(i);
+                    subrects.push_back(row);
+                    subrects.push_back(len);
+                    subrects.push_back(1);
+                } else {
+                    append_be16(subrects, i);
+                    append_be16(subrects, row);
+                    append_be16(subrects, len);
+                    append_be16(subrects, 1);
+                }
+                count++;
+            }
+            i += len;
+        }
+    }
+
+    putRect(x, y, w, h, compact ? rfbEncodingCoRRE : rfbEncodingRRE);
+    put32(count);
+    append_pixel(_pending, bg);
+    putBytes(subrects);
+}
+
+void SessionBuilder::hextile(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride, bool zlib) {
+    putRect(x, y, w, h, zlib ? rfbEncodingZlibHex : rfbEncodingHextile);
+    for (uint16_t ty = 0; ty < h; ty += 16) {
+        for (uint16_t tx = 0; tx < w; tx += 16) {
+            hextileTile(pixels + ty * stride + tx, stride, min(w - tx, 16), min(h - ty, 16), zlib);
+        }
+    }
+}
+
+/**
+ * one color: background only, two: foreground subrects, more: colored
+ * subrects unless raw is smaller. Every tile names its background.
+ */
+void SessionBuilder::hextileTile(const uint16_t* pixels, uint32_t stride, uint16_t w, uint16_t h, bool zlib) {
+    uint16_t palette[3];
+    size_t colors = collect_palette(pixels, stride, w, h, palette, 2);
+    uint16_t bg = pixels[0];
+    uint8_t flags = rfbHextileBackgroundSpecified;
+    std::vector<uint8_t> body;
+    std::vector<uint8_t> subrects;
+    size_t count = 0;
+
+    append_pixel(body, bg);
+    if (colors > 1) {
+        for (uint16_t row = 0; row < h; row++) {
+            const uint16_t* p = pixels + row * stride;
+            for (uint16_t i = 0; i < w;) {
+                uint16_t len = 1;
+                while (i + len < w && p[i + len] == p[i]) len++;
+                if (p[i] != bg) {
+                    if (colors > 2) {
+                        append_pixel(subrects, p[i]);
+                    }
+                    subrects.push_back(rfbHextilePackXY(i, row));
+                    subrects.push_back(rfbHextilePackWH(len, 1));
+                    count++;
+                }
+                i += len;
+            }
+        }
+
+        flags |= rfbHextileAnySubrects;
+        if (colors == 2) {
+            flags |= rfbHextileForegroundSpecified;
+            append_pixel(body, palette[0] == bg ? palette[1] : palette[0]);
+        } else {
+            flags |= rfbHextileSubrectsColoured;
+        }
+        body.push_back(count);
+        body.insert(body.end(), subrects.begin(), subrects.end());
+    }
+
+    if (count > 255 || body.size() >= (size_t)w * h * 2) {
+        flags = rfbHextileRaw;
+        body.clear();
+        for (uint16_t row = 0; row < h; row++) {
+            for (uint16_t i = 0; i < w; i++) {
+                append_pixel(body, pixels[row * stride + i]);
+            }
+        }
+    }
+
+#ifdef VNC_ZLIBHEX
+    // ZlibHex compresses raw tiles and subrect lists in separate streams
+    if (zlib && (flags == rfbHextileRaw || count)) {
+        bool isRaw = flags == rfbHextileRaw;
+        std::vector<uint8_t> data = deflateSync(isRaw ? STREAM_ZLIBHEX_RAW : STREAM_ZLIBHEX, body);
+        put8(isRaw ? rfbHextileZlibRaw : (flags | rfbHextileZlibHex));
+        put16(data.size());
+        putBytes(data);
+        return;
+    }
+#endif
+
+    put8(flags);
+    putBytes(body);
+}
+
+void SessionBuilder::zlibRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride) {
+    std::vector<uint8_t> data;
+    for (uint16_t row = 0; row < h; row++) {
+        for (uint16_t i = 0; i < w; i++) {
+            append_pixel(data, pixels[row * stride + i]);
+        }
+    }
+    data = deflateSync(STREAM_ZLIB, data);
+
+    putRect(x, y, w, h, rfbEncodingZlib);
+    put32(data.size());
+    putBytes(data);
+}
+
+#ifdef VNC_TIGHT
+/// libjpeg quality and chroma subsampling for the quality levels, as TigerVNC picks them
+static const struct {
+    int quality;
+    int subsampling;
+} tight_jpeg_levels[10] = {
+    { 15, 2 }, { 29, 2 }, { 41, 2 }, { 42, 1 }, { 62, 1 },
+    { 77, 1 }, { 79, 0 }, { 86, 0 }, { 92, 0 }, { 100, 0 },
+};
+
+/**
+ * the components of each pixel as the difference to the prediction
+ * left + above - above left, the row above the rect predicted as black
+ * @return sum of the absolute differences
+ */
+static uint32_t tight_gradient(std::vector<uint8_t>& out, const uint16_t* pixels, uint32_t stride, uint16_t w, uint16_t h) {
+    static const int max[3] = { 31, 63, 31 };
+    static const int shift[3] = { 11, 5, 0 };
+    uint32_t error = 0;
+
+    for (uint16_t y = 0; y < h; y++) {
+        for (uint16_t x = 0; x < w; x++) {
+            uint16_t diff = 0;
+            for (int c = 0; c < 3; c++) {
+                int left = x ? (pixels[y * stride + x - 1] >> shift[c]) & max[c] : 0;
+                int above = y ? (pixels[(y - 1) * stride + x] >> shift[c]) & max[c] : 0;
+                int upleft = (x && y) ? (pixels[(y - 1) * stride + x - 1] >> shift[c]) & max[c] : 0;
+                int est = above + left - upleft;
+                if (est < 0) {
+                    est = 0;
+                } else if (est > max[c]) {
+                    est = max[c];
+                }
+                int d = ((pixels[y * stride + x] >> shift[c]) & max[c]) - est;
+                error += abs(d);
+                diff |= (d & max[c]) << shift[c];
+            }
+            append_pixel(out, diff);
+        }
+    }
+    return error;
+}
+
+/**
+ * one color: fill, up to 16: palette filter. More go as JPEG when the
+ * client asked for a quality, else with the gradient filter if the rect is
+ * smooth, else with the copy filter.
+ */
+void SessionBuilder::tight(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride) {
+    uint16_t palette[17];
+    size_t colors = collect_palette(pixels, stride, w, h, palette, 16);
+    std::vector<uint8_t> data;
+
+    putRect(x, y, w, h, rfbEncodingTight);
+
+    if (colors == 1) {
+        put8(rfbTightFill << 4);
+        append_pixel(_pending, palette[0]);
+        return;
+    }
+
+    if (colors <= 16) {
+        put8((rfbTightExplicitFilter | 1) << 4);
+        put8(rfbTightFilterPalette);
+        put8(colors - 1);
+        for (size_t i = 0; i < colors; i++) {
+            append_pixel(_pending, palette[i]);
+        }
+        for (uint16_t row = 0; row < h; row++) {
+            const uint16_t* p = pixels + row * stride;
+            if (colors == 2) {
+                // a bit per pixel, rows start on a new byte
+                for (uint16_t i = 0; i < w; i += 8) {
+                    uint8_t bits = 0;
+                    for (uint16_t b = 0; b < 8 && i + b < w; b++) {
+                        bits |= palette_index(palette, colors, p[i + b]) << (7 - b);
+                    }
+                    data.push_back(bits);
+                }
+            } else {
+                for (uint16_t i = 0; i < w; i++) {
+                    data.push_back(palette_index(palette, colors, p[i]));
+                }
+            }
+        }
+        tightData(STREAM_TIGHT_PALETTE, data);
+        return;
+    }
+
+    if (_quality <= 9) {
+        tightJpeg(pixels, stride, w, h);
+        return;
+    }
+
+    // smooth: the prediction is off by less than 2 steps per component on average
+    if (tight_gradient(data, pixels, stride, w, h) < (uint32_t)w * h * 3 * 2) {
+        put8((rfbTightExplicitFilter | 3) << 4);
+        put8(rfbTightFilterGradient);
+        tightData(STREAM_TIGHT_GRADIENT, data);
+        return;
+    }
+
+    data.clear();
+    put8(0);
+    for (uint16_t row = 0; row < h; row++) {
+        for (uint16_t i = 0; i < w; i++) {
+            append_pixel(data, pixels[row * stride + i]);
+        }
+    }
+    tightData(STREAM_TIGHT_COPY, data);
+}
+
+/**
+ * data below 12 bytes is sent as it is, more is compressed and
+ * preceded by its length
+ */
+void SessionBuilder::tightData(Stream stream, const std::vector<uint8_t>& data) {
+    if (data.size() < 12) {
+        putBytes(data);
+        return;
+    }
+
+    std::vector<uint8_t> compressed = deflateSync(stream, data);
+    putCompactLength(compressed.size());
+    putBytes(compressed);
+}
+
+/**
+ * the rect as a baseline JPEG of the components widened to 8 bits
+ */
+void SessionBuilder::tightJpeg(const uint16_t* pixels, uint32_t stride, uint16_t w, uint16_t h) {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr err;
+    unsigned char* jpeg = nullptr;
+    unsigned long len = 0;
+    std::vector<uint8_t> rgb((size_t)w * 3);
+
+    cinfo.err = jpeg_std_error(&err);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &jpeg, &len);
+    cinfo.image_width = w;
+    cinfo.image_height = h;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, tight_jpeg_levels[_quality].quality, TRUE);
+    // 2: 4:2:0, 1: 4:2:2, 0: none
+    int subsampling = tight_jpeg_levels[_quality].subsampling;
+    cinfo.comp_info[0].h_samp_factor = subsampling ? 2 : 1;
+    cinfo.comp_info[0].v_samp_factor = (subsampling == 2) ? 2 : 1;
+    jpeg_start_compress(&cinfo, TRUE);
+
+    while (cinfo.next_scanline < cinfo.image_height) {
+        const uint16_t* p = pixels + cinfo.next_scanline * stride;
+        for (uint16_t i = 0; i < w; i++) {
+            uint8_t r = (p[i] >> 11) & 0x1F;
+            uint8_t g = (p[i] >> 5) & 0x3F;
+            uint8_t b = p[i] & 0x1F;
+            rgb[i * 3] = (r << 3) | (r >> 2);
+            rgb[i * 3 + 1] = (g << 2) | (g >> 4);
+            rgb[i * 3 + 2] = (b << 3) | (b >> 2);
+        }
+        JSAMPROW row = rgb.data();
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    put8(rfbTightJpeg << 4);
+    putCompactLength(len);
+    _pending.insert(_pending.end(), jpeg, jpeg + len);
+    free(jpeg);
+}
+
+/// 1 to 3 bytes of 7 bits, the lowest first
+void SessionBuilder::putCompactLength(size_t len) {
+    put8((len & 0x7F) | (len > 0x7F ? 0x80 : 0));
+    if (len > 0x7F) {
+        put8(((len >> 7) & 0x7F) | (len > 0x3FFF ? 0x80 : 0));
+        if (len > 0x3FFF) {
+            put8(len >> 14);
+        }
+    }
+}
+#endif
+
+void SessionBuilder::zrle(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride, uint8_t level) {
+    std::vector<uint8_t> tiles;
+    for (uint16_t ty = 0; ty < h; ty += 64) {
+        for (uint16_t tx = 0; tx < w; tx += 64) {
+            const uint16_t* tile = pixels + ty * stride + tx;
+            uint16_t tw = min(w - tx, 64);
+            uint16_t th = min(h - ty, 64);
+            size_t start = tiles.size();
+            zrleTile(tiles, tile, stride, tw, th);
+#ifdef VNC_ZYWRLE
+            if (level && tiles[start] == 0) {
+                tiles.resize(start);
+                zywrleTile(tiles, tile, stride, tw, th, level);
+            }
+#endif
+        }
+    }
+    std::vector<uint8_t> data = deflateSync(STREAM_ZRLE, tiles);
+
+    putRect(x, y, w, h, level ? rfbEncodingZYWRLE : rfbEncodingZRLE);
+    put32(data.size());
+    putBytes(data);
+}
+
+/**
+ * the smallest of solid, packed palette, palette RLE, plain RLE and raw
+ */
+void SessionBuilder::zrleTile(std::vector<uint8_t>& out, const uint16_t* pixels, uint32_t stride, uint16_t w, uint16_t h) {
+    uint16_t palette[128];
+    size_t colors = collect_palette(pixels, stride, w, h, palette, 127);
+
+    if (colors == 1) {
+        out.push_back(1);
+        append_pixel(out, palette[0]);
+        return;
+    }
+
+    // runs continue from row to row
+    std::vector<uint16_t> tile;
+    for (uint16_t row = 0; row < h; row++) {
+        tile.insert(tile.end(), pixels + row * stride, pixels + row * stride + w);
+    }
+    std::vector<std::pair<uint16_t, size_t> > runs;
+    for (size_t i = 0; i < tile.size();) {
+        size_t len = 1;
+        while (i + len < tile.size() && tile[i + len] == tile[i]) len++;
+        runs.push_back(std::make_pair(tile[i], len));
+        i += len;
+    }
+
+    const size_t rawSize = tile.size() * 2;
+    size_t plainSize = 0;
+    size_t paletteRleSize = colors * 2;
+    for (const auto& run : runs) {
+        plainSize += 2 + run_length_bytes(run.second);
+        paletteRleSize += (run.second == 1) ? 1 : 1 + run_length_bytes(run.second);
+    }
+    if (colors > 127) {
+        paletteRleSize = SIZE_MAX;
+    }
+    uint8_t bits = (colors == 2) ? 1 : (colors <= 4) ? 2 : 4;
+    size_t packedSize = (colors <= 16) ? colors * 2 + h * ((w * bits + 7) / 8) : SIZE_MAX;
+
+    size_t best = min(min(rawSize, plainSize), min(paletteRleSize, packedSize));
+
+    if (best == packedSize) {
+        out.push_back(colors);
+        for (size_t i = 0; i < colors; i++) {
+            append_pixel(out, palette[i]);
+        }
+        for (uint16_t row = 0; row < h; row++) {
+            uint8_t byte = 0;
+            int shift = 8;
+            for (uint16_t i = 0; i < w; i++) {
+                shift -= bits;
+                byte |= palette_index(palette, colors, tile[row * w + i]) << shift;
+                if (shift == 0) {
+                    out.push_back(byte);
+                    byte = 0;
+                    shift = 8;
+                }
+            }
+            if (shift != 8) {
+                out.push_back(byte);
+            }
+        }
+    } else if (best == paletteRleSize) {
+        out.push_back(128 + colors);
+        for (size_t i = 0; i < colors; i++) {
+            append_pixel(out, palette[i]);
+        }
+        for (const auto& run : runs) {
+            uint8_t index = palette_index(palette, colors, run.first);
+            if (run.second == 1) {
+                out.push_back(index);
+            } else {
+                out.push_back(index | 128);
+                append_run_length(out, run.second);
+            }
+        }
+    } else if (best == plainSize) {
+        out.push_back(128);
+        for (const auto& run : runs) {
+            append_pixel(out, run.first);
+            append_run_length(out, run.second);
+        }
+    } else {
+        out.push_back(0);
+        for (uint16_t c : tile) {
+            append_pixel(out, c);
+        }
+    }
+}
+
+#ifdef VNC_ZYWRLE
+/// the Haar step of zywrle.cpp, it is its own inverse
+static inline void zywrle_haar(int8_t* a, int8_t* b) {
+    int x0 = *a;
+    int x1 = *b;
+    if ((x0 ^ x1) & 0x80) {
+        x1 += x0;
+        if (((x1 ^ *b) & 0x80) == 0) {
+            x0 -= x1;
+        }
+    } else {
+        x0 -= x1;
+        if (((x0 ^ *a) & 0x80) == 0) {
+            x1 += x0;
+        }
+    }
+    *a = (int8_t)x1;
+    *b = (int8_t)x0;
+}
+
+/// level l of a w x h plane, rows first, then columns, as the client undoes it backwards
+static void zywrle_analyze_level(int8_t* p, uint16_t w, uint16_t h, uint8_t l) {
+    const uint16_t half = 1 << l;
+    const uint16_t step = 2 << l;
+
+    for (uint16_t y = 0; y < h; y += half) {
+        int8_t* r = p + y * w;
+        for (uint16_t x = 0; x < w; x += step) {
+            zywrle_haar(r + x, r + x + half);
+        }
+    }
+    for (uint16_t y = 0; y < h; y += step) {
+        int8_t* r0 = p + y * w;
+        int8_t* r1 = r0 + half * w;
+        for (uint16_t x = 0; x < w; x += half) {
+            zywrle_haar(r0 + x, r1 + x);
+        }
+    }
+}
+
+/// the coefficients of band r (1: H, 2: V, 3: HV, 0: the rest) of level l, as zywrle_unpack reads them
+static void zywrle_pack(std::vector<uint16_t>& out, const int8_t* py, const int8_t* pu, const int8_t* pv, uint16_t w, uint16_t h, uint8_t l, uint8_t r) {
+    const uint16_t half = 1 << l;
+    const uint16_t step = 2 << l;
+
+    for (uint16_t y = (r & 2) ? half : 0; y < h; y += step) {
+        for (uint16_t x = (r & 1) ? half : 0; x < w; x += step) {
+            size_t i = y * w + x;
+            out.push_back(((pv[i] & 0xF8) << 8) | ((py[i] & 0xFC) << 3) | ((pu[i] & 0xF8) >> 3));
+        }
+    }
+}
+
+/**
+ * The part of the tile that is a multiple of 1 << level wide and high goes
+ * as YUV wavelet coefficients, the pixels right of it, below it and in the
+ * corner follow untransformed. All of it is sent as a ZRLE tile of its own
+ * after a raw subencoding byte. Servers also quantize the high bands by
+ * quality, which is left out here, so only the YUV conversion loses bits.
+ */
+void SessionBuilder::zywrleTile(std::vector<uint8_t>& out, const uint16_t* pixels, uint32_t stride, uint16_t tile_w, uint16_t tile_h, uint8_t level) {
+    const uint16_t mask = (1 << level) - 1;
+    const uint16_t w = tile_w & ~mask;
+    const uint16_t h = tile_h & ~mask;
+    std::vector<uint16_t> coefficients;
+
+    if (!w || !h) {
+        // too small for the wavelet, the client keeps the tile as it is
+        for (uint16_t row = 0; row < tile_h; row++) {
+            coefficients.insert(coefficients.end(), pixels + row * stride, pixels + row * stride + tile_w);
+        }
+    } else {
+        std::vector<int8_t> py((size_t)w * h);
+        std::vector<int8_t> pu((size_t)w * h);
+        std::vector<int8_t> pv((size_t)w * h);
+        size_t i = 0;
+        for (uint16_t y = 0; y < h; y++) {
+            for (uint16_t x = 0; x < w; x++, i++) {
+                uint16_t c = pixels[y * stride + x];
+                int R = (c >> 8) & 0xF8;
+                int G = (c >> 3) & 0xFC;
+                int B = (c << 3) & 0xF8;
+                int Y = (((R + (G << 1) + B) >> 2) - 128) & ~3;
+                int U = ((B - G) >> 1) & ~7;
+                int V = ((R - G) >> 1) & ~7;
+                // -128 is the one value the Haar step does not give back
+                py[i] = (Y == -128) ? Y + 4 : Y;
+                pu[i] = (U == -128) ? U + 8 : U;
+                pv[i] = (V == -128) ? V + 8 : V;
+            }
+        }
+
+        for (uint8_t l = 0; l < level; l++) {
+            zywrle_analyze_level(py.data(), w, h, l);
+            zywrle_analyze_level(pu.data(), w, h, l);
+            zywrle_analyze_level(pv.data(), w, h, l);
+        }
+
+        // finest level first, the low pass band last
+        for (uint8_t l = 0; l < level; l++) {
+            zywrle_pack(coefficients, py.data(), pu.data(), pv.data(), w, h, l, 3);
+            zywrle_pack(coefficients, py.data(), pu.data(), pv.data(), w, h, l, 2);
+            zywrle_pack(coefficients, py.data(), pu.data(), pv.data(), w, h, l, 1);
+        }
+        zywrle_pack(coefficients, py.data(), pu.data(), pv.data(), w, h, level - 1, 0);
+
+        // right edge, bottom edge, then the corner
+        for (uint16_t y = 0; y < h; y++) {
+            coefficients.insert(coefficients.end(), pixels + y * stride + w, pixels + y * stride + tile_w);
+        }
+        for (uint16_t y = h; y < tile_h; y++) {
+            coefficients.insert(coefficients.end(), pixels + y * stride, pixels + y * stride + w);
+        }
+        for (uint16_t y = h; y < tile_h; y++) {
+            coefficients.insert(coefficients.end(), pixels + y * stride + w, pixels + y * stride + tile_w);
+        }
+    }
+
+    out.push_back(0);
+    zrleTile(out, coefficients.data(), tile_w, tile_w, tile_h);
+}
+#endif
+
+std::vector<uint8_t> SessionBuilder::deflateSync(Stream stream, const std::vector<uint8_t>& data) {
+    z_stream* zs = &_streams[stream];
+    if (!_streamOpen[stream]) {
+        deflateInit(zs, Z_DEFAULT_COMPRESSION);
+        _streamOpen[stream] = true;
+    }
+
+    std::vector<uint8_t> out(deflateBound(zs, data.size()) + 16);
+    zs->next_in = (Bytef*)data.data();
+    zs->avail_in = data.size();
+    zs->next_out = out.data();
+    zs->avail_out = out.size();
+    while (deflate(zs, Z_SYNC_FLUSH) == Z_OK && zs->avail_out == 0) {
+        size_t used = out.size();
+        out.resize(used * 2);
+        zs->next_out = out.data() + used;
+        zs->avail_out = out.size() - used;
+    }
+    out.resize(out.size() - zs->avail_out);
+    return out;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file SessionBuilder.h
+ * @brief Server side of a synthetic RFB session for the native build
+ *
+ * Writes the byte stream a server would send: the RFB 3.8 handshake without
+ * authentication, followed by FramebufferUpdate messages. Pixels are given
+ * as native RGB565 values and sent in the byte order the client negotiates,
+ * so the same session fits both settings of VNC_NATIVE_PIXEL_ORDER. The
+ * stream is handed to a ReplayServer in timed blocks, so checks and
+ * benchmarks run arduinoVNC against input that needs no real server.
+ *
+ * Rects can be sent in Raw, RRE, CoRRE, Hextile, ZlibHex, Zlib, Tight, ZRLE
+ * and ZYWRLE. Each encoder picks the subencodings a server would pick for
+ * the content, so a varied image covers the decoder paths of the encoding.
+ */
+
+#pragma once
+
+#ifndef SESSIONBUILDER_H
+#define SESSIONBUILDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <zlib.h>
+#include "ReplayServer.h"
+
+/**
+ * @class SessionBuilder
+ * @brief Encoder of server messages into a ReplayServer
+ */
+class SessionBuilder {
+public:
+    /**
+     * @brief Constructor
+     * @param server Replay server the blocks are added to
+     * @param width Desktop width announced in ServerInit
+     * @param height Desktop height announced in ServerInit
+     */
+    SessionBuilder(ReplayServer& server, uint16_t width, uint16_t height);
+    ~SessionBuilder();
+
+    /**
+     * @brief Protocol version, security type None and ServerInit
+     */
+    void handshake(const char* name = "native");
+
+    /**
+     * @brief Start a FramebufferUpdate, rects follow until endUpdate()
+     */
+    void beginUpdate();
+
+    /**
+     * @brief Finish the FramebufferUpdate with the number of rects written
+     */
+    void endUpdate();
+
+    /**
+     * @brief Quality level the client asked for, 0..9, 99 = none
+     *
+     * Picks the wavelet level of ZYWRLE rects the way the client expects it,
+     * and lets Tight send rects of many colors as JPEG.
+     */
+    void setQuality(uint8_t quality) { _quality = quality; }
+
+    /**
+     * @brief Encode a rect of an image
+     * @param encoding One of the encodings listed above
+     * @param pixels Native RGB565 values of the rect, stride pixels per row
+     * @return false if the encoding is not supported
+     *
+     * CoRRE rects larger than 255 pixels are split, so one call may write
+     * more than one rect.
+     */
+    bool rect(int32_t encoding, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride);
+
+    /**
+     * @brief CopyRect from src_x/src_y to x/y
+     */
+    void copyRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t src_x, uint16_t src_y);
+
+    /**
+     * @brief Hand everything written since the last call to the server
+     * @param timestamp Milliseconds since the session start the block is sent at
+     */
+    void flush(uint32_t timestamp);
+
+    /**
+     * @brief Bytes written so far, including the flushed ones
+     */
+    uint64_t bytes() const { return _flushed + _pending.size(); }
+
+private:
+    /// server side of the zlib streams the encodings keep for a session
+    enum Stream {
+        STREAM_ZLIB,
+        STREAM_ZRLE,
+        STREAM_TIGHT_COPY,
+        STREAM_TIGHT_PALETTE,
+        STREAM_TIGHT_GRADIENT,
+        STREAM_ZLIBHEX_RAW,
+        STREAM_ZLIBHEX,
+        STREAM_COUNT
+    };
+
+    void put8(uint8_t v);
+    void put16(uint16_t v);
+    void put32(uint32_t v);
+    void putBytes(const std::vector<uint8_t>& data);
+    void putRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, int32_t encoding);
+
+    void raw(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride);
+    void rre(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride, bool compact);
+    void hextile(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride, bool zlib);
+    void hextileTile(const uint16_t* pixels, uint32_t stride, uint16_t w, uint16_t h, bool zlib);
+    void zlibRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride);
+    void tight(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride);
+    void tightData(Stream stream, const std::vector<uint8_t>& data);
+    void tightJpeg(const uint16_t* pixels, uint32_t stride, uint16_t w, uint16_t h);
+    void putCompactLength(size_t len);
+    void zrle(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint16_t* pixels, uint32_t stride, uint8_t level);
+    void zrleTile(std::vector<uint8_t>& out, const uint16_t* pixels, uint32_t stride, uint16_t w, uint16_t h);
+    void zywrleTile(std::vector<uint8_t>& out, const uint16_t* pixels, uint32_t stride, uint16_t w, uint16_t h, uint8_t level);
+
+    /// compress data into the stream and flush it, as servers do per rect
+    std::vector<uint8_t> deflateSync(Stream stream, const std::vector<uint8_t>& data);
+
+    ReplayServer& _server;
+    uint16_t _width;
+    uint16_t _height;
+    std::vector<uint8_t> _pending;
+    uint64_t _flushed;
+    size_t _updateStart;    ///< Offset of the rect count of the open update in _pending
+    uint16_t _updateRects;  ///< Rects written into the open update
+    uint8_t _quality;       ///< Quality level of the client, 99 = none
+    z_stream _streams[STREAM_COUNT];
+    bool _streamOpen[STREAM_COUNT];
+};
+
+#endif // SESSIONBUILDER_H
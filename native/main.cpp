@@ -0,0 +1,249 @@
+/**
+ * @file main.cpp
+ * @brief Native (Linux) VNC client for host testing and benchmarking
+ *
+ * Runs arduinoVNC with an in-memory display and reports update and pixel
+ * throughput once per second. A session can be recorded to an FBS file and
+ * replayed later from a local server, so decoders can be compared on the
+ * identical byte stream. Benchmark sessions are generated in memory and
+ * replayed the same way, so a decoder can be timed without a recording.
+ * With -P the display presents from a second thread through the same
+ * queue as the Tab5 driver, and reports queue depth and decode stalls.
+ *
+ * Usage:
+ *   program [-t seconds] [-o snapshot.ppm] [-r record.fbs] [-P rate] [-s mode] <host> [port] [password]
+ *   program -p replay.fbs [-f] [-o snapshot.ppm] [-P rate] [-s mode] [password]
+ *   program -b benchmark [-n frames] [-f] [-o snapshot.ppm] [-P rate] [-s mode]
+ *
+ * Build and run with PlatformIO:
+ *   pio run -e native
+ *   .pio/build/native/program -t 10 -o out.ppm 127.0.0.1 5900 secret
+ *   .pio/build/native/program -b zrle-text -f
+ */
+
+#include <Arduino.h>
+#include <VNC.h>
+#include <unistd.h>
+#include "MemoryDisplay.h"
+#include "PipelineDisplay.h"
+#include "FbsRecorder.h"
+#include "ReplayServer.h"
+#include "BenchmarkSession.h"
+
+// Same geometry as the Tab5 panel
+const uint32_t DISPLAY_WIDTH = 1280;
+const uint32_t DISPLAY_HEIGHT = 720;
+
+// Updates of a benchmark session unless -n is given
+const uint32_t BENCHMARK_FRAMES = 60;
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [-t seconds] [-o snapshot.ppm] [-r record.fbs] [-P rate] [-s mode] [-v view] <host> [port] [password]\n"
+            "       %s -p replay.fbs [-f] [-o snapshot.ppm] [-P rate] [-s mode] [-v view] [password]\n"
+            "       %s -b benchmark [-n frames] [-f] [-o snapshot.ppm] [-P rate] [-s mode] [-v view]\n"
+            "  -t  run time in seconds (default 10)\n"
+            "  -o  write the screen as PPM at the end\n"
+            "  -r  record the server byte stream\n"
+            "  -p  replay a recording from a local server until it ends\n"
+            "  -b  replay a generated session, named <encoding>-<content>\n"
+            "  -n  updates of the generated session (default 60)\n"
+            "  -f  replay as fast as possible instead of at the recorded pace\n"
+            "  -P  present from a second thread, like the present task of the Tab5\n"
+            "      driver, to a panel of the given Mpixel/s (0 = as fast as possible)\n"
+            "  -s  show desktops larger than the display scaled: box or bilinear\n"
+            "  -v  zoom,dx,dy: once the desktop is shown, zoom around the display center\n"
+            "      and pan by dx/dy display pixels\n"
+            "  benchmarks, e.g. zrle-text:\n",
+            name, name, name);
+    print_benchmark_names(stderr);
+}
+
+int main(int argc, char** argv) {
+    unsigned long seconds = 10;
+    const char* snapshot = nullptr;
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    const char* benchmark = nullptr;
+    uint32_t frames = BENCHMARK_FRAMES;
+    double panelRate = -1;
+    bool fast = false;
+    vnc_scale_mode_t scaling = VNC_SCALE_NONE;
+    float viewZoom = 0;
+    int viewX = 0;
+    int viewY = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:o:r:p:b:n:fP:s:v:")) != -1) {
+        switch (c) {
+            case 't': seconds = strtoul(optarg, nullptr, 10); break;
+            case 'o': snapshot = optarg; break;
+            case 'r': recordPath = optarg; break;
+            case 'p': replayPath = optarg; break;
+            case 'b': benchmark = optarg; break;
+            case 'n': frames = strtoul(optarg, nullptr, 10); break;
+            case 'f': fast = true; break;
+            case 'P':
+                panelRate = strtod(optarg, nullptr);
+                if (panelRate < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 's':
+                if (!strcmp(optarg, "box")) {
+                    scaling = VNC_SCALE_BOX;
+                } else if (!strcmp(optarg, "bilinear")) {
+                    scaling = VNC_SCALE_BILINEAR;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'v':
+                if (sscanf(optarg, "%f,%d,%d", &viewZoom, &viewX, &viewY) < 1 || viewZoom <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    const char* host = "127.0.0.1";
+    uint16_t port = 5900;
+    const char* password = "";
+
+    // declared before the client, so the client socket is closed first
+    ReplayServer replay;
+
+    if (benchmark) {
+        if (!build_benchmark_session(benchmark, replay, DISPLAY_WIDTH, DISPLAY_HEIGHT, frames)) {
+            fprintf(stderr, "unknown benchmark %s\n", benchmark);
+            usage(argv[0]);
+            return 1;
+        }
+    } else if (replayPath && !replay.load(replayPath)) {
+        fprintf(stderr, "cannot load %s\n", replayPath);
+        return 1;
+    }
+    const char* replaying = benchmark ? benchmark : replayPath;
+
+    if (replaying) {
+        port = replay.start(!fast);
+        if (port == 0) {
+            fprintf(stderr, "cannot start the replay server\n");
+            return 1;
+        }
+        if (optind < argc) password = argv[optind];
+        printf("[native] replaying %s: %llu bytes, %.1f s recorded%s\n", replaying,
+               (unsigned long long)replay.bytes(), replay.duration() / 1000.0, fast ? ", fast" : "");
+    } else {
+        if (optind >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        host = argv[optind];
+        if (optind + 1 < argc) port = atoi(argv[optind + 1]);
+        if (optind + 2 < argc) password = argv[optind + 2];
+    }
+
+    FbsRecorder recorder(recordPath ? recordPath : "");
+
+    PipelineDisplay display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    arduinoVNC vnc(&display);
+
+    if (panelRate >= 0) {
+        display.start(panelRate);
+    }
+
+    if (recordPath) {
+        vnc.setRecorder(&recorder);
+    }
+
+    vnc.begin(host, port);
+    vnc.setPassword(password);
+    vnc.setScaling(scaling);
+
+    unsigned long start = millis();
+    unsigned long lastReport = start;
+    MemoryDisplayStats last = display.getStats();
+
+    while (true) {
+        if (replaying) {
+            // the stream is complete once the server is done and the
+            // client has consumed everything
+            if (replay.finished() && !vnc.connected()) break;
+        } else if (millis() - start >= seconds * 1000) {
+            break;
+        }
+
+        vnc.loop();
+
+        // move the viewport once, after the first complete update
+        if (viewZoom > 0 && display.getStats().updates > 0) {
+            vnc.zoomViewport(viewZoom, DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2);
+            vnc.panViewport(viewX, viewY);
+            viewZoom = 0;
+        }
+
+        unsigned long now = millis();
+        if (now - lastReport >= 1000) {
+            const MemoryDisplayStats& stats = display.getStats();
+            double elapsed = (now - lastReport) / 1000.0;
+            printf("[native] updates/s: %.1f rects/s: %.1f Mpixel/s: %.2f\n",
+                   (stats.updates - last.updates) / elapsed,
+                   (stats.rects - last.rects) / elapsed,
+                   (stats.pixels - last.pixels) / elapsed / 1e6);
+#ifdef VNC_AUTO_ENCODING
+            const vnc_encoding_choice_t& choice = vnc.getEncodingChoice();
+            printf("[native] encoding: %d compress: %d quality: %d link: %u kbit/s wait: %d%% changes: %u\n",
+                   choice.encoding, choice.compressLevel, choice.quality, choice.linkKbps,
+                   choice.waitPercent, choice.changes);
+#endif
+            last = stats;
+            lastReport = now;
+        }
+    }
+
+    const MemoryDisplayStats& stats = display.getStats();
+    double elapsed = (millis() - start) / 1000.0;
+    printf("[native] total updates: %u rects: %u pixels: %llu in %.3f s (%.2f Mpixel/s)\n",
+           stats.updates, stats.rects, (unsigned long long)stats.pixels,
+           elapsed, elapsed > 0 ? stats.pixels / elapsed / 1e6 : 0.0);
+    printf("[native] socket reads: %llu, %.1f bytes per read\n",
+           (unsigned long long)WiFiClient::readCalls(),
+           WiFiClient::readCalls() ? (double)WiFiClient::readBytes() / WiFiClient::readCalls() : 0.0);
+
+    if (panelRate >= 0) {
+        display.stop();
+        const PipelineStats& present = display.getPipelineStats();
+        printf("[native] present: queued %u presented %u stalls %u max depth %u, %.1f us per region (max %u)\n",
+               present.queued, present.presented, present.stalls, present.maxDepth,
+               present.presented ? (double)present.writeUs / present.presented : 0.0, present.maxWriteUs);
+    }
+
+#ifdef VNC_METRICS
+    vnc.getMetrics().dump([](const char* line) { printf("%s\n", line); });
+#endif
+
+    int ret = 0;
+    if (recordPath) {
+        vnc.setRecorder(nullptr);
+        recorder.session_end();
+        if (recorder.failed()) {
+            fprintf(stderr, "cannot write %s\n", recordPath);
+            ret = 1;
+        } else {
+            printf("[native] recorded %llu bytes to %s\n", (unsigned long long)recorder.bytes(), recordPath);
+        }
+    }
+
+    if (snapshot && !display.savePPM(snapshot)) {
+        fprintf(stderr, "cannot write %s\n", snapshot);
+        ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,208 @@
+/**
+ * @file Arduino.cpp
+ * @brief Arduino, WiFiClient and miniz shims for the native (Linux) build
+ */
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "miniz.h"
+
+#include <time.h>
+#include <sched.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// ============================================================================
+// Timing
+// ============================================================================
+
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static const uint64_t start_us = monotonic_us();
+
+unsigned long millis(void) {
+    return (unsigned long)((monotonic_us() - start_us) / 1000);
+}
+
+unsigned long micros(void) {
+    return (unsigned long)(monotonic_us() - start_us);
+}
+
+void delay(unsigned long ms) {
+    if (ms == 0) {
+        sched_yield();
+        return;
+    }
+    usleep(ms * 1000);
+}
+
+// ============================================================================
+// String / Serial
+// ============================================================================
+
+String::String(double value, unsigned int decimals) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    _str = buf;
+}
+
+int HardwareSerial::printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vprintf(format, args);
+    va_end(args);
+    return len;
+}
+
+// ============================================================================
+// WiFiClient
+// ============================================================================
+
+uint64_t WiFiClient::_readCalls = 0;
+uint64_t WiFiClient::_readBytes = 0;
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    struct addrinfo hints = {};
+    struct addrinfo* res = nullptr;
+    char service[8];
+
+    stop();
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%u", port);
+
+    if (getaddrinfo(host, service, &hints, &res) != 0) {
+        return 0;
+    }
+
+    for (struct addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            _fd = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(res);
+
+    return _fd >= 0 ? 1 : 0;
+}
+
+uint8_t WiFiClient::connected(void) {
+    if (_fd < 0) return 0;
+
+    // like the Arduino cores: still "connected" while data is left to read
+    char c;
+    ssize_t len = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (len > 0) return 1;
+    if (len == 0) return 0;
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : 0;
+}
+
+int WiFiClient::available(void) {
+    if (_fd < 0) return 0;
+
+    int len = 0;
+    if (ioctl(_fd, FIONREAD, &len) < 0) return 0;
+    if (len > 0) return len;
+
+    // callers busy-poll on available(), wait a little instead of spinning
+    struct pollfd pfd = { _fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 1) > 0 && ioctl(_fd, FIONREAD, &len) == 0) {
+        return len;
+    }
+    return 0;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+    if (_fd < 0) return -1;
+    ssize_t len = recv(_fd, buf, size, MSG_DONTWAIT);
+    _readCalls++;
+    if (len > 0) _readBytes += len;
+    return len > 0 ? (int)len : 0;
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+    size_t sent = 0;
+    while (_fd >= 0 && sent < size) {
+        ssize_t len = send(_fd, buf + sent, size - sent, MSG_NOSIGNAL);
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) continue;
+            break;
+        }
+        sent += len;
+    }
+    return sent;
+}
+
+void WiFiClient::stop(void) {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+void WiFiClient::setNoDelay(bool nodelay) {
+    if (_fd < 0) return;
+    int one = nodelay ? 1 : 0;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// ============================================================================
+// miniz (tinfl) on zlib
+// ============================================================================
+
+#define TINFL_NATIVE_MAGIC 0x7a6c6962
+
+void tinfl_init_native(tinfl_decompressor* r) {
+    if (r->magic == TINFL_NATIVE_MAGIC) {
+        inflateReset(&r->strm);
+        return;
+    }
+    memset(&r->strm, 0, sizeof(r->strm));
+    inflateInit(&r->strm);
+    r->magic = TINFL_NATIVE_MAGIC;
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* pIn_buf_next, size_t* pIn_buf_size,
+                              mz_uint8* pOut_buf_start, mz_uint8* pOut_buf_next, size_t* pOut_buf_size,
+                              const mz_uint32 decomp_flags) {
+    if (r->magic != TINFL_NATIVE_MAGIC) {
+        return TINFL_STATUS_BAD_PARAM;
+    }
+
+    r->strm.next_in = (Bytef*)pIn_buf_next;
+    r->strm.avail_in = *pIn_buf_size;
+    r->strm.next_out = pOut_buf_next;
+    r->strm.avail_out = *pOut_buf_size;
+
+    int ret = inflate(&r->strm, Z_SYNC_FLUSH);
+
+    *pIn_buf_size -= r->strm.avail_in;
+    *pOut_buf_size -= r->strm.avail_out;
+
+    switch (ret) {
+        case Z_STREAM_END:
+            return TINFL_STATUS_DONE;
+        case Z_OK:
+        case Z_BUF_ERROR:
+            return r->strm.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+        default:
+            return TINFL_STATUS_FAILED;
+    }
+}
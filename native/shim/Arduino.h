@@ -0,0 +1,80 @@
+/**
+ * @file Arduino.h
+ * @brief Minimal Arduino API for the native (Linux) build
+ *
+ * Only what arduinoVNC uses: timing, String, Serial and the mixed-type
+ * min()/max() the Arduino cores provide.
+ */
+
+#pragma once
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+
+#include <string>
+#include <type_traits>
+
+#define os_printf printf
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+
+template <class A, class B>
+inline typename std::common_type<A, B>::type min(A a, B b) {
+    return (a < b) ? a : b;
+}
+
+template <class A, class B>
+inline typename std::common_type<A, B>::type max(A a, B b) {
+    return (a > b) ? a : b;
+}
+
+class String {
+public:
+    String() {}
+    String(const char* str) : _str(str ? str : "") {}
+    String(const std::string& str) : _str(str) {}
+    String(int value) : _str(std::to_string(value)) {}
+    String(unsigned int value) : _str(std::to_string(value)) {}
+    String(long value) : _str(std::to_string(value)) {}
+    String(unsigned long value) : _str(std::to_string(value)) {}
+    String(double value, unsigned int decimals = 2);
+
+    const char* c_str() const { return _str.c_str(); }
+    size_t length() const { return _str.length(); }
+
+    String& operator+=(const String& rhs) { _str += rhs._str; return *this; }
+    friend String operator+(const String& lhs, const String& rhs) { return String(lhs._str + rhs._str); }
+    bool operator==(const String& rhs) const { return _str == rhs._str; }
+
+private:
+    std::string _str;
+};
+
+class HardwareSerial {
+public:
+    void begin(unsigned long baud) {}
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void print(const String& str) { fputs(str.c_str(), stdout); }
+    void println(const String& str = String()) { puts(str.c_str()); }
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+    uint32_t getFreeHeap(void) { return 0; }
+};
+
+extern EspClass ESP;
+
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,36 @@
+/**
+ * @file WiFi.h
+ * @brief WiFiClient on top of POSIX sockets for the native (Linux) build
+ */
+
+#pragma once
+
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include "Arduino.h"
+
+class WiFiClient {
+public:
+    WiFiClient() : _fd(-1) {}
+    ~WiFiClient() { stop(); }
+
+    int connect(const char* host, uint16_t port);
+    uint8_t connected(void);
+    int available(void);
+    int read(uint8_t* buf, size_t size);
+    size_t write(const uint8_t* buf, size_t size);
+    void stop(void);
+    void setNoDelay(bool nodelay);
+
+    /// read() calls and the bytes they returned, summed over all clients
+    static uint64_t readCalls(void) { return _readCalls; }
+    static uint64_t readBytes(void) { return _readBytes; }
+
+private:
+    int _fd;
+    static uint64_t _readCalls;
+    static uint64_t _readBytes;
+};
+
+#endif // NATIVE_WIFI_H
@@ -0,0 +1,52 @@
+/**
+ * @file miniz.h
+ * @brief tinfl inflate API on top of zlib for the native (Linux) build
+ *
+ * The ESP32 ROM provides miniz. On the host the same tinfl_decompress()
+ * calls are served by zlib's inflate(), which keeps its own window, so the
+ * wrapping output buffer of the decoders works unchanged.
+ */
+
+#pragma once
+
+#ifndef NATIVE_MINIZ_H
+#define NATIVE_MINIZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <zlib.h>
+
+typedef unsigned char mz_uint8;
+typedef uint32_t mz_uint32;
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+typedef enum {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct {
+    z_stream strm;
+    uint32_t magic;     ///< set once strm is initialized
+} tinfl_decompressor;
+
+void tinfl_init_native(tinfl_decompressor* r);
+#define tinfl_init(r) tinfl_init_native(r)
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* pIn_buf_next, size_t* pIn_buf_size,
+                              mz_uint8* pOut_buf_start, mz_uint8* pOut_buf_next, size_t* pOut_buf_size,
+                              const mz_uint32 decomp_flags);
+
+#endif // NATIVE_MINIZ_H
@@ -0,0 +1,61 @@
+/**
+ * @file ClientLog.cpp
+ * @brief Decoder of the messages arduinoVNC sent to a ReplayServer
+ */
+
+#include "ClientLog.h"
+
+#include <stdio.h>
+#include "VNC.h"
+
+static uint16_t read_be16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t read_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+bool ClientLog::parse(const std::vector<uint8_t>& data) {
+    // protocol version, security type and ClientInit
+    size_t pos = 12 + 1 + 1;
+    const size_t end = data.size();
+
+    _requests.clear();
+    _pixelFormats = 0;
+
+    while (pos < end) {
+        const uint8_t* p = &data[pos];
+        size_t left = end - pos;
+        size_t len;
+
+        switch (p[0]) {
+            case rfbSetPixelFormat: len = 20; break;
+            case rfbSetEncodings: len = (left >= 4) ? 4 + 4 * read_be16(p + 2) : 4; break;
+            case rfbFramebufferUpdateRequest: len = 10; break;
+            case rfbKeyEvent: len = 8; break;
+            case rfbPointerEvent: len = 6; break;
+            case rfbClientCutText: len = (left >= 8) ? 8 + read_be32(p + 4) : 8; break;
+            case rfbEnableContinuousUpdates: len = 10; break;
+            case rfbFence: len = (left >= 9) ? 9 + p[8] : 9; break;
+            case rfbSetDesktopSize: len = (left >= 8) ? 8 + 16 * p[6] : 8; break;
+            default:
+                fprintf(stderr, "[ClientLog] unknown message %d at %zu\n", p[0], pos);
+                return false;
+        }
+        if (len > left) {
+            fprintf(stderr, "[ClientLog] message %d at %zu truncated\n", p[0], pos);
+            return false;
+        }
+
+        if (p[0] == rfbSetPixelFormat) {
+            _bigEndian = p[6] != 0;
+            _pixelFormats++;
+        } else if (p[0] == rfbFramebufferUpdateRequest) {
+            UpdateRequest r = { p[1], read_be16(p + 2), read_be16(p + 4), read_be16(p + 6), read_be16(p + 8) };
+            _requests.push_back(r);
+        }
+        pos += len;
+    }
+    return true;
+}
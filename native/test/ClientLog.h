@@ -0,0 +1,59 @@
+/**
+ * @file ClientLog.h
+ * @brief Decoder of the messages arduinoVNC sent to a ReplayServer
+ */
+
+#pragma once
+
+#ifndef CLIENTLOG_H
+#define CLIENTLOG_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @struct UpdateRequest
+ * @brief One FramebufferUpdateRequest
+ */
+struct UpdateRequest {
+    uint8_t incremental;
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+};
+
+/**
+ * @class ClientLog
+ * @brief Client side of an RFB 3.8 session without authentication
+ */
+class ClientLog {
+public:
+    /**
+     * @brief Split the client byte stream into messages
+     * @return false on an unknown message type or a truncated message
+     */
+    bool parse(const std::vector<uint8_t>& data);
+
+    /**
+     * @brief Pixel format of the last SetPixelFormat is big endian
+     */
+    bool bigEndian() const { return _bigEndian; }
+
+    /**
+     * @brief Number of SetPixelFormat messages
+     */
+    uint32_t pixelFormats() const { return _pixelFormats; }
+
+    /**
+     * @brief All update requests in the order they were sent
+     */
+    const std::vector<UpdateRequest>& requests() const { return _requests; }
+
+private:
+    bool _bigEndian = false;
+    uint32_t _pixelFormats = 0;
+    std::vector<UpdateRequest> _requests;
+};
+
+#endif // CLIENTLOG_H
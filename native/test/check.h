@@ -0,0 +1,42 @@
+/**
+ * @file check.h
+ * @brief Minimal assertions for the native checks
+ *
+ * A failed CHECK prints where and what failed and counts the failure, the
+ * check keeps running so one run shows every difference.
+ */
+
+#pragma once
+
+#ifndef NATIVE_CHECK_H
+#define NATIVE_CHECK_H
+
+#include <stdio.h>
+
+/// Failures since the start of the program
+extern int check_failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            check_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        long long _a = (long long)(a); \
+        long long _b = (long long)(b); \
+        if (_a != _b) { \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+            check_failures++; \
+        } \
+    } while (0)
+
+/// The checks of one area, run by test_main.cpp
+void test_update_requests(void);
+void test_pixel_order(void);
+void test_pipeline(void);
+
+#endif // NATIVE_CHECK_H
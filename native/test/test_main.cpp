@@ -0,0 +1,41 @@
+/**
+ * @file test_main.cpp
+ * @brief Host checks of arduinoVNC, run against sessions built in memory
+ *
+ * Build and run with PlatformIO:
+ *   pio run -e native_test
+ *   .pio/build/native_test/program
+ *
+ * Exits with 1 if any check failed.
+ */
+
+#include <Arduino.h>
+#include "check.h"
+
+int check_failures = 0;
+
+struct CheckArea {
+    const char* name;
+    void (*run)(void);
+};
+
+static const CheckArea areas[] = {
+    { "update requests", test_update_requests },
+    { "pixel order", test_pixel_order },
+    { "present pipeline", test_pipeline },
+};
+
+int main(int argc, char** argv) {
+    int failed = 0;
+
+    for (const CheckArea& area : areas) {
+        int before = check_failures;
+        area.run();
+        int failures = check_failures - before;
+        printf("[test] %s: %s\n", area.name, failures ? "FAILED" : "ok");
+        if (failures) failed++;
+    }
+
+    printf("[test] %d of %zu areas failed\n", failed, sizeof(areas) / sizeof(areas[0]));
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file test_pipeline.cpp
+ * @brief Checks the decode/present pipeline built with std::thread
+ *
+ * Replays a session whose content changes every update through a
+ * PipelineDisplay. Once as fast as the host can present, once to a panel
+ * slow enough that the 64 slots of the queue fill up and the decode thread
+ * has to wait. Either way every queued region must reach the panel, and
+ * the panel must end up equal to the shadow.
+ */
+
+#include <Arduino.h>
+#include <VNC.h>
+#include "check.h"
+#include "../BenchmarkSession.h"
+#include "../PipelineDisplay.h"
+#include "../ReplayServer.h"
+
+static const uint16_t PIPELINE_WIDTH = 96;
+static const uint16_t PIPELINE_HEIGHT = 64;
+static const uint32_t PIPELINE_FRAMES = 100;
+
+static void check_pipeline(double panelRate) {
+    ReplayServer replay;
+    CHECK(build_benchmark_session("raw-text", replay, PIPELINE_WIDTH, PIPELINE_HEIGHT, PIPELINE_FRAMES));
+
+    uint16_t port = replay.start(false);
+    CHECK(port != 0);
+    if (!port) return;
+
+    PipelineDisplay display(PIPELINE_WIDTH, PIPELINE_HEIGHT);
+    display.start(panelRate);
+    {
+        arduinoVNC vnc(&display);
+        vnc.begin("127.0.0.1", port);
+        vnc.setPassword("");
+
+        unsigned long start = millis();
+        while (!(replay.finished() && !vnc.connected()) && millis() - start < 10000) {
+            vnc.loop();
+        }
+    }
+    display.stop();
+    replay.wait();
+
+    // every update is one full screen rect, merged into one region
+    const PipelineStats& stats = display.getPipelineStats();
+    CHECK_EQ(display.getStats().updates, PIPELINE_FRAMES);
+    CHECK_EQ(stats.queued, PIPELINE_FRAMES);
+    CHECK_EQ(stats.presented, stats.queued);
+    CHECK_EQ(display.present_backlog(), 0);
+    CHECK(stats.maxDepth <= 64);
+    if (panelRate > 0) {
+        CHECK_EQ(stats.maxDepth, 64);
+        CHECK(stats.stalls > 0);
+    }
+
+    uint32_t mismatches = 0;
+    for (uint32_t y = 0; y < PIPELINE_HEIGHT; y++) {
+        for (uint32_t x = 0; x < PIPELINE_WIDTH; x++) {
+            if (display.getPanelPixel(x, y) != display.getPixel(x, y)) {
+                mismatches++;
+            }
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+}
+
+void test_pipeline(void) {
+    check_pipeline(0);
+    // 6144 pixels at 0.5 Mpixel/s take 12 ms per update, decoding far less
+    check_pipeline(0.5);
+}
@@ -0,0 +1,237 @@
+/**
+ * @file test_pixel_order.cpp
+ * @brief Checks that every decoder draws the same image in either byte order
+ *
+ * The client asks for big endian RGB565, or for the CPU byte order with
+ * VNC_NATIVE_PIXEL_ORDER. The sessions are encoded in whichever order it
+ * asked for, so building the checks with and without the switch runs the
+ * decoders on both. The image has a band each for the subencodings of the
+ * encodings: two colors, a gradient, a solid area, four colors, one color
+ * per row and three colors taking turns row by row. Lossy encodings get a
+ * smooth image instead, compared within a tolerance.
+ */
+
+#include <Arduino.h>
+#include <VNC.h>
+#include <vector>
+#include "check.h"
+#include "ClientLog.h"
+#include "../MemoryDisplay.h"
+#include "../ReplayServer.h"
+#include "../SessionBuilder.h"
+
+static const uint16_t IMAGE_WIDTH = 96;
+static const uint16_t IMAGE_HEIGHT = 48;
+
+// ZRLE tiles of 64x64, 63x64, 64x57 and 63x57, Tight decodes it in two parts
+static const uint16_t SMOOTH_WIDTH = 127;
+static const uint16_t SMOOTH_HEIGHT = 121;
+
+// large enough for a JPEG that does not fit the receive buffer
+static const uint16_t NOISE_WIDTH = 320;
+static const uint16_t NOISE_HEIGHT = 240;
+
+static uint16_t image_pixel(uint32_t x, uint32_t y) {
+    static const uint16_t four[4] = { 0x07E0, 0x00F8, 0x1234, 0xABCD };
+    static const uint16_t three[3] = { 0x0100, 0x8410, 0xFFE0 };
+
+    if (x < 24) {
+        return ((x * 7 + y * 3) % 5 < 2) ? 0xFFFF : 0x001F;
+    }
+    if (x < 48) {
+        return (((x * 5 + y) & 0x1F) << 11) | (((y * 3 + x) & 0x3F) << 5) | ((x ^ y) & 0x1F);
+    }
+    if (x < 80) {
+        return (y < 24) ? 0xF800 : four[((x + y) / 3) % 4];
+    }
+    return (y < 24) ? y * 0x0421 + 0x0100 : three[y % 3];
+}
+
+/// gradients with a bit of noise, so ZRLE would send the tiles raw
+static uint16_t smooth_pixel(uint32_t x, uint32_t y) {
+    uint32_t r = x * 31 / (SMOOTH_WIDTH - 1);
+    uint32_t g = (x + y * 2) * 63 / (SMOOTH_WIDTH - 1 + (SMOOTH_HEIGHT - 1) * 2);
+    g ^= ((x * 37 + y * 91 + x * y) % 7) < 3;
+    uint32_t b = 31 - y * 31 / (SMOOTH_HEIGHT - 1);
+    return (r << 11) | (g << 5) | b;
+}
+
+static uint16_t noise_pixel(uint32_t x, uint32_t y) {
+    uint32_t h = (x * 0x9E3779B1u) ^ (y * 0x85EBCA77u);
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+/// largest difference of the color components, in steps of 8 bit components
+static uint32_t pixel_error(uint16_t a, uint16_t b) {
+    int dr = abs((a >> 11) - (b >> 11)) << 3;
+    int dg = abs(((a >> 5) & 0x3F) - ((b >> 5) & 0x3F)) << 2;
+    int db = abs((a & 0x1F) - (b & 0x1F)) << 3;
+    return max(dr, max(dg, db));
+}
+
+struct Band {
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+};
+
+static const Band bands[] = {
+    { 0, 0, 24, 48 },
+    { 24, 0, 24, 48 },
+    { 48, 0, 32, 24 },
+    { 48, 24, 32, 24 },
+    { 80, 0, 16, 24 },
+    { 80, 24, 16, 24 },
+};
+
+/**
+ * replay a session of one update into a display of the image size
+ * @return number of pixels further than tolerance from the image
+ */
+static uint32_t replay_image(const char* name, ReplayServer& replay, const uint16_t* image, uint16_t width, uint16_t height, uint32_t tolerance) {
+    uint16_t port = replay.start(true);
+    CHECK(port != 0);
+    if (!port) return 0;
+
+    uint32_t mismatches = 0;
+    {
+        MemoryDisplay display(width, height);
+        arduinoVNC vnc(&display);
+        vnc.begin("127.0.0.1", port);
+        vnc.setPassword("");
+
+        unsigned long start = millis();
+        while (!(replay.finished() && !vnc.connected()) && millis() - start < 5000) {
+            vnc.loop();
+        }
+
+        CHECK_EQ(display.getStats().updates, 1);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint16_t got = display.getPixel(x, y);
+                uint16_t want = image[y * width + x];
+                if (pixel_error(got, want) > tolerance && mismatches++ < 5) {
+                    fprintf(stderr, "[%s] pixel %u/%u: %04X, expected %04X\n", name, x, y, got, want);
+                }
+            }
+        }
+    }
+    replay.wait();
+    return mismatches;
+}
+
+static void check_encoding(const char* name, int32_t encoding, const uint16_t* image) {
+    ReplayServer replay;
+    SessionBuilder session(replay, IMAGE_WIDTH, IMAGE_HEIGHT);
+    int failures = check_failures;
+
+    session.handshake();
+    session.beginUpdate();
+    for (const Band& b : bands) {
+        CHECK(session.rect(encoding, b.x, b.y, b.w, b.h, image + b.y * IMAGE_WIDTH + b.x, IMAGE_WIDTH));
+    }
+    session.endUpdate();
+    session.flush(0);
+    // the client reads ahead, a server closing right away would leave it
+    // no chance to send its pixel format
+    session.flush(300);
+
+    CHECK_EQ(replay_image(name, replay, image, IMAGE_WIDTH, IMAGE_HEIGHT, 0), 0);
+
+    ClientLog log;
+    CHECK(log.parse(replay.clientData()));
+    CHECK(log.pixelFormats() > 0);
+#if defined(VNC_NATIVE_PIXEL_ORDER) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    CHECK(!log.bigEndian());
+#else
+    CHECK(log.bigEndian());
+#endif
+
+    if (failures != check_failures) {
+        fprintf(stderr, "[%s] failed\n", name);
+    }
+}
+
+/**
+ * a generated image as one rect
+ * @param quality Quality level the client asked for
+ * @param tolerance Largest error of a component, in 8 bit steps
+ * @return bytes of the session
+ */
+static uint64_t check_image(const char* name, int32_t encoding, uint8_t quality, uint16_t (*pixel)(uint32_t x, uint32_t y),
+                            uint16_t width, uint16_t height, uint32_t tolerance) {
+    std::vector<uint16_t> image((size_t)width * height);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            image[y * width + x] = pixel(x, y);
+        }
+    }
+
+    ReplayServer replay;
+    SessionBuilder session(replay, width, height);
+    int failures = check_failures;
+
+    session.setQuality(quality);
+    session.handshake();
+    session.beginUpdate();
+    CHECK(session.rect(encoding, 0, 0, width, height, image.data(), width));
+    session.endUpdate();
+    session.flush(0);
+    session.flush(300);
+
+    CHECK_EQ(replay_image(name, replay, image.data(), width, height, tolerance), 0);
+
+    if (failures != check_failures) {
+        fprintf(stderr, "[%s] failed\n", name);
+    }
+    return session.bytes();
+}
+
+void test_pixel_order(void) {
+    uint16_t image[IMAGE_WIDTH * IMAGE_HEIGHT];
+    for (uint32_t y = 0; y < IMAGE_HEIGHT; y++) {
+        for (uint32_t x = 0; x < IMAGE_WIDTH; x++) {
+            image[y * IMAGE_WIDTH + x] = image_pixel(x, y);
+        }
+    }
+
+    check_encoding("Raw", rfbEncodingRaw, image);
+#ifdef VNC_RRE
+    check_encoding("RRE", rfbEncodingRRE, image);
+#endif
+#ifdef VNC_CORRE
+    check_encoding("CoRRE", rfbEncodingCoRRE, image);
+#endif
+#ifdef VNC_HEXTILE
+    check_encoding("Hextile", rfbEncodingHextile, image);
+#endif
+#ifdef VNC_ZLIBHEX
+    check_encoding("ZlibHex", rfbEncodingZlibHex, image);
+#endif
+#ifdef VNC_ZLIB
+    check_encoding("Zlib", rfbEncodingZlib, image);
+#endif
+#ifdef VNC_TIGHT
+    check_encoding("Tight", rfbEncodingTight, image);
+#endif
+#ifdef VNC_ZRLE
+    check_encoding("ZRLE", rfbEncodingZRLE, image);
+#endif
+
+#ifdef VNC_TIGHT
+    // without a quality the smooth image goes through the gradient filter
+    check_image("Tight gradient", rfbEncodingTight, 99, smooth_pixel, SMOOTH_WIDTH, SMOOTH_HEIGHT, 0);
+    // a JPEG decoded from the receive buffer, and one too large for it
+    CHECK(check_image("Tight JPEG", rfbEncodingTight, 5, smooth_pixel, SMOOTH_WIDTH, SMOOTH_HEIGHT, 24) < VNC_RX_BUFFER);
+    CHECK(check_image("Tight large JPEG", rfbEncodingTight, 9, noise_pixel, NOISE_WIDTH, NOISE_HEIGHT, 16) > VNC_RX_BUFFER);
+#endif
+#if defined(VNC_ZYWRLE) && defined(VNC_JPEG_QUALITY) && VNC_JPEG_QUALITY < VNC_ZYWRLE_QUALITY
+    // the client only asks for ZYWRLE below VNC_ZYWRLE_QUALITY, the wavelet
+    // level follows from its quality
+    check_image("ZYWRLE", rfbEncodingZYWRLE, VNC_JPEG_QUALITY, smooth_pixel, SMOOTH_WIDTH, SMOOTH_HEIGHT, 16);
+#endif
+}
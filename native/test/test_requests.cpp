@@ -0,0 +1,184 @@
+/**
+ * @file test_requests.cpp
+ * @brief Checks of the rectangles arduinoVNC asks the server for
+ *
+ * Every case replays a session with a one pixel update at 0 ms, an empty
+ * update at 300 ms and the end at 600 ms. The client first asks for its
+ * whole view and after each update incrementally for the view again. An
+ * action at 150 ms may change the view, the parts it exposes are asked for
+ * right away and the next incremental request covers the new view.
+ */
+
+#include <Arduino.h>
+#include <VNC.h>
+#include "check.h"
+#include "ClientLog.h"
+#include "../MemoryDisplay.h"
+#include "../ReplayServer.h"
+#include "../SessionBuilder.h"
+
+static const uint32_t DISPLAY_WIDTH = 320;
+static const uint32_t DISPLAY_HEIGHT = 240;
+
+typedef void (*ViewAction)(arduinoVNC& vnc);
+
+static std::vector<UpdateRequest> run_session(uint16_t width, uint16_t height, vnc_scale_mode_t mode, ViewAction action) {
+    ReplayServer replay;
+    SessionBuilder session(replay, width, height);
+    const uint16_t pixel = 0xFFFF;
+
+    session.handshake();
+    session.beginUpdate();
+    session.rect(rfbEncodingRaw, 0, 0, 1, 1, &pixel, 1);
+    session.endUpdate();
+    session.flush(0);
+    session.beginUpdate();
+    session.endUpdate();
+    session.flush(300);
+    session.flush(600);
+
+    uint16_t port = replay.start(true);
+    if (port == 0) {
+        fprintf(stderr, "cannot start the replay server\n");
+        check_failures++;
+        return std::vector<UpdateRequest>();
+    }
+
+    {
+        MemoryDisplay display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+        arduinoVNC vnc(&display);
+        vnc.begin("127.0.0.1", port);
+        vnc.setPassword("");
+        vnc.setScaling(mode);
+
+        unsigned long start = millis();
+        while (!(replay.finished() && !vnc.connected()) && millis() - start < 5000) {
+            vnc.loop();
+            if (action && millis() - start >= 150) {
+                action(vnc);
+                action = nullptr;
+            }
+        }
+    }
+    replay.wait();
+
+    ClientLog log;
+    CHECK(log.parse(replay.clientData()));
+    return log.requests();
+}
+
+static void check_requests(const char* name, const std::vector<UpdateRequest>& got, const std::vector<UpdateRequest>& want) {
+    int failures = check_failures;
+
+    CHECK_EQ(got.size(), want.size());
+    for (size_t i = 0; i < got.size() && i < want.size(); i++) {
+        CHECK_EQ(got[i].incremental, want[i].incremental);
+        CHECK_EQ(got[i].x, want[i].x);
+        CHECK_EQ(got[i].y, want[i].y);
+        CHECK_EQ(got[i].w, want[i].w);
+        CHECK_EQ(got[i].h, want[i].h);
+    }
+
+    if (failures != check_failures) {
+        fprintf(stderr, "[%s] requests:", name);
+        for (const UpdateRequest& r : got) {
+            fprintf(stderr, " %s(%u,%u %ux%u)", r.incremental ? "inc" : "full", r.x, r.y, r.w, r.h);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+#ifdef VNC_VIEWPORT
+static void pan_right_down(arduinoVNC& vnc) {
+    CHECK(vnc.panViewport(100, 50));
+}
+
+static void zoom_in(arduinoVNC& vnc) {
+    CHECK(vnc.zoomViewport(2.0f, DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2));
+}
+
+static void zoom_in_and_reset(arduinoVNC& vnc) {
+    zoom_in(vnc);
+    CHECK(vnc.resetViewport());
+}
+#else
+static void move_offset(arduinoVNC& vnc) {
+    // x is clamped to the last position that still fills the display
+    vnc.setOffset(1000, 50);
+}
+#endif
+
+void test_update_requests(void) {
+    // a desktop of the display size is asked for as a whole
+    check_requests("full", run_session(320, 240, VNC_SCALE_NONE, nullptr), {
+        { 0, 0, 0, 320, 240 },
+        { 1, 0, 0, 320, 240 },
+        { 1, 0, 0, 320, 240 },
+    });
+
+    // a smaller desktop is centered, the requests stay in server coordinates
+    check_requests("centered", run_session(200, 100, VNC_SCALE_NONE, nullptr), {
+        { 0, 0, 0, 200, 100 },
+        { 1, 0, 0, 200, 100 },
+        { 1, 0, 0, 200, 100 },
+    });
+
+#ifdef VNC_VIEWPORT
+    // a larger desktop at 1:1 is clipped to the window in the top left corner
+    check_requests("clipped", run_session(640, 480, VNC_SCALE_NONE, nullptr), {
+        { 0, 0, 0, 320, 240 },
+        { 1, 0, 0, 320, 240 },
+        { 1, 0, 0, 320, 240 },
+    });
+
+    // shrunk to fit, the whole desktop is visible
+    check_requests("fit", run_session(640, 480, VNC_SCALE_BOX, nullptr), {
+        { 0, 0, 0, 640, 480 },
+        { 1, 0, 0, 640, 480 },
+        { 1, 0, 0, 640, 480 },
+    });
+
+    // panning asks for the strips below and right of the old window
+    check_requests("pan", run_session(640, 480, VNC_SCALE_NONE, pan_right_down), {
+        { 0, 0, 0, 320, 240 },
+        { 1, 0, 0, 320, 240 },
+        { 0, 100, 240, 320, 50 },
+        { 0, 320, 50, 100, 190 },
+        { 1, 100, 50, 320, 240 },
+    });
+
+    // zooming in shows a part that is already cached; the display center
+    // samples server pixel 321/241 at half size and stays in the center
+    check_requests("zoom", run_session(640, 480, VNC_SCALE_BOX, zoom_in), {
+        { 0, 0, 0, 640, 480 },
+        { 1, 0, 0, 640, 480 },
+        { 1, 161, 121, 320, 240 },
+    });
+
+    // zooming out again asks for everything around the zoomed window
+    check_requests("zoom out", run_session(640, 480, VNC_SCALE_BOX, zoom_in_and_reset), {
+        { 0, 0, 0, 640, 480 },
+        { 1, 0, 0, 640, 480 },
+        { 0, 0, 0, 640, 121 },
+        { 0, 0, 361, 640, 119 },
+        { 0, 0, 121, 161, 240 },
+        { 0, 481, 121, 159, 240 },
+        { 1, 0, 0, 640, 480 },
+    });
+#else
+    // a larger desktop at 1:1 is cropped at the offset, 0/0 by default
+    check_requests("clipped", run_session(640, 480, VNC_SCALE_NONE, nullptr), {
+        { 0, 0, 0, 320, 240 },
+        { 1, 0, 0, 320, 240 },
+        { 1, 0, 0, 320, 240 },
+    });
+
+    // a new offset asks for the whole new view at once
+    check_requests("offset", run_session(640, 480, VNC_SCALE_NONE, move_offset), {
+        { 0, 0, 0, 320, 240 },
+        { 1, 0, 0, 320, 240 },
+        { 0, 320, 50, 320, 240 },
+        { 1, 320, 50, 320, 240 },
+    });
+#endif
+}
@@ -0,0 +1,89 @@
+/**
+ * @file DirtyRegion.cpp
+ * @brief Dirty-rectangle accumulator for the VNC display driver
+ */
+
+#include "DirtyRegion.h"
+
+DirtyRegion::DirtyRegion()
+    : _count(0)
+{
+    resetStats();
+}
+
+void DirtyRegion::add(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (w == 0 || h == 0) return;
+
+    _stats.received++;
+
+    DirtyRect r = { x, y, w, h };
+
+    while (true) {
+        // fold in everything that overlaps or touches, the grown rect may
+        // reach further neighbours so start over after each merge
+        bool merged = true;
+        while (merged) {
+            merged = false;
+            for (uint8_t i = 0; i < _count; i++) {
+                DirtyRect b = bounds(_rects[i], r);
+                if (area(b) <= area(_rects[i]) + area(r)) {
+                    r = b;
+                    remove(i);
+                    _stats.merged++;
+                    merged = true;
+                    break;
+                }
+            }
+        }
+
+        if (_count < MAX_RECTS) break;
+
+        // full: merge into the rect whose bounding box grows least
+        uint8_t best = 0;
+        uint64_t bestGrowth = UINT64_MAX;
+        for (uint8_t i = 0; i < _count; i++) {
+            uint64_t growth = area(bounds(_rects[i], r)) - area(_rects[i]);
+            if (growth < bestGrowth) {
+                bestGrowth = growth;
+                best = i;
+            }
+        }
+        r = bounds(_rects[best], r);
+        remove(best);
+        _stats.merged++;
+    }
+
+    _rects[_count++] = r;
+}
+
+void DirtyRegion::clear() {
+    _count = 0;
+}
+
+void DirtyRegion::flushed() {
+    _stats.flushed += _count;
+    _count = 0;
+}
+
+void DirtyRegion::resetStats() {
+    _stats.received = 0;
+    _stats.merged = 0;
+    _stats.flushed = 0;
+}
+
+uint64_t DirtyRegion::area(const DirtyRect& r) {
+    return (uint64_t)r.w * r.h;
+}
+
+DirtyRect DirtyRegion::bounds(const DirtyRect& a, const DirtyRect& b) {
+    uint32_t x0 = a.x < b.x ? a.x : b.x;
+    uint32_t y0 = a.y < b.y ? a.y : b.y;
+    uint32_t x1 = (a.x + a.w) > (b.x + b.w) ? (a.x + a.w) : (b.x + b.w);
+    uint32_t y1 = (a.y + a.h) > (b.y + b.h) ? (a.y + a.h) : (b.y + b.h);
+    DirtyRect r = { x0, y0, x1 - x0, y1 - y0 };
+    return r;
+}
+
+void DirtyRegion::remove(uint8_t i) {
+    _rects[i] = _rects[--_count];
+}
@@ -7,24 +7,51 @@
 
 #ifdef ESP32
 
+// Pixel type of the data handed in by the decoders, matching the byte order
+// negotiated in arduinoVNC::begin()
+#ifdef VNC_NATIVE_PIXEL_ORDER
+typedef lgfx::rgb565_t vnc_pixel_t;
+#else
+typedef lgfx::swap565_t vnc_pixel_t;
+#endif
+
 M5GFX_VNCDriver::M5GFX_VNCDriver(M5GFX* gfx) 
     : _gfx(gfx)
     , _isPaused(false)
+    , _hasShadow(false)
     , _updateX(0)
     , _updateY(0)
     , _updateW(0)
     , _updateH(0)
-    , _pixelCount(0)
+    , _updateCol(0)
+    , _updateRow(0)
+    , _inUpdate(false)
+    , _flushDeadline(0)
+    , _dirtySince(0)
+    , _dropDirty(false)
+    , _presentTask(nullptr)
+    , _panelLock(xSemaphoreCreateMutex())
+    , _repaintPending(false)
+    , _presentBacklog(0)
+    , _overlayArea()
+    , _overlayOn(false)
+    , _overlayPending(false)
+    , _presentStats()
 {
 }
 
 M5GFX_VNCDriver::~M5GFX_VNCDriver() {
+    vSemaphoreDelete(_panelLock);
 }
 
 bool M5GFX_VNCDriver::hasCopyRect(void) {
     return true;
 }
 
+bool M5GFX_VNCDriver::hasJpeg(void) {
+    return true;
+}
+
 uint32_t M5GFX_VNCDriver::getHeight(void) {
     return _gfx->height();
 }
@@ -34,30 +61,35 @@ uint32_t M5GFX_VNCDriver::getWidth(void) {
 }
 
 void M5GFX_VNCDriver::draw_area(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint8_t* data) {
+    if (_hasShadow) {
+        _shadow.draw_area(x, y, w, h, data);
+        markDirty(x, y, w, h);
+        return;
+    }
     if (_isPaused) return;
 
-    _gfx->startWrite();
-    _gfx->setAddrWindow(x, y, w, h);
-    
-    uint16_t* pixels = (uint16_t*)data;
-    uint32_t pixelCount = w * h;
-    
-    for (uint32_t i = 0; i < pixelCount; i++) {
-        uint16_t color = pixels[i];
-        color = (color >> 8) | (color << 8);
-        _gfx->writePixel(x + (i % w), y + (i / w), color);
-    }
-    
-    _gfx->endWrite();
+    // Push the whole rectangle in one transfer; M5GFX handles the byte order
+    // of vnc_pixel_t inside its pixel copy.
+    _gfx->pushImage(x, y, w, h, (const vnc_pixel_t*)data);
 }
 
 void M5GFX_VNCDriver::draw_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint16_t color) {
+    if (_hasShadow) {
+        // the shadow keeps pixels in the negotiated byte order
+        _shadow.draw_rect(x, y, w, h, SwapPixel(color));
+        markDirty(x, y, w, h);
+        return;
+    }
     if (_isPaused) return;
-    uint16_t swappedColor = (color >> 8) | (color << 8);
-    _gfx->fillRect(x, y, w, h, swappedColor);
+    _gfx->fillRect(x, y, w, h, color);
 }
 
 void M5GFX_VNCDriver::copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x, uint32_t dest_y, uint32_t w, uint32_t h) {
+    if (_hasShadow) {
+        _shadow.copy_rect(src_x, src_y, dest_x, dest_y, w, h);
+        markDirty(dest_x, dest_y, w, h);
+        return;
+    }
     if (_isPaused) return;
     
     uint16_t* buffer = (uint16_t*)heap_caps_malloc(w * h * sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
@@ -75,52 +107,311 @@ void M5GFX_VNCDriver::copy_rect(uint32_t src_x, uint32_t src_y, uint32_t dest_x,
     }
 }
 
+bool M5GFX_VNCDriver::draw_jpeg(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint8_t* data, size_t len) {
+    if (_hasShadow) {
+        // decode straight into the shadow, the sprite stores swap565
+        LGFX_Sprite canvas;
+        canvas.setBuffer(_shadow.getPtr(), _shadow.getWidth(), _shadow.getHeight(), lgfx::rgb565_2Byte);
+        if (!canvas.drawJpg(data, len, x, y, w, h)) {
+            return false;
+        }
+#ifdef VNC_NATIVE_PIXEL_ORDER
+        for (uint32_t row = 0; row < h; row++) {
+            uint16_t* p = (uint16_t*)_shadow.getPtr(x, y + row);
+            for (uint32_t i = 0; i < w; i++) {
+                p[i] = (p[i] << 8) | (p[i] >> 8);
+            }
+        }
+#endif
+        markDirty(x, y, w, h);
+        return true;
+    }
+    if (_isPaused) return true;
+    return _gfx->drawJpg(data, len, x, y, w, h);
+}
+
 void M5GFX_VNCDriver::area_update_start(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
     _updateX = x;
     _updateY = y;
     _updateW = w;
     _updateH = h;
-    _pixelCount = 0;
+    _updateCol = 0;
+    _updateRow = 0;
     
-    if (!_isPaused) {
+    if (!_isPaused && !_hasShadow) {
         _gfx->startWrite();
         _gfx->setAddrWindow(x, y, w, h);
     }
 }
 
 void M5GFX_VNCDriver::area_update_data(char* data, uint32_t pixel) {
-    if (_isPaused) {
-        _pixelCount += pixel;
-        return;
+    if (_updateW == 0 || _updateRow >= _updateH) return;
+
+    // Chunks may end anywhere inside a row. The address window wraps rows on
+    // its own, so the whole chunk goes out as one span and the cursors only
+    // remember where the next chunk continues.
+    uint32_t remaining = (_updateH - _updateRow) * _updateW - _updateCol;
+    if (pixel > remaining) {
+        pixel = remaining;
     }
-    
-    uint16_t* pixels = (uint16_t*)data;
-    
-    for (uint32_t i = 0; i < pixel; i++) {
-        uint32_t pos = _pixelCount + i;
-        uint32_t px = _updateX + (pos % _updateW);
-        uint32_t py = _updateY + (pos / _updateW);
-        
-        uint16_t color = pixels[i];
-        color = (color >> 8) | (color << 8);
-        
-        _gfx->writePixel(px, py, color);
+
+    if (_hasShadow) {
+        // the shadow has a different stride, copy row by row
+        uint32_t left = pixel;
+        uint32_t col = _updateCol;
+        uint32_t row = _updateRow;
+        const uint8_t* src = (const uint8_t*)data;
+        while (left) {
+            uint32_t span = min(left, _updateW - col);
+            _shadow.draw_area(_updateX + col, _updateY + row, span, 1, src);
+            src += span * 2;
+            left -= span;
+            col = 0;
+            row++;
+        }
+    } else if (!_isPaused) {
+        _gfx->writePixels((const vnc_pixel_t*)data, pixel);
     }
-    
-    _pixelCount += pixel;
+
+    _updateCol += pixel;
+    _updateRow += _updateCol / _updateW;
+    _updateCol %= _updateW;
 }
 
 void M5GFX_VNCDriver::area_update_end(void) {
-    if (!_isPaused) {
+    if (_hasShadow) {
+        markDirty(_updateX, _updateY, _updateW, _updateH);
+    } else if (!_isPaused) {
         _gfx->endWrite();
     }
-    _pixelCount = 0;
+    _updateCol = 0;
+    _updateRow = 0;
+}
+
+void M5GFX_VNCDriver::framebuffer_update_start(void) {
+    _inUpdate = true;
+}
+
+void M5GFX_VNCDriver::framebuffer_update_end(void) {
+    _inUpdate = false;
+    flush();
+}
+
+uint32_t M5GFX_VNCDriver::present_backlog(void) {
+    return _presentBacklog + (_repaintPending ? 1 : 0);
 }
 
 void M5GFX_VNCDriver::vnc_options_override(dfb_vnc_options* opt) {
     // Override VNC options for optimal performance on Tab5
 }
 
+bool M5GFX_VNCDriver::enableShadowBuffer() {
+    _hasShadow = _shadow.begin(_gfx->width(), _gfx->height(), true);
+    if (_hasShadow) {
+        memset(_shadow.getPtr(), 0, _shadow.currentSize());
+    }
+    return _hasShadow;
+}
+
+void M5GFX_VNCDriver::setPaused(bool paused) {
+    _isPaused = paused;
+    if (paused) {
+        // repaint() covers everything on resume; _dirty belongs to the
+        // decode task, so it drops the regions itself
+        _dropDirty = true;
+        // a push that started before the flag was set finishes first, the
+        // caller may draw its own screen as soon as this returns
+        xSemaphoreTake(_panelLock, portMAX_DELAY);
+        xSemaphoreGive(_panelLock);
+    }
+}
+
+void M5GFX_VNCDriver::flush() {
+    if (_dropDirty.exchange(false)) {
+        _dirty.clear();
+    }
+    if (_dirty.isEmpty()) return;
+
+    if (_presentTask == nullptr) {
+        xSemaphoreTake(_panelLock, portMAX_DELAY);
+        for (uint8_t i = 0; i < _dirty.count() && !_isPaused; i++) {
+            const DirtyRect& r = _dirty.rect(i);
+            pushVisible(r.x, r.y, r.w, r.h);
+        }
+        xSemaphoreGive(_panelLock);
+        _dirty.flushed();
+        return;
+    }
+
+    for (uint8_t i = 0; i < _dirty.count(); i++) {
+        // a full queue means the panel is the bottleneck, wait for it
+        while (!_presentQueue.push(_dirty.rect(i))) {
+            _presentStats.stalls++;
+            xTaskNotifyGive(_presentTask);
+            vTaskDelay(1);
+        }
+        _presentStats.queued++;
+        _presentBacklog++;
+    }
+    _presentStats.maxDepth = max(_presentStats.maxDepth, _presentQueue.size());
+    _dirty.flushed();
+    xTaskNotifyGive(_presentTask);
+}
+
+void M5GFX_VNCDriver::setPresentTask(TaskHandle_t task) {
+    _presentTask = _hasShadow ? task : nullptr;
+}
+
+uint32_t M5GFX_VNCDriver::present() {
+    uint32_t count = 0;
+
+    // held while pushing, setPaused() waits for it
+    xSemaphoreTake(_panelLock, portMAX_DELAY);
+    if (_repaintPending.exchange(false) && !_isPaused) {
+        pushVisible(0, 0, _shadow.getWidth(), _shadow.getHeight());
+        if (_overlayOn) {
+            _overlayPending = true;
+        }
+        count++;
+    }
+
+    // The decode task may already be writing newer pixels into a region
+    // while it is pushed here; that region is queued again by its flush.
+    DirtyRect r;
+    while (_presentQueue.pop(r)) {
+        if (!_isPaused) {
+            pushVisible(r.x, r.y, r.w, r.h);
+            count++;
+        }
+        _presentBacklog--;
+    }
+
+    if (_overlayPending && _overlayOn && !_isPaused) {
+        _overlay.pushSprite(_gfx, _overlayArea.x, _overlayArea.y);
+        _overlayPending = false;
+    }
+    xSemaphoreGive(_panelLock);
+
+    _presentStats.presented += count;
+    return count;
+}
+
+bool M5GFX_VNCDriver::setOverlay(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (!_hasShadow || _overlayOn) return _overlayOn;
+
+    // the canvas is kept after clearOverlay(), the present task may still push it
+    if (_overlay.getBuffer() == nullptr || _overlay.width() != (int32_t)w || _overlay.height() != (int32_t)h) {
+        _overlay.setPsram(true);
+        _overlay.setColorDepth(16);
+        if (_overlay.createSprite(w, h) == nullptr) {
+            return false;
+        }
+    }
+    _overlay.fillSprite(TFT_BLACK);
+    _overlayArea.x = x;
+    _overlayArea.y = y;
+    _overlayArea.w = w;
+    _overlayArea.h = h;
+    _overlayOn = true;
+    presentOverlay();
+    return true;
+}
+
+void M5GFX_VNCDriver::clearOverlay() {
+    if (!_overlayOn) return;
+    _overlayOn = false;
+    _overlayPending = false;
+    // the remote desktop under the overlay is only in the shadow
+    repaint();
+}
+
+LGFX_Sprite* M5GFX_VNCDriver::overlayCanvas() {
+    if (!_overlayOn || _overlayPending) return nullptr;
+    return &_overlay;
+}
+
+void M5GFX_VNCDriver::presentOverlay() {
+    if (!_overlayOn) return;
+    _overlayPending = true;
+    if (_presentTask != nullptr) {
+        xTaskNotifyGive(_presentTask);
+    } else if (!_isPaused) {
+        _overlay.pushSprite(_gfx, _overlayArea.x, _overlayArea.y);
+        _overlayPending = false;
+    }
+}
+
+void M5GFX_VNCDriver::markDirty(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (_dropDirty.exchange(false)) {
+        _dirty.clear();
+    }
+    if (_isPaused) return;
+
+    if (_dirty.isEmpty()) {
+        _dirtySince = millis();
+    }
+    _dirty.add(x, y, w, h);
+
+    // outside of an update there is nothing to coalesce with, a long update
+    // on a slow link still shows progress once the deadline has passed
+    if (!_inUpdate || (_flushDeadline && (millis() - _dirtySince) >= _flushDeadline)) {
+        flush();
+    }
+}
+
+void M5GFX_VNCDriver::repaint() {
+    if (!_hasShadow || _isPaused) return;
+    if (_presentTask != nullptr) {
+        // keep all panel access on the present task
+        _repaintPending = true;
+        xTaskNotifyGive(_presentTask);
+        return;
+    }
+    pushVisible(0, 0, _shadow.getWidth(), _shadow.getHeight());
+}
+
+void M5GFX_VNCDriver::pushVisible(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    const DirtyRect& o = _overlayArea;
+    if (!_overlayOn || x >= o.x + o.w || y >= o.y + o.h || x + w <= o.x || y + h <= o.y) {
+        pushShadow(x, y, w, h);
+        return;
+    }
+
+    // up to four parts around the overlay: above, below, left and right of it
+    uint32_t top = max(y, o.y);
+    uint32_t bottom = min(y + h, o.y + o.h);
+    if (top > y) pushShadow(x, y, w, top - y);
+    if (y + h > bottom) pushShadow(x, bottom, w, y + h - bottom);
+    if (x < o.x) pushShadow(x, top, o.x - x, bottom - top);
+    if (x + w > o.x + o.w) pushShadow(o.x + o.w, top, x + w - (o.x + o.w), bottom - top);
+}
+
+void M5GFX_VNCDriver::pushShadow(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    uint32_t stride = _shadow.getWidth();
+    if (x >= stride || y >= _shadow.getHeight()) return;
+    w = min(w, stride - x);
+    h = min(h, _shadow.getHeight() - y);
+
+    uint32_t start = micros();
+    _gfx->startWrite();
+    _gfx->setAddrWindow(x, y, w, h);
+    if (w == stride) {
+        _gfx->writePixels((const vnc_pixel_t*)_shadow.getPtr(x, y), w * h);
+    } else {
+        const vnc_pixel_t* row = (const vnc_pixel_t*)_shadow.getPtr(x, y);
+        for (uint32_t i = 0; i < h; i++) {
+            _gfx->writePixels(row, w);
+            row += stride;
+        }
+    }
+    _gfx->endWrite();
+
+    uint32_t us = micros() - start;
+    _presentStats.writes++;
+    _presentStats.writeUs += us;
+    _presentStats.maxWriteUs = max(_presentStats.maxWriteUs, us);
+}
+
 void M5GFX_VNCDriver::printScreen(const String& title, const String& msg, uint16_t color) {
     if (_isPaused) return;
     
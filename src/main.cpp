@@ -49,6 +49,18 @@
 // Display settings
 const uint8_t DISPLAY_BRIGHTNESS = 128;         // Display brightness (0-255)
 const uint8_t DISPLAY_ROTATION = 3;             // Display rotation (0-3)
+const uint32_t DISPLAY_FLUSH_DEADLINE = 100;    // Max ms to hold back decoded tiles
+//#define DRAW_BENCHMARK                        // Time per-pixel writes against pushImage at boot (Serial)
+#ifdef VNC_METRICS
+const uint32_t METRICS_INTERVAL = 10000;        // ms between metrics dumps on Serial
+#endif
+const int32_t HUD_WIDTH = 320;                  // Performance overlay in the top right corner
+const int32_t HUD_HEIGHT = 112;
+const int32_t HUD_MARGIN = 8;
+const uint32_t HUD_INTERVAL = 500;              // ms between overlay refreshes
+#ifdef VNC_SCALING
+const vnc_scale_mode_t DISPLAY_SCALING = VNC_SCALE_BOX;  // Desktops larger than the panel: NONE crops, BOX/BILINEAR shrink
+#endif
 
 // ESP32-P4 Tab5 SDIO2 pins for WiFi (ESP32-C6)
 #define SDIO2_CLK GPIO_NUM_12
@@ -84,6 +96,32 @@ uint32_t lastScrollTime = 0;
 const int32_t SCROLL_THRESHOLD = 50;  // Pixels to move before sending scroll event
 const uint32_t SCROLL_MIN_INTERVAL = 100;  // Minimum ms between scroll events
 
+#ifdef VNC_VIEWPORT
+// Pinch zoom / two-finger pan of the viewport
+bool viewportGesture = false;      // Current two-finger touch moves the viewport
+int32_t pinchLastDistance = 0;
+int32_t pinchLastX = 0;
+int32_t pinchLastY = 0;
+uint32_t lastViewportTime = 0;
+const int32_t PINCH_THRESHOLD = 40;         // Change of finger distance before zooming
+const int32_t PAN_THRESHOLD = 8;            // Pixels to move before panning
+const uint32_t VIEWPORT_MIN_INTERVAL = 50;  // Minimum ms between viewport changes
+#endif
+
+#ifdef VNC_METRICS
+uint32_t lastMetricsTime = 0;
+#endif
+
+// Performance HUD
+bool hudEnabled = false;
+uint32_t lastHudTime = 0;
+uint32_t hudLastUpdates = 0;
+uint32_t hudLastBytes = 0;
+int32_t hudButtonX = 0;      // HUD toggle on the info screen
+int32_t hudButtonY = 0;
+const int32_t HUD_BUTTON_WIDTH = 360;
+const int32_t HUD_BUTTON_HEIGHT = 70;
+
 // Connection state
 bool wifiConnected = false;
 bool vncConnected = false;
@@ -108,6 +146,7 @@ const int32_t SWIPE_START_DISTANCE = 20; // Minimum movement to start swipe mode
 const int32_t SWIPE_MIN_DISTANCE = 100;  // Minimum swipe distance to complete
 const uint32_t SWIPE_MAX_TIME = 1000;    // Maximum swipe time (ms)/ Task handles
 TaskHandle_t vncTaskHandle = nullptr;
+TaskHandle_t presentTaskHandle = nullptr;
 
 // ============================================================================
 // Function prototypes
@@ -117,7 +156,9 @@ void setupDisplay();
 void setupWiFi();
 void setupVNC();
 void vncTask(void* pvParameters);
+void presentTask(void* pvParameters);
 void handleTouch();
+bool handleViewportGesture(bool started);
 void checkMultiTouch();
 void checkSwipeGesture();
 void displayStatus(const String& title, const String& message, uint16_t color);
@@ -127,6 +168,17 @@ void showInfoScreen();
 String getVNCAddress();
 void pauseVNCScreen();
 void resumeVNCScreen();
+void checkInfoScreenTouch();
+void drawHudButton();
+void setHud(bool enabled);
+void updateHud();
+const char* encodingName(int32_t encoding);
+#ifdef VNC_METRICS
+void dumpMetrics();
+#endif
+#ifdef DRAW_BENCHMARK
+void drawBenchmark();
+#endif
 
 void setupCardKB();
 uint8_t cardkb_getch();
@@ -167,6 +219,21 @@ void setup() {
     // setup CardKB if available
     setupCardKB();
 
+    // Create present task on core 1, it pushes decoded regions from the
+    // shadow framebuffer to the panel while the VNC task keeps decoding
+    if (vncDisplay->hasShadowBuffer()) {
+        xTaskCreatePinnedToCore(
+            presentTask,           // Task function
+            "present_task",        // Task name
+            8192,                  // Stack size (bytes)
+            NULL,                  // Task parameters
+            1,                     // Priority
+            &presentTaskHandle,    // Task handle
+            1                      // Core ID (0 or 1)
+        );
+        vncDisplay->setPresentTask(presentTaskHandle);
+    }
+
     // Create VNC task on core 0 (core 1 is used for Arduino loop)
     xTaskCreatePinnedToCore(
         vncTask,           // Task function
@@ -194,6 +261,14 @@ void loop() {
     
     // Check for swipe down gesture from top edge
     checkSwipeGesture();
+
+    // HUD toggle on the info screen
+    checkInfoScreenTouch();
+
+    // Refresh the performance overlay
+    if (hudEnabled && !showingInfoScreen && millis() - lastHudTime >= HUD_INTERVAL) {
+        updateHud();
+    }
     
     // Handle button press for reconnection
     if (M5.BtnA.wasPressed() || M5.BtnPWR.wasPressed()) {
@@ -257,6 +332,12 @@ void vncTask(void* pvParameters) {
                 if (!vncScreenPaused && !showingInfoScreen) {
                     handleTouch();
                 }
+#ifdef VNC_METRICS
+                if (millis() - lastMetricsTime >= METRICS_INTERVAL) {
+                    lastMetricsTime = millis();
+                    dumpMetrics();
+                }
+#endif
             }
         }
         
@@ -265,6 +346,106 @@ void vncTask(void* pvParameters) {
     }
 }
 
+// ============================================================================
+// Present Task (runs on core 1)
+// ============================================================================
+
+void presentTask(void* pvParameters) {
+    Serial.println("Present task started on core " + String(xPortGetCoreID()));
+    
+    while (true) {
+        // Sleep until the VNC task has queued regions (or a repaint)
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vncDisplay->present();
+    }
+}
+
+#ifdef VNC_METRICS
+// ============================================================================
+// Metrics
+// ============================================================================
+
+/**
+ * @brief Print the session metrics and the panel write times on Serial
+ */
+void dumpMetrics() {
+    vnc->getMetrics().dump([](const char* line) { Serial.println(line); });
+
+    const PresentStats& ps = vncDisplay->getPresentStats();
+    Serial.printf("[metrics] panel writes=%u avg=%u max=%u queued=%u stalls=%u depth=%u\n",
+                  (unsigned)ps.writes, ps.writes ? (unsigned)(ps.writeUs / ps.writes) : 0u, (unsigned)ps.maxWriteUs,
+                  (unsigned)ps.queued, (unsigned)ps.stalls, (unsigned)ps.maxDepth);
+}
+#endif
+
+#ifdef DRAW_BENCHMARK
+// ============================================================================
+// Draw benchmark
+// ============================================================================
+
+/**
+ * @brief Time the per-pixel loop draw_area used to have against pushImage
+ *
+ * Covers the screen with full screen, ZRLE (64x64) and Hextile (16x16)
+ * rectangles. Each size is drawn twice: once with one writePixel per pixel
+ * as draw_area did before, once with one pushImage per rectangle as it
+ * does now. Both rates are printed on Serial. It needs the panel, so the
+ * native build cannot run it.
+ */
+void drawBenchmark() {
+    static const uint32_t sizes[][2] = { { 0, 0 }, { 64, 64 }, { 16, 16 } };
+    uint32_t width = M5.Display.width();
+    uint32_t height = M5.Display.height();
+
+    uint16_t* pixels = (uint16_t*)heap_caps_malloc(width * height * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (pixels == nullptr) {
+        Serial.println("[drawBenchmark] no memory for the test image");
+        return;
+    }
+    // big-endian RGB565 as the decoders hand it in
+    for (uint32_t i = 0; i < width * height; i++) {
+        uint16_t color = i * 7;
+        pixels[i] = (color >> 8) | (color << 8);
+    }
+
+    for (const auto& size : sizes) {
+        uint32_t w = size[0] ? size[0] : width;
+        uint32_t h = size[1] ? size[1] : height;
+        uint64_t count = 0;
+
+        uint32_t start = micros();
+        for (uint32_t y = 0; y + h <= height; y += h) {
+            for (uint32_t x = 0; x + w <= width; x += w) {
+                M5.Display.startWrite();
+                M5.Display.setAddrWindow(x, y, w, h);
+                for (uint32_t i = 0; i < w * h; i++) {
+                    uint16_t color = pixels[i];
+                    color = (color >> 8) | (color << 8);
+                    M5.Display.writePixel(x + (i % w), y + (i / w), color);
+                }
+                M5.Display.endWrite();
+                count += w * h;
+            }
+        }
+        uint32_t pixelUs = micros() - start;
+
+        start = micros();
+        for (uint32_t y = 0; y + h <= height; y += h) {
+            for (uint32_t x = 0; x + w <= width; x += w) {
+                M5.Display.pushImage(x, y, w, h, (const lgfx::swap565_t*)pixels);
+            }
+        }
+        uint32_t pushUs = micros() - start;
+
+        Serial.printf("[drawBenchmark] %ux%u: writePixel %.2f Mpixel/s, pushImage %.2f Mpixel/s\n",
+                      (unsigned)w, (unsigned)h, (float)count / pixelUs, (float)count / pushUs);
+    }
+
+    heap_caps_free(pixels);
+    M5.Display.fillScreen(TFT_BLACK);
+}
+#endif
+
 // ============================================================================
 // Display setup
 // ============================================================================
@@ -281,9 +462,21 @@ void setupDisplay() {
     // Clear display
     M5.Display.fillScreen(TFT_BLACK);
     
+#ifdef DRAW_BENCHMARK
+    drawBenchmark();
+#endif
+    
     // Create VNC display driver
     vncDisplay = new M5GFX_VNCDriver(&M5.Display);
     
+    // Keep a copy of the remote desktop in PSRAM (falls back to direct drawing)
+    if (vncDisplay->enableShadowBuffer()) {
+        Serial.println("Shadow framebuffer allocated in PSRAM");
+        vncDisplay->setFlushDeadline(DISPLAY_FLUSH_DEADLINE);
+    } else {
+        Serial.println("Shadow framebuffer not available - drawing directly");
+    }
+    
     // Display startup message
     displayStatus("M5Stack Tab5", "VNC Client Starting...", TFT_CYAN);
     
@@ -353,6 +546,9 @@ void setupVNC() {
     // Configure VNC connection
     vnc->begin(VNC_HOST, VNC_PORT);
     vnc->setPassword(VNC_PASSWORD);
+#ifdef VNC_SCALING
+    vnc->setScaling(DISPLAY_SCALING);
+#endif
     Serial.println("VNC client initialized");
 }
 
@@ -510,10 +706,13 @@ void showVNCScreen() {
     showingInfoScreen = false;
     
     // Clear the screen to remove info screen content
-    M5.Display.fillScreen(TFT_BLACK);
-    
-    // Small delay to ensure screen clear is complete
-    delay(50);
+    // (not needed when the shadow framebuffer repaints every pixel)
+    if (vncDisplay == nullptr || !vncDisplay->hasShadowBuffer()) {
+        M5.Display.fillScreen(TFT_BLACK);
+        
+        // Small delay to ensure screen clear is complete
+        delay(50);
+    }
     
     // Resume VNC drawing
     resumeVNCScreen();
@@ -594,6 +793,8 @@ void displayConnectionInfo() {
         M5.Display.drawString("VNC Disconnected", M5.Display.width() * 3 / 4, y + 28);
     }
     
+    drawHudButton();
+
     // Footer instruction
     M5.Display.setFont(&fonts::FreeSans12pt7b);
     M5.Display.setTextColor(TFT_LIGHTGREY);
@@ -602,6 +803,123 @@ void displayConnectionInfo() {
                           M5.Display.width() / 2, M5.Display.height() - 30);
 }
 
+// ============================================================================
+// Performance HUD
+// ============================================================================
+
+/**
+ * @brief Draw the HUD on/off button of the info screen
+ */
+void drawHudButton() {
+    hudButtonX = M5.Display.width() - HUD_BUTTON_WIDTH - 40;
+    hudButtonY = 110;
+
+    M5.Display.fillRoundRect(hudButtonX, hudButtonY, HUD_BUTTON_WIDTH, HUD_BUTTON_HEIGHT, 12,
+                             hudEnabled ? TFT_DARKGREEN : TFT_DARKGREY);
+    M5.Display.setFont(&fonts::FreeSansBold12pt7b);
+    M5.Display.setTextColor(TFT_WHITE);
+    M5.Display.setTextDatum(MC_DATUM);
+    M5.Display.drawString(hudEnabled ? "Performance HUD: ON" : "Performance HUD: OFF",
+                          hudButtonX + HUD_BUTTON_WIDTH / 2, hudButtonY + HUD_BUTTON_HEIGHT / 2);
+}
+
+/**
+ * @brief Toggle the HUD when its button on the info screen is tapped
+ */
+void checkInfoScreenTouch() {
+    if (!showingInfoScreen) return;
+
+    auto touch = M5.Touch.getDetail();
+    if (!touch.wasClicked()) return;
+
+    if (touch.x >= hudButtonX && touch.x < hudButtonX + HUD_BUTTON_WIDTH &&
+        touch.y >= hudButtonY && touch.y < hudButtonY + HUD_BUTTON_HEIGHT) {
+        setHud(!hudEnabled);
+        drawHudButton();
+    }
+}
+
+/**
+ * @brief Reserve or release the overlay corner for the HUD
+ * @param enabled true to show the HUD
+ *
+ * Needs the shadow framebuffer, the remote desktop under the HUD is
+ * repainted from it when the HUD is turned off.
+ */
+void setHud(bool enabled) {
+    if (vncDisplay == nullptr) return;
+
+    if (enabled) {
+        enabled = vncDisplay->setOverlay(M5.Display.width() - HUD_WIDTH - HUD_MARGIN, HUD_MARGIN,
+                                         HUD_WIDTH, HUD_HEIGHT);
+        if (!enabled) {
+            Serial.println("[setHud] Overlay needs the shadow framebuffer");
+        }
+    } else {
+        vncDisplay->clearOverlay();
+    }
+    hudEnabled = enabled;
+    lastHudTime = 0;
+    Serial.printf("[setHud] Performance HUD %s\n", hudEnabled ? "on" : "off");
+}
+
+const char* encodingName(int32_t encoding) {
+    switch (encoding) {
+        case rfbEncodingRaw:      return "Raw";
+        case rfbEncodingCopyRect: return "CopyRect";
+        case rfbEncodingRRE:      return "RRE";
+        case rfbEncodingCoRRE:    return "CoRRE";
+        case rfbEncodingHextile:  return "Hextile";
+        case rfbEncodingZlibHex:  return "ZlibHex";
+        case rfbEncodingZlib:     return "Zlib";
+        case rfbEncodingTight:    return "Tight";
+        case rfbEncodingZRLE:     return "ZRLE";
+        case rfbEncodingZYWRLE:   return "ZYWRLE";
+        default:                  return "-";
+    }
+}
+
+/**
+ * @brief Draw the current rates into the overlay canvas
+ */
+void updateHud() {
+    if (vnc == nullptr || vncDisplay == nullptr) return;
+
+    LGFX_Sprite* canvas = vncDisplay->overlayCanvas();
+    if (canvas == nullptr) return;  // the last one is not on the panel yet
+
+    uint32_t now = millis();
+    float seconds = lastHudTime ? (now - lastHudTime) / 1000.0f : 0;
+    const vnc_update_stats_t& stats = vnc->getUpdateStats();
+    uint32_t bytes = vnc->getReceivedBytes();
+
+    float fps = 0;
+    float mbps = 0;
+    if (seconds > 0 && stats.updates >= hudLastUpdates) {
+        fps = (stats.updates - hudLastUpdates) / seconds;
+        mbps = (bytes - hudLastBytes) * 8 / seconds / 1e6f;
+    }
+    hudLastUpdates = stats.updates;
+    hudLastBytes = bytes;
+    lastHudTime = now;
+
+    canvas->fillSprite(TFT_BLACK);
+    canvas->drawRect(0, 0, HUD_WIDTH, HUD_HEIGHT, TFT_DARKGREY);
+    canvas->setFont(&fonts::FreeSans9pt7b);
+    canvas->setTextDatum(TL_DATUM);
+    canvas->setTextColor(TFT_GREEN);
+    canvas->drawString(String(fps, 1) + " fps   " + String(mbps, 2) + " Mbit/s", 10, 8);
+    canvas->setTextColor(TFT_WHITE);
+    canvas->drawString("decode " + String(stats.decodeUs / 1000.0f, 1) + " ms  present " +
+                       String(stats.presentUs / 1000.0f, 1) + " ms", 10, 34);
+    canvas->drawString("heap " + String(ESP.getFreeHeap() / 1024) + " KB  PSRAM " +
+                       String(ESP.getFreePsram() / 1024) + " KB", 10, 60);
+    canvas->setTextColor(TFT_CYAN);
+    canvas->drawString(String("encoding ") + encodingName(stats.encoding), 10, 86);
+
+    vncDisplay->presentOverlay();
+}
+
 // ============================================================================
 // Screen control methods (for switching between VNC and other screens)
 // ============================================================================
@@ -621,9 +939,12 @@ void resumeVNCScreen() {
         vncScreenPaused = false;
         Serial.println("VNC screen resumed - drawing enabled");
         
-        // Request full screen update from VNC server
-        if (vnc != nullptr && vnc->connected()) {
-            // Force immediate full update
+        // Updates received while paused are already in the shadow framebuffer
+        if (vncDisplay->hasShadowBuffer()) {
+            vncDisplay->repaint();
+            Serial.println("Repainted VNC screen from shadow framebuffer");
+        } else if (vnc != nullptr && vnc->connected()) {
+            // Request full screen update from VNC server
             vnc->forceFullUpdate();
             Serial.println("Requested full screen update from VNC server");
             
@@ -735,6 +1056,17 @@ void handleTouch() {
     
     // Handle two-finger scroll
     if (touchCount == 2) {
+#ifdef VNC_VIEWPORT
+        // Pinch and, while zoomed in, drag move the viewport instead
+        if (handleViewportGesture(!twoFingerScrollActive)) {
+            if (!twoFingerScrollActive && wasTouched) {
+                vnc->mouseEvent(lastTouchX, lastTouchY, 0b000);
+                wasTouched = false;
+            }
+            twoFingerScrollActive = true;
+            return;
+        }
+#endif
         if (!twoFingerScrollActive) {
             // Start two-finger scroll
             twoFingerScrollActive = true;
@@ -807,6 +1139,54 @@ void handleTouch() {
     }
 }
 
+#ifdef VNC_VIEWPORT
+/**
+ * Pinch zoom and two-finger pan of the viewport
+ * @param started first call for the current two-finger touch
+ * @return true if the touch moves the viewport and must not scroll
+ */
+bool handleViewportGesture(bool started) {
+    auto a = M5.Touch.getDetail(0);
+    auto b = M5.Touch.getDetail(1);
+    int32_t midX = (a.x + b.x) / 2;
+    int32_t midY = (a.y + b.y) / 2;
+    int32_t distance = (int32_t)sqrtf((float)(a.x - b.x) * (a.x - b.x) + (float)(a.y - b.y) * (a.y - b.y));
+
+    if (started) {
+        viewportGesture = false;
+        pinchLastDistance = distance;
+        pinchLastX = midX;
+        pinchLastY = midY;
+        return false;
+    }
+
+    uint32_t now = millis();
+    if ((now - lastViewportTime) < VIEWPORT_MIN_INTERVAL) {
+        return viewportGesture;
+    }
+
+    if (abs(distance - pinchLastDistance) >= PINCH_THRESHOLD && pinchLastDistance > 0) {
+        // Zoom around the fingers, then follow them
+        vnc->zoomViewport((float)distance / pinchLastDistance, midX, midY);
+        vnc->panViewport(pinchLastX - midX, pinchLastY - midY);
+        pinchLastDistance = distance;
+        pinchLastX = midX;
+        pinchLastY = midY;
+        lastViewportTime = now;
+        viewportGesture = true;
+    } else if (vnc->canPanViewport() &&
+               (abs(midX - pinchLastX) >= PAN_THRESHOLD || abs(midY - pinchLastY) >= PAN_THRESHOLD)) {
+        // The desktop follows the fingers
+        vnc->panViewport(pinchLastX - midX, pinchLastY - midY);
+        pinchLastX = midX;
+        pinchLastY = midY;
+        lastViewportTime = now;
+        viewportGesture = true;
+    }
+    return viewportGesture;
+}
+#endif
+
 // ============================================================================
 // Helper functions
 // ============================================================================